@@ -82,16 +82,22 @@ typedef struct _zgossip_t zgossip_t;
 #define ZGOSSIP_T_DEFINED
 typedef struct _zhashx_t zhashx_t;
 #define ZHASHX_T_DEFINED
+typedef struct _zjournal_t zjournal_t;
+#define ZJOURNAL_T_DEFINED
 typedef struct _ziflist_t ziflist_t;
 #define ZIFLIST_T_DEFINED
 typedef struct _zlistx_t zlistx_t;
 #define ZLISTX_T_DEFINED
 typedef struct _zloop_t zloop_t;
 #define ZLOOP_T_DEFINED
+typedef struct _zloop_pool_t zloop_pool_t;
+#define ZLOOP_POOL_T_DEFINED
 typedef struct _zmonitor_t zmonitor_t;
 #define ZMONITOR_T_DEFINED
 typedef struct _zmsg_t zmsg_t;
 #define ZMSG_T_DEFINED
+typedef struct _zpicture_t zpicture_t;
+#define ZPICTURE_T_DEFINED
 typedef struct _zpoller_t zpoller_t;
 #define ZPOLLER_T_DEFINED
 typedef struct _zproxy_t zproxy_t;
@@ -149,11 +155,14 @@ typedef struct _zthread_t zthread_t;
 #include "zframe.h"
 #include "zgossip.h"
 #include "zhashx.h"
+#include "zjournal.h"
 #include "ziflist.h"
 #include "zlistx.h"
 #include "zloop.h"
+#include "zloop_pool.h"
 #include "zmonitor.h"
 #include "zmsg.h"
+#include "zpicture.h"
 #include "zpoller.h"
 #include "zproxy.h"
 #include "zrex.h"
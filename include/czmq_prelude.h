@@ -275,6 +275,7 @@
 #   include <sys/wait.h>
 #   include <sys/un.h>
 #   include <sys/uio.h>             //  Let CZMQ build with libzmq/3.x
+#   include <sys/mman.h>            //  For zjournal replay
 #   include <netinet/in.h>          //  Must come before arpa/inet.h
 #   if (!defined (__UTYPE_ANDROID)) && (!defined (__UTYPE_IBMAIX)) \
     && (!defined (__UTYPE_HPUX))
@@ -309,6 +310,11 @@
 #   if (defined (__UTYPE_ANDROID))
 #       include <android/log.h>
 #   endif
+#   if (defined (__UTYPE_LINUX))
+#       include <sys/epoll.h>            //  For zloop epoll backend
+#       include <sys/eventfd.h>          //  For zloop_post wakeup
+#       include <sys/timerfd.h>          //  For zloop microsecond timers
+#   endif
 #endif
 
 #if (defined (__VMS__))
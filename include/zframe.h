@@ -25,6 +25,10 @@ extern "C" {
 #define ZFRAME_REUSE 2                      // 
 #define ZFRAME_DONTWAIT 4                   // 
 
+// Callback function to free zero-copy frame data
+typedef void (zframe_free_fn) (
+    void *data, void *hint);
+
 //  Create a new frame. If size is not null, allocates the frame data
 //  to the specified size. If additionally, data is not null, copies 
 //  size octets from the specified data into the frame body.         
@@ -40,6 +44,18 @@ CZMQ_EXPORT void
 CZMQ_EXPORT zframe_t *
     zframe_new_empty (void);
 
+//  Create a frame that uses the caller's data as its body, without copying
+//  it. The frame takes ownership of the data, and calls free_fn with the  
+//  data and the hint when the frame and any copies of it are sent or      
+//  destroyed, and libzmq no longer needs the data. The free function is   
+//  called exactly once, and may be called from a libzmq I/O thread. If    
+//  free_fn is null, the data must stay valid for as long as libzmq may use
+//  it, e.g. static data. Returns NULL if the frame could not be created,  
+//  in which case the caller still owns the data.                          
+//  The caller is responsible for destroying the return value when finished with it.
+CZMQ_EXPORT zframe_t *
+    zframe_new_zero_copy (void *data, size_t size, zframe_free_fn *free_fn, void *hint);
+
 //  Receive frame from socket, returns zframe_t object or NULL if the recv  
 //  was interrupted. Does a blocking recv, if you want to not block then use
 //  zpoller or zloop.                                                       
@@ -47,6 +63,13 @@ CZMQ_EXPORT zframe_t *
 CZMQ_EXPORT zframe_t *
     zframe_recv (void *source);
 
+//  Receive frame from socket into an existing frame, replacing its former
+//  contents, so a loop that reads many frames can use one frame object.  
+//  Returns 0 if OK, or -1 if the recv was interrupted, in which case the 
+//  frame is left empty. Does a blocking recv, like zframe_recv.          
+CZMQ_EXPORT int
+    zframe_recv_into (zframe_t *self, void *source);
+
 //  Send a frame to a socket, destroy frame after sending.
 //  Return -1 on error, 0 on success.                     
 CZMQ_EXPORT int
@@ -56,12 +79,19 @@ CZMQ_EXPORT int
 CZMQ_EXPORT size_t
     zframe_size (zframe_t *self);
 
-//  Return address of frame data
+//  Return address of frame data. If the frame shares its data with a       
+//  duplicate, first takes a private copy, so the caller may modify it.     
+//  Asserts if there is not enough memory for the copy. Note that a pointer 
+//  you got before duplicating the frame still refers to the shared data, so
+//  do not modify the data through it.                                      
 CZMQ_EXPORT byte *
     zframe_data (zframe_t *self);
 
 //  Create a new frame that duplicates an existing frame. If frame is null,
-//  or memory was exhausted, returns null.                                 
+//  or memory was exhausted, returns null. Where libzmq allows, the copy   
+//  shares the frame data rather than copying it; either frame takes its   
+//  own copy if its data is then modified via zframe_data, until the other 
+//  frames sharing the data are destroyed or sent.                         
 //  The caller is responsible for destroying the return value when finished with it.
 CZMQ_EXPORT zframe_t *
     zframe_dup (zframe_t *self);
@@ -115,6 +145,27 @@ CZMQ_EXPORT void
     zframe_test (bool verbose);
 //  @end
 
+//  Return pointer to frame data, without taking a private copy if the frame
+//  shares its data, so the caller must not modify the data. Not a part of
+//  the official interface; CZMQ classes use this to read frames.
+CZMQ_EXPORT const byte *
+    zframe_peek (zframe_t *self);
+
+//  Receive frame into an existing frame, as zframe_recv_into, from the
+//  libzmq socket handle that the caller resolved from source. Flags may be
+//  ZFRAME_DONTWAIT. Returns 0 if OK, or -1 if no frame was waiting or the
+//  recv was interrupted, in which case the frame is not changed. Not a
+//  part of the official interface; CZMQ classes use this to read many
+//  frames with one resolve.
+CZMQ_EXPORT int
+    zframe_recv_resolved (zframe_t *self, void *source, void *handle, int flags);
+
+//  Send frame, as zframe_send, on the libzmq socket handle that the caller
+//  resolved from dest. Not a part of the official interface; CZMQ classes
+//  use this to send many frames with one resolve.
+CZMQ_EXPORT int
+    zframe_send_resolved (zframe_t **self_p, void *dest, void *handle, int flags);
+
 //  DEPRECATED as poor style -- callers should use zloop or zpoller
 //  Receive a new frame off the socket. Returns newly allocated frame, or
 //  NULL if there was no input waiting, or if the read was interrupted.
@@ -0,0 +1,106 @@
+/*  =========================================================================
+    zjournal - append-only message journal
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZJOURNAL_H_INCLUDED__
+#define __ZJOURNAL_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @warning THE FOLLOWING @INTERFACE BLOCK IS AUTO-GENERATED BY ZPROJECT!
+//  @warning Please edit the model at "api/zjournal.xml" to make changes.
+//  @interface
+//  Create a new journal, or open an existing one, in the specified     
+//  directory, which is created if needed. Returns NULL if the directory
+//  could not be created or an existing journal could not be read.      
+CZMQ_EXPORT zjournal_t *
+    zjournal_new (const char *path);
+
+//  Destroy a journal, writing any messages not yet written. Messages that
+//  were replayed from the journal stay valid until they are destroyed.   
+CZMQ_EXPORT void
+    zjournal_destroy (zjournal_t **self_p);
+
+//  Set the size at which the journal starts a new segment file. The      
+//  default is 64MB. A message larger than this gets a segment of its own.
+CZMQ_EXPORT void
+    zjournal_set_segment_size (zjournal_t *self, size_t segment_size);
+
+//  Set the size of the batch of appended messages that the journal holds 
+//  before writing them to disk. The default is 64KB. Set to zero to write
+//  each message as it is appended.                                       
+CZMQ_EXPORT void
+    zjournal_set_batch_size (zjournal_t *self, size_t batch_size);
+
+//  If sync is true, the journal flushes each batch it writes to stable    
+//  storage, so that appended messages survive a system crash once written.
+//  By default, the journal leaves this to the operating system.           
+CZMQ_EXPORT void
+    zjournal_set_sync (zjournal_t *self, bool sync);
+
+//  Set how many messages each index entry covers, for segments created from
+//  now on. Reading a message by sequence number scans up to this many      
+//  records. The default is 64.                                             
+CZMQ_EXPORT void
+    zjournal_set_index_interval (zjournal_t *self, size_t interval);
+
+//  Append a message to the journal. Does not destroy the message. Returns
+//  0 if OK, or -1 if the message could not be written.                   
+CZMQ_EXPORT int
+    zjournal_append (zjournal_t *self, zmsg_t *msg);
+
+//  Write any appended messages that are still held in memory, and flush
+//  them to stable storage if sync is enabled. Returns 0 if OK, or -1 if
+//  the write failed, in which case the journal keeps the messages, and 
+//  writes them again on the next flush.                                
+CZMQ_EXPORT int
+    zjournal_flush (zjournal_t *self);
+
+//  Return the number of messages in the journal, which is also the sequence
+//  number of the next message to be appended.                              
+CZMQ_EXPORT uint64_t
+    zjournal_size (zjournal_t *self);
+
+//  Position replay at the specified sequence number, so the next call to 
+//  zjournal_next returns that message. Returns 0 if OK, or -1 if there is
+//  no such message.                                                      
+CZMQ_EXPORT int
+    zjournal_seek (zjournal_t *self, uint64_t sequence);
+
+//  Return the message at the replay position, and move to the following   
+//  message. Replay starts at the first message in the journal, unless you 
+//  call zjournal_seek. Returns NULL at the end of the journal, or if the  
+//  message could not be read. Frames refer to the journal file rather than
+//  copying it, where the system allows.                                   
+//  The caller is responsible for destroying the return value when finished with it.
+CZMQ_EXPORT zmsg_t *
+    zjournal_next (zjournal_t *self);
+
+//  Return the message with the specified sequence number, or NULL if there
+//  is no such message or it could not be read. Moves the replay position  
+//  to the following message.                                              
+//  The caller is responsible for destroying the return value when finished with it.
+CZMQ_EXPORT zmsg_t *
+    zjournal_read (zjournal_t *self, uint64_t sequence);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zjournal_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
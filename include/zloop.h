@@ -33,6 +33,10 @@ typedef int (zloop_fn) (
 typedef int (zloop_timer_fn) (
     zloop_t *loop, int timer_id, void *arg);
 
+// Callback for functions posted to the reactor
+typedef int (zloop_post_fn) (
+    zloop_t *loop, void *arg);
+
 //  Create a new zloop reactor
 CZMQ_EXPORT zloop_t *
     zloop_new ();
@@ -58,6 +62,41 @@ CZMQ_EXPORT void
 CZMQ_EXPORT void
     zloop_reader_set_tolerant (zloop_t *self, zsock_t *sock);
 
+//  Configure a registered reader to drain its socket in batches. While the
+//  socket still has input, the reactor calls the handler again, up to the 
+//  specified number of calls or milliseconds per pass, whichever comes    
+//  first, and then moves on to other readers. If msecs is zero, only the  
+//  number of calls is limited. Setting calls to 1 restores the default of 
+//  one call per pass.                                                     
+CZMQ_EXPORT void
+    zloop_reader_set_batch (zloop_t *self, zsock_t *sock, size_t calls, size_t msecs);
+
+//  Set the priority of a registered reader, from 0 (the default) to 7. In
+//  each pass, the reactor services ready readers and pollers in order of 
+//  priority, highest first, and items with the same priority in the order
+//  they were registered. Give control and heartbeat sockets a higher     
+//  priority than bulk data, so a flood of data does not delay them.      
+CZMQ_EXPORT void
+    zloop_reader_set_priority (zloop_t *self, zsock_t *sock, int priority);
+
+//  Set the events a registered reader waits for: ZMQ_POLLIN (the default), 
+//  ZMQ_POLLOUT, both, or zero to pause the reader. With ZMQ_POLLOUT, the   
+//  reactor calls the handler when the socket can accept a message without  
+//  blocking, so a producer that hit the high-water mark can wait for its   
+//  peer to drain, instead of blocking or spinning. The handler can check   
+//  zsock_events to tell input from output. Drop ZMQ_POLLOUT when there is  
+//  nothing more to send, or the reactor will call the handler on each pass.
+CZMQ_EXPORT void
+    zloop_reader_set_events (zloop_t *self, zsock_t *sock, int events);
+
+//  Check a registered reader's socket again on the next pass, whether or
+//  not it signals. With epoll, call this from a handler that sends on a 
+//  socket registered as a reader in the same loop, since sending can    
+//  consume the signal that would have woken that reader. With zmq_poll, 
+//  this does nothing, as every socket is checked on each pass.          
+CZMQ_EXPORT void
+    zloop_reader_rearm (zloop_t *self, zsock_t *sock);
+
 //  Register low-level libzmq pollitem with the reactor. When the pollitem  
 //  is ready, will call the handler, passing the arg. Returns 0 if OK, -1   
 //  if there was an error. If you register the pollitem more than once, each
@@ -77,6 +116,11 @@ CZMQ_EXPORT void
 CZMQ_EXPORT void
     zloop_poller_set_tolerant (zloop_t *self, zmq_pollitem_t *item);
 
+//  Set the priority of a registered poller, specified by socket or FD, as
+//  for readers. Overload shedding does not apply to pollers.             
+CZMQ_EXPORT void
+    zloop_poller_set_priority (zloop_t *self, zmq_pollitem_t *item, int priority);
+
 //  Register a timer that expires after some delay and repeats some number of
 //  times. At each expiry, will call the handler, passing the arg. To run a  
 //  timer forever, use 0 times. Returns a timer_id that is used to cancel the
@@ -84,8 +128,25 @@ CZMQ_EXPORT void
 CZMQ_EXPORT int
     zloop_timer (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler, void *arg);
 
+//  Register a timer with a delay in microseconds, which otherwise works as
+//  zloop_timer. On Linux, the reactor wakes up at the exact time the timer
+//  is due; on other systems it may wake up to one msec late.              
+CZMQ_EXPORT int
+    zloop_timer_us (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler, void *arg);
+
+//  Allow a timer to go off up to the specified number of usecs late. The
+//  reactor uses this to handle several timers in one wakeup, so low     
+//  priority timers should have some slack. A timer with slack still goes
+//  off as early as it can, if the reactor is awake. Timers have no slack
+//  by default. Returns 0 if OK, -1 if there is no such timer.           
+CZMQ_EXPORT int
+    zloop_timer_set_slack (zloop_t *self, int timer_id, size_t slack);
+
 //  Cancel a specific timer identified by a specific timer_id (as returned by
-//  zloop_timer).                                                            
+//  zloop_timer). The timer is found by its id without a search, and taken   
+//  off the timer heap, so this costs O(log n) in the number of timers. It   
+//  is safe to call from any handler, including the handler of the timer     
+//  being cancelled.                                                         
 CZMQ_EXPORT int
     zloop_timer_end (zloop_t *self, int timer_id);
 
@@ -97,34 +158,103 @@ CZMQ_EXPORT int
 //  cost of ticket timers is constant, no matter the number of clients. You  
 //  must set the ticket delay using zloop_set_ticket_delay before creating a 
 //  ticket. Returns a handle to the timer that you should use in             
-//  zloop_ticket_reset and zloop_ticket_delete.                              
+//  zloop_ticket_reset and zloop_ticket_delete. A ticket fires once, and is  
+//  then deleted, unless its handler resets it.                              
 CZMQ_EXPORT void *
     zloop_ticket (zloop_t *self, zloop_timer_fn handler, void *arg);
 
-//  Reset a ticket timer, which moves it to the end of the ticket list and
-//  resets its execution time. This is a very fast operation.             
+//  Reset a ticket timer, which moves it to the wheel slot for its new
+//  execution time. This is a very fast operation.                    
 CZMQ_EXPORT void
     zloop_ticket_reset (zloop_t *self, void *handle);
 
-//  Delete a ticket timer. We do not actually delete the ticket here, as    
-//  other code may still refer to the ticket. We mark as deleted, and remove
-//  later and safely.                                                       
+//  Set the delay for one ticket, in msecs, in place of the ticket delay it
+//  was created with, and reset the ticket. Use this when different tickets
+//  need different delays.                                                 
+CZMQ_EXPORT void
+    zloop_ticket_set_delay (zloop_t *self, void *handle, size_t delay);
+
+//  Delete a ticket timer. This frees the ticket at once, unless it is the  
+//  ticket whose handler is running, which we free when the handler returns.
 CZMQ_EXPORT void
     zloop_ticket_delete (zloop_t *self, void *handle);
 
-//  Set the ticket delay, which applies to all tickets. If you lower the   
-//  delay and there are already tickets created, the results are undefined.
+//  Post a callback to the reactor from any thread. The reactor calls the 
+//  handler, passing the arg, on its own thread, as soon as it wakes up.  
+//  Callbacks run in the order they were posted. If a callback returns -1,
+//  the reactor ends. This is the only zloop method that is safe to call  
+//  from another thread. Returns 0 if OK, -1 if there was not enough      
+//  memory, or posting is not supported on this platform.                 
+CZMQ_EXPORT int
+    zloop_post (zloop_t *self, zloop_post_fn handler, void *arg);
+
+//  Set the ticket delay, which applies to tickets created from now on.
+//  Existing tickets keep their delay.                                 
 CZMQ_EXPORT void
     zloop_set_ticket_delay (zloop_t *self, size_t ticket_delay);
 
-//  Set hard limit on number of timers allowed. Setting more than a small  
-//  number of timers (10-100) can have a dramatic impact on the performance
-//  of the reactor. For high-volume cases, use ticket timers. If the hard  
-//  limit is reached, the reactor stops creating new timers and logs an    
-//  error.                                                                 
+//  Set hard limit on number of timers allowed. Timers are held in a heap,  
+//  so the cost of adding, cancelling and expiring a timer grows only slowly
+//  with the number of timers. For high-volume expiry cases, ticket timers  
+//  are still cheaper. If the hard limit is reached, the reactor stops      
+//  creating new timers and logs an error.                                  
 CZMQ_EXPORT void
     zloop_set_max_timers (zloop_t *self, size_t max_timers);
 
+//  Use epoll instead of zmq_poll to wait for readers and pollers, if epoll
+//  is true, or go back to zmq_poll if false. With epoll, the cost of each 
+//  pass is proportional to the number of active sockets rather than to the
+//  number of registered sockets. Sockets are watched through their ZMQ_FD,
+//  which only signals a change of state, and after calling a handler the  
+//  reactor checks that handler's socket again on the next pass. A handler 
+//  that sends on another socket registered in the same loop may consume   
+//  that socket's signal, so its reader will not wake for input that is    
+//  already waiting. Such a handler should call zloop_reader_rearm for that
+//  socket. Returns 0 if OK, -1 if epoll is not available on this platform,
+//  or could not be set up.                                                
+//  Call this before zloop_start, not from a handler.                      
+CZMQ_EXPORT int
+    zloop_set_epoll (zloop_t *self, bool epoll);
+
+//  Keep statistics on handlers, if stats is true. For each reader, poller,
+//  and timer, the reactor counts calls and keeps a histogram of how long  
+//  the handler took. It also measures how late timers fire. Turning on    
+//  statistics clears any previous values. Statistics are off by default.  
+CZMQ_EXPORT void
+    zloop_set_stats (zloop_t *self, bool stats);
+
+//  Report any reader, poller, or timer handler that takes longer than the
+//  specified number of msecs, as a warning on the system log. Set to zero
+//  to turn off reporting, which is the default.                          
+CZMQ_EXPORT void
+    zloop_set_watchdog (zloop_t *self, size_t msecs);
+
+//  Shed load when the reactor is overloaded. The reactor measures its lag  
+//  on each pass: how late it calls each timer and ticket handler, after the
+//  time the timer was due (allowing for its slack), and how long each ready
+//  reader and poller waits after the reactor wakes up before its handler is
+//  called. If the lag is more than the specified number of msecs, then for 
+//  the next msecs the reactor stops polling readers with a priority below  
+//  the specified priority. Their input waits on the socket, rather than    
+//  delaying higher-priority readers and timers. The reactor stays          
+//  overloaded until no pass has had too much lag for msecs. Set msecs to   
+//  zero to turn off shedding, which is the default.                        
+CZMQ_EXPORT void
+    zloop_set_overload (zloop_t *self, size_t msecs, int priority);
+
+//  Return a snapshot of the reactor's statistics, as a message with six    
+//  frames for each set of statistics: kind ("lag", "reader", "poller", or  
+//  "timer"), name (socket type, "FD", or timer id), number of calls, total 
+//  usecs, longest usecs, and a histogram of calls as counts separated by   
+//  spaces. Histogram bucket N counts calls that took less than 2^N usecs,  
+//  and the last bucket counts all longer calls. The first set is timer lag,
+//  which measures how late timers fired. Timers that have ended or been    
+//  cancelled are added together in one last set, named "ended". Returns    
+//  NULL if statistics are not enabled. Caller must destroy the message when
+//  finished with it.                                                       
+CZMQ_EXPORT zmsg_t *
+    zloop_stats (zloop_t *self);
+
 //  Set verbose tracing of reactor on/off
 CZMQ_EXPORT void
     zloop_set_verbose (zloop_t *self, bool verbose);
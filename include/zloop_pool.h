@@ -0,0 +1,105 @@
+/*  =========================================================================
+    zloop_pool - pool of reactors, each on its own thread
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZLOOP_POOL_H_INCLUDED__
+#define __ZLOOP_POOL_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @warning THE FOLLOWING @INTERFACE BLOCK IS AUTO-GENERATED BY ZPROJECT!
+//  @warning Please edit the model at "api/zloop_pool.xml" to make changes.
+//  @interface
+//  Create a new pool of the specified number of reactors. The reactors do
+//  not run until you call zloop_pool_start.                              
+CZMQ_EXPORT zloop_pool_t *
+    zloop_pool_new (size_t size);
+
+//  Destroy a pool. Stops all reactors, and waits for their threads to end.
+CZMQ_EXPORT void
+    zloop_pool_destroy (zloop_pool_t **self_p);
+
+//  Return the number of reactors in the pool
+CZMQ_EXPORT size_t
+    zloop_pool_size (zloop_pool_t *self);
+
+//  Return the reactor with the specified index, from 0 to size - 1. Until  
+//  you start the pool, you may configure the reactor, and register readers,
+//  pollers, and timers with it. After that, only use the reactor from its  
+//  own handlers, or through zloop_post.                                    
+CZMQ_EXPORT zloop_t *
+    zloop_pool_loop (zloop_pool_t *self, size_t index);
+
+//  Pin the thread for the specified reactor to a CPU, when the pool starts.
+//  Set cpu to -1 to let the thread run on any CPU, which is the default.   
+//  Pinning is only supported on Linux, and is ignored elsewhere. Call this 
+//  before zloop_pool_start.                                                
+CZMQ_EXPORT void
+    zloop_pool_set_cpu (zloop_pool_t *self, size_t index, int cpu);
+
+//  Start each reactor on its own thread. Returns 0 if OK, -1 if a thread
+//  could not be started. The reactors run until you destroy the pool, or
+//  until a handler returns -1, which ends only that handler's reactor.  
+//  Requests to a reactor that has ended return -1, except that          
+//  zloop_pool_reader_end still cancels the reader.                      
+CZMQ_EXPORT int
+    zloop_pool_start (zloop_pool_t *self);
+
+//  Return the index of the reactor for a key, such as a client identity.
+//  The same key always gives the same reactor.                          
+CZMQ_EXPORT size_t
+    zloop_pool_shard (zloop_pool_t *self, const char *key);
+
+//  Return the index of the reactor with fewest readers registered through
+//  the pool. If several reactors have the fewest, returns the first.     
+CZMQ_EXPORT size_t
+    zloop_pool_least_loaded (zloop_pool_t *self);
+
+//  Register a socket reader with the specified reactor, and wait until the 
+//  reactor has done so. The reactor's own thread calls the handler, as for 
+//  zloop_reader, and the socket belongs to that thread until you cancel the
+//  reader. Do not call this from a handler in the pool: use zloop_reader on
+//  the handler's own reactor instead. Returns 0 if OK, -1 if the reactor   
+//  could not register the reader, or has ended. On Windows, this works only
+//  until the pool starts.                                                  
+CZMQ_EXPORT int
+    zloop_pool_reader (zloop_pool_t *self, size_t index, zsock_t *sock, zloop_reader_fn handler, void *arg);
+
+//  Cancel a socket reader from the specified reactor, and wait until the   
+//  reactor has done so, after which the socket again belongs to the caller.
+//  Do not call this from a handler in the pool: use zloop_reader_end on the
+//  handler's own reactor instead. Returns 0 if OK, -1 if the request could 
+//  not be passed to the reactor. If the reactor has ended, this cancels the
+//  reader directly, so do not call it for the same reactor from two threads
+//  at once. On Windows, this works only until the pool starts.             
+CZMQ_EXPORT int
+    zloop_pool_reader_end (zloop_pool_t *self, size_t index, zsock_t *sock);
+
+//  Post a callback to the specified reactor, which calls it from its own   
+//  thread, as for zloop_post. You may call this from any thread. Returns 0 
+//  if OK, -1 if the callback could not be posted, or the reactor has ended.
+//  A callback posted just as the reactor ends is not called.               
+CZMQ_EXPORT int
+    zloop_pool_post (zloop_pool_t *self, size_t index, zloop_post_fn handler, void *arg);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zloop_pool_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -81,6 +81,14 @@ CZMQ_EXPORT int
 CZMQ_EXPORT int
     zmsg_addmem (zmsg_t *self, const void *src, size_t size);
 
+//  Add caller's data to the end of the message as a new frame, without   
+//  copying it. The message takes ownership of the data, and calls free_fn
+//  with the data and the hint exactly once, when libzmq no longer needs  
+//  the data, as for zframe_new_zero_copy. Returns 0 on success, -1 on    
+//  error, in which case the data has already been released.              
+CZMQ_EXPORT int
+    zmsg_addmem_zero_copy (zmsg_t *self, void *data, size_t size, zframe_free_fn *free_fn, void *hint);
+
 //  Push string as new frame to front of message.
 //  Returns 0 on success, -1 on error.           
 CZMQ_EXPORT int
@@ -159,6 +167,18 @@ CZMQ_EXPORT zmsg_t *
 CZMQ_EXPORT size_t
     zmsg_encode (zmsg_t *self, byte **buffer);
 
+//  Return the size of the buffer that zmsg_encode would produce for this
+//  message.                                                             
+CZMQ_EXPORT size_t
+    zmsg_encode_size (zmsg_t *self);
+
+//  Serialize message into a caller-provided buffer, in the same format as
+//  zmsg_encode. Returns the encoded size. If this is larger than the     
+//  buffer_size, the buffer was too small and nothing was written; use    
+//  zmsg_encode_size to size the buffer beforehand.                       
+CZMQ_EXPORT size_t
+    zmsg_encode_into (zmsg_t *self, byte *buffer, size_t buffer_size);
+
 //  Decodes a serialized message buffer created by zmsg_encode () and returns
 //  a new zmsg_t object. Returns NULL if the buffer was badly formatted or   
 //  there was insufficient memory to work.                                   
@@ -166,8 +186,30 @@ CZMQ_EXPORT size_t
 CZMQ_EXPORT zmsg_t *
     zmsg_decode (const byte *buffer, size_t buffer_size);
 
+//  Decodes a serialized message buffer created by zmsg_encode (), like     
+//  zmsg_decode, but without copying the frame data. The frames refer to the
+//  buffer, which the message takes ownership of. When the message and all  
+//  frames from it are sent or destroyed, calls free_fn with the buffer and 
+//  hint, as for zframe_new_zero_copy. Returns NULL if the buffer was badly 
+//  formatted or there was insufficient memory to work, in which case the   
+//  buffer has already been released.                                       
+//  The caller is responsible for destroying the return value when finished with it.
+CZMQ_EXPORT zmsg_t *
+    zmsg_decode_zero_copy (byte *buffer, size_t buffer_size, zframe_free_fn *free_fn, void *hint);
+
+//  Walk the frames of a serialized message buffer created by zmsg_encode (),
+//  without creating a message or frames. Start with *offset_p at zero; each 
+//  call returns the address of the next frame's data within the buffer, sets
+//  *frame_size_p to its size, and moves *offset_p past it. Returns NULL when
+//  there are no more frames, in which case *offset_p equals buffer_size, or 
+//  if the buffer is badly formatted, in which case it is less.              
+CZMQ_EXPORT const byte *
+    zmsg_decode_next (const byte *buffer, size_t buffer_size, size_t *offset_p, size_t *frame_size_p);
+
 //  Create copy of message, as new message object. Returns a fresh zmsg_t
 //  object. If message is null, or memory was exhausted, returns null.   
+//  The copy shares frame data with the original, as zframe_dup does, so 
+//  copying a large message costs no more than copying a small one.      
 //  The caller is responsible for destroying the return value when finished with it.
 CZMQ_EXPORT zmsg_t *
     zmsg_dup (zmsg_t *self);
@@ -0,0 +1,95 @@
+/*  =========================================================================
+    zpicture - compiled picture for binary encoded messages
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#ifndef __ZPICTURE_H_INCLUDED__
+#define __ZPICTURE_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//  @warning THE FOLLOWING @INTERFACE BLOCK IS AUTO-GENERATED BY ZPROJECT!
+//  @warning Please edit the model at "api/zpicture.xml" to make changes.
+//  @interface
+//  Create a new compiled picture. Returns NULL if the picture is not valid,
+//  after logging the reason.                                               
+CZMQ_EXPORT zpicture_t *
+    zpicture_new (const char *picture);
+
+//  Destroy a compiled picture
+CZMQ_EXPORT void
+    zpicture_destroy (zpicture_t **self_p);
+
+//  Return the picture as a string
+CZMQ_EXPORT const char *
+    zpicture_picture (zpicture_t *self);
+
+//  Send a binary encoded message to the socket (or actor), as zsock_bsend
+//  does, using the compiled picture. Does not change or take ownership of
+//  any arguments. Returns 0 if successful, -1 if sending failed for any  
+//  reason.                                                               
+CZMQ_EXPORT int
+    zpicture_send (zpicture_t *self, void *dest, ...);
+
+//  Send a binary encoded message to the socket (or actor), using the
+//  compiled picture, taking the arguments from a va_list.           
+CZMQ_EXPORT int
+    zpicture_vsend (zpicture_t *self, void *dest, va_list argptr);
+
+//  Receive a binary encoded message from the socket (or actor), as        
+//  zsock_brecv does, using the compiled picture. All arguments must be    
+//  pointers; strings ('s') point to values held by the picture, which are 
+//  valid until the next receive with it. Returns 0 if successful, or -1 if
+//  it failed to read a message.                                           
+CZMQ_EXPORT int
+    zpicture_recv (zpicture_t *self, void *source, ...);
+
+//  Receive a binary encoded message from the socket (or actor), using the
+//  compiled picture, storing into the pointers in a va_list.             
+CZMQ_EXPORT int
+    zpicture_vrecv (zpicture_t *self, void *source, va_list argptr);
+
+//  Receive a binary encoded message from the socket (or actor), returning  
+//  views into the received data rather than copies. Numbers and pointers   
+//  are returned as by zpicture_recv. Strings ('s' and 'S') and chunks ('c')
+//  take two arguments, a const byte ** and a size_t *, which are set to    
+//  the value's data and size; strings are not null-terminated. Frames      
+//  ('f') also take a const byte ** and a size_t *. UUIDs ('u') take a      
+//  const byte ** to ZUUID_LEN bytes. A message ('m') is created as for     
+//  zpicture_recv and the caller must destroy it. The views are valid until 
+//  the next call to this method with the picture, zpicture_release, or     
+//  destroying the picture. Returns 0 if successful, or -1 if it failed to  
+//  read a message.                                                         
+CZMQ_EXPORT int
+    zpicture_recv_view (zpicture_t *self, void *source, ...);
+
+//  Receive a binary encoded message from the socket (or actor), returning   
+//  views as zpicture_recv_view does, storing into the pointers in a va_list.
+CZMQ_EXPORT int
+    zpicture_vrecv_view (zpicture_t *self, void *source, va_list argptr);
+
+//  Release the message data held for views by zpicture_recv_view. Does
+//  nothing if no views are held.                                      
+CZMQ_EXPORT void
+    zpicture_release (zpicture_t *self);
+
+//  Self test of this class
+CZMQ_EXPORT void
+    zpicture_test (bool verbose);
+//  @end
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
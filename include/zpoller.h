@@ -39,18 +39,57 @@ CZMQ_EXPORT int
 CZMQ_EXPORT int
     zpoller_remove (zpoller_t *self, void *reader);
 
-//  Poll the registered readers for I/O, return first reader that has input.
-//  The reader will be a libzmq void * socket, or a zsock_t or zactor_t
+//  Set the events to poll a reader for: ZMQ_POLLIN, ZMQ_POLLOUT, or both.
+//  Readers are polled for ZMQ_POLLIN by default. Poll for ZMQ_POLLOUT to
+//  wait until a socket can accept a message without blocking, e.g. after
+//  it reached its high-water mark. Use zpoller_revents to tell which events
+//  a reader returned by the poller is ready for. Returns 0 if OK, -1 if the
+//  reader is not registered with the poller.
+CZMQ_EXPORT int
+    zpoller_set_events (zpoller_t *self, void *reader, int events);
+
+//  Poll the registered readers for I/O, return first reader that is ready,
+//  i.e. that has input, or the events set with zpoller_set_events. The
+//  reader will be a libzmq void * socket, or a zsock_t or zactor_t
 //  instance as specified in zpoller_new/zpoller_add. The timeout should be
-//  zero or greater, or -1 to wait indefinitely. Socket priority is defined
-//  by their order in the poll list. If you need a balanced poll, use the low
-//  level zmq_poll method directly. If the poll call was interrupted (SIGINT),
-//  or the ZMQ context was destroyed, or the timeout expired, returns NULL.
-//  You can test the actual exit condition by calling zpoller_expired () and
-//  zpoller_terminated (). The timeout is in msec.
+//  zero or greater, or -1 to wait indefinitely. Each call starts looking for
+//  input just after the reader it returned last time, so a busy reader does
+//  not starve the readers after it in the poll list. If you need all ready
+//  readers, use zpoller_wait_all. If the poll call was interrupted
+//  (SIGINT), or the ZMQ context was destroyed, or the timeout expired,
+//  returns NULL. You can test the actual exit condition by calling
+//  zpoller_expired () and zpoller_terminated (). The timeout is in msec.
 CZMQ_EXPORT void *
     zpoller_wait (zpoller_t *self, int timeout);
 
+//  Poll the registered readers for I/O, and collect every reader that is
+//  ready, so one poll call can service all busy readers. Returns the number
+//  of ready readers, zero if the timeout expired, or -1 if the
+//  poll call was interrupted or the ZMQ context was destroyed. Walk the
+//  readers with zpoller_ready_first and zpoller_ready_next; these are valid
+//  until the next call to zpoller_wait or zpoller_wait_all. The order of the
+//  ready set rotates on each call, to keep polling fair. The timeout is in
+//  msec.
+CZMQ_EXPORT int
+    zpoller_wait_all (zpoller_t *self, int timeout);
+
+//  Return first reader in the ready set collected by zpoller_wait_all, or
+//  NULL if no readers were ready. Sets the cursor for zpoller_ready_next.
+CZMQ_EXPORT void *
+    zpoller_ready_first (zpoller_t *self);
+
+//  Return next reader in the ready set collected by zpoller_wait_all, or
+//  NULL if there are no more readers.
+CZMQ_EXPORT void *
+    zpoller_ready_next (zpoller_t *self);
+
+//  Return the events that the reader last returned by zpoller_wait,
+//  zpoller_ready_first, or zpoller_ready_next is ready for: ZMQ_POLLIN,
+//  ZMQ_POLLOUT, and for file handles, ZMQ_POLLERR. Returns 0 if no reader
+//  was returned.
+CZMQ_EXPORT int
+    zpoller_revents (zpoller_t *self);
+
 //  Return true if the last zpoller_wait () call ended because the timeout
 //  expired, without any error.
 CZMQ_EXPORT bool
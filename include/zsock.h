@@ -24,6 +24,20 @@ extern "C" {
 //  commas. If endpoint does not start with '@' or '>', default action depends
 //  on socket type.
 
+//  Traffic counters for a socket, see zsock_stats and zsys_socket_stats. A
+//  message is counted when its last frame is sent or received. The wait
+//  times cover blocking sends, including sends that block on the high-water
+//  mark.
+typedef struct {
+    uint64_t msgs_sent;             //  Messages sent
+    uint64_t bytes_sent;            //  Bytes sent, in all frames
+    uint64_t msgs_received;         //  Messages received
+    uint64_t bytes_received;        //  Bytes received, in all frames
+    uint64_t send_again;            //  Sends refused with EAGAIN
+    uint64_t send_wait_usecs;       //  Total time in blocking sends
+    uint64_t send_wait_max_usecs;   //  Longest single blocking send
+} zsock_stats_t;
+
 //  @warning THE FOLLOWING @INTERFACE BLOCK IS AUTO-GENERATED BY ZPROJECT!
 //  @warning Please edit the model at "api/zsock.xml" to make changes.
 //  @interface
@@ -162,7 +176,7 @@ CZMQ_EXPORT const char *
 //  Send a 'picture' message to the socket (or actor). The picture is a   
 //  string that defines the type of each frame. This makes it easy to send
 //  a complex multiframe message in one call. The picture can contain any 
-//  of these characters, each corresponding to one or two arguments:      
+//  of these characters, each corresponding to one or more arguments:     
 //                                                                        
 //      i = int (signed)                                                  
 //      1 = uint8_t                                                       
@@ -177,14 +191,28 @@ CZMQ_EXPORT const char *
 //      U = zuuid_t *                                                     
 //      p = void * (sends the pointer value, only meaningful over inproc) 
 //      m = zmsg_t * (sends all frames in the zmsg)                       
+//      x = void *, size_t, zframe_free_fn *, void * (4 arguments)        
+//          (sends data without copying, see zframe_new_zero_copy)        
 //      z = sends zero-sized frame (0 arguments)                          
 //      u = uint (deprecated)                                             
 //                                                                        
 //  Note that s, b, c, and f are encoded the same way and the choice is   
 //  offered as a convenience to the sender, which may or may not already  
 //  have data in a zchunk or zframe. Does not change or take ownership of 
-//  any arguments. Returns 0 if successful, -1 if sending failed for any  
-//  reason.                                                               
+//  any arguments, except the x data, which is freed by its free function 
+//  even if sending fails. Returns 0 if successful, -1 if sending failed  
+//  for any reason.                                                       
+//                                                                        
+//  Integers are sent as decimal text by default. If the picture starts   
+//  with '#', they are sent in binary instead, in network byte order, as  
+//  4 bytes for i and u, and 1, 2, 4, or 8 bytes for 1, 2, 4, and 8. This 
+//  is cheaper to encode and decode; the receiver must use '#' as well.   
+//  As decimal text, u is now sent as just the digits, for example "42".  
+//  Older versions sent it with a trailing 'd', as "42d". zsock_recv reads
+//  both forms, but a peer that reads the frame as a string sees the new  
+//  form, so this is a wire format change for such peers.                 
+//  Frames are sent straight from the arguments without building a zmsg;  
+//  f and m frames are sent by reference, without copying their data.     
 CZMQ_EXPORT int
     zsock_send (void *self, const char *picture, ...);
 
@@ -220,6 +248,9 @@ CZMQ_EXPORT int
 //  If an argument pointer is NULL, does not store any value (skips it).    
 //  An 'n' picture matches an empty frame; if the message does not match,   
 //  the method will return -1.                                              
+//  A picture that starts with '#' expects binary integers, as sent by a    
+//  '#' picture. If a binary integer frame is missing or has the wrong      
+//  size, the integer reads as zero and the method returns -1.              
 CZMQ_EXPORT int
     zsock_recv (void *self, const char *picture, ...);
 
@@ -250,6 +281,9 @@ CZMQ_EXPORT int
 //                                                                         
 //  Does not change or take ownership of any arguments. Returns 0 if       
 //  successful, -1 if sending failed for any reason.                       
+//  The socket keeps each picture it sees in compiled form, so it checks   
+//  and sizes each picture once; see zpicture. A picture may have any      
+//  number of 'f' elements.                                                
 CZMQ_EXPORT int
     zsock_bsend (void *self, const char *picture, ...);
 
@@ -264,6 +298,70 @@ CZMQ_EXPORT int
 CZMQ_EXPORT int
     zsock_brecv (void *self, const char *picture, ...);
 
+//  Receive a binary encoded 'picture' message from the socket (or actor),
+//  returning views into the received data instead of copies, as for      
+//  zpicture_recv_view. Strings, chunks, and frames each take a const     
+//  byte ** and a size_t *; strings are not null-terminated. The views are
+//  valid until the next zsock_brecv_view with the same picture on this   
+//  socket, or until the socket is destroyed. Returns 0 if successful, or 
+//  -1 if it failed to read a message.                                    
+CZMQ_EXPORT int
+    zsock_brecv_view (void *self, const char *picture, ...);
+
+//  Receive up to limit messages from the socket (or actor) without blocking,
+//  storing them in the msgs array in order. Entries that already hold a     
+//  message are reused: the message is emptied and refilled, reusing its     
+//  frames, so a caller that keeps the array between calls does not need to  
+//  allocate new objects. Entries that are NULL get a new message. Stops at  
+//  the first message that is not waiting, and leaves that entry and all     
+//  entries after it unchanged. Returns the number of messages received, 0   
+//  if none were waiting, or -1 if the receive was interrupted before any    
+//  message was received. If interrupted part way through a message, that    
+//  entry is destroyed and set to NULL.                                      
+CZMQ_EXPORT int
+    zsock_recv_batch (void *self, zmsg_t **msgs, size_t limit);
+
+//  Receive up to limit frames from the socket (or actor) without blocking, 
+//  storing them in the frames array in order. This is the frame level      
+//  version of zsock_recv_batch, for callers that handle each frame as it   
+//  comes and check zframe_more for message boundaries. Entries that already
+//  hold a frame are reused, and entries that are NULL get a new frame.     
+//  Stops at the first frame that is not waiting, and leaves that entry and 
+//  all entries after it unchanged. Returns the number of frames received,  
+//  0 if none were waiting, or -1 if the receive was interrupted before any 
+//  frame was received.                                                     
+CZMQ_EXPORT int
+    zsock_recv_frames (void *self, zframe_t **frames, size_t limit);
+
+//  Send count messages from the msgs array to the socket (or actor), in    
+//  order. Each message that is sent is destroyed and its entry set to NULL,
+//  as for zmsg_send. Stops at the first message that fails to send, which  
+//  stays with the caller along with all the messages after it. Returns the 
+//  number of messages sent.                                                
+CZMQ_EXPORT int
+    zsock_send_batch (void *self, zmsg_t **msgs, size_t count);
+
+//  Return a snapshot of the traffic counters of the socket (or actor). If 
+//  the socket does not count its traffic (see zsys_set_socket_stats), sets
+//  all the counters to zero.                                              
+CZMQ_EXPORT void
+    zsock_stats (void *self, zsock_stats_t *stats);
+
+//  Apply a socket tuning profile to the socket (or actor), setting a group
+//  of options in one call. The built-in profiles are "low-latency" (short 
+//  queues, immediate, no linger, fast reconnect, TCP keepalives),         
+//  "bulk-throughput" (deep queues, 4MB kernel buffers, a larger backlog,  
+//  and 5 seconds linger), and "lossy-telemetry" (short queues, sends that 
+//  fail instead of blocking, and conflate). The lossy-telemetry profile   
+//  only fits PUB, SUB, PUSH, and PULL sockets sending single-frame        
+//  messages, as conflate does not support multipart messages.             
+//  Applications can add their own profiles with zsys_load_socket_profiles,
+//  and set a profile for all new sockets with zsys_set_socket_profile.    
+//  Options set later override the profile. Returns 0 if OK, or -1 if the  
+//  profile is unknown, or does not fit the socket type.                   
+CZMQ_EXPORT int
+    zsock_set_profile (void *self, const char *profile);
+
 //  Set socket to use unbounded pipes (HWM=0); use this in cases when you are
 //  totally certain the message volume can fit in memory. This method works  
 //  across all versions of ZeroMQ. Takes a polymorphic socket reference.     
@@ -371,6 +469,16 @@ CZMQ_EXPORT zsock_t *
 CZMQ_EXPORT zsock_t *
     zsock_new_stream_checked (const char *endpoint, const char *filename, size_t line_nbr);
 
+// zsock traffic accounting - not a part of the official interface to zsock.
+// The classes that send and receive on sockets use these to count traffic.
+CZMQ_EXPORT zsock_stats_t *
+    zsock_stats_of (void *self);
+
+CZMQ_EXPORT void
+    zsock_stats_sent (zsock_stats_t *stats, size_t bytes, bool more, int rc, int64_t started);
+
+CZMQ_EXPORT void
+    zsock_stats_received (zsock_stats_t *stats, size_t bytes, bool more);
 
 #ifdef __cplusplus
 }
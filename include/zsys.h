@@ -259,6 +259,87 @@ CZMQ_EXPORT void
 CZMQ_EXPORT size_t
     zsys_pipehwm (void);
 
+//  Configure how many destroyed zframe_t and zmsg_t objects each thread
+//  keeps for reuse, of each type, so that creating frames and messages on
+//  a busy thread does not go to the heap. The default is zero, which means
+//  no pooling. If the environment variable ZSYS_OBJECT_POOL is defined,
+//  that provides the default. Pooling only works on POSIX systems, where we
+//  can release a thread's pool when the thread exits.
+CZMQ_EXPORT void
+    zsys_set_object_pool (size_t object_pool);
+
+//  Return the number of objects each thread keeps for reuse, of each type.
+CZMQ_EXPORT size_t
+    zsys_object_pool (void);
+
+//  Return how many zframe_t and zmsg_t objects were taken from a thread
+//  pool (hits), and how many were allocated because the pool was empty
+//  (misses), since the process started. Each thread adds its counts to
+//  the totals in batches, and when it exits, so the totals may trail the
+//  latest activity.
+CZMQ_EXPORT uint64_t
+    zsys_object_pool_hits (void);
+
+CZMQ_EXPORT uint64_t
+    zsys_object_pool_misses (void);
+
+//  Configure whether new zsock instances count their traffic, for zsock_stats
+//  and zsys_socket_stats. Counting costs a clock read on each blocking send,
+//  so it is off by default (socket_stats set to 0). If the environment
+//  variable ZSYS_SOCKET_STATS is defined (as 1 or 0), this provides the
+//  default. Sockets that already exist are not affected.
+CZMQ_EXPORT void
+    zsys_set_socket_stats (int socket_stats);
+
+//  Return the traffic counters of all zsock instances in the process that
+//  count their traffic, open or closed, added together. The wait maximum is
+//  the largest for any one socket. Each socket updates its counters without
+//  locking, so the values for open sockets may trail their latest activity.
+CZMQ_EXPORT void
+    zsys_socket_stats (zsock_stats_t *totals);
+
+//  Log the traffic counters of each open zsock instance that counts its
+//  traffic, with the place it was created, to find hot or backed-up sockets.
+CZMQ_EXPORT void
+    zsys_socket_stats_print (void);
+
+//  Set the socket tuning profile that new zsock instances get, after the
+//  other process defaults. This may be one of the built-in profiles,
+//  "low-latency", "bulk-throughput", or "lossy-telemetry", or a profile
+//  loaded with zsys_load_socket_profiles. The profile applies to every new
+//  socket, including actor pipes, so lossy profiles are rarely a good
+//  default. A socket whose type the profile does not fit gets no profile,
+//  and an error is logged. Set to NULL for no profile, which is the
+//  default. If the environment variable ZSYS_SOCKET_PROFILE is defined,
+//  that provides the default.
+CZMQ_EXPORT void
+    zsys_set_socket_profile (const char *profile);
+
+//  Return the socket tuning profile that new zsock instances get, or "" if
+//  none was set.
+CZMQ_EXPORT const char *
+    zsys_socket_profile (void);
+
+//  Load socket tuning profiles from a configuration section. Each child of
+//  the section is a profile, named by the child, holding option = value
+//  items that name socket options without the ZMQ_ prefix, in lower case,
+//  for example:
+//
+//      socket_profiles
+//          market-data
+//              sndhwm = 50000
+//              conflate = 1
+//
+//  The options are sndhwm, rcvhwm, sndbuf, rcvbuf, linger, immediate,
+//  conflate, affinity, rate, reconnect_ivl, backlog, sndtimeo, rcvtimeo,
+//  tos, and the tcp_keepalive options, as far as the libzmq version
+//  supports them. A loaded profile replaces a built-in profile with the
+//  same name, and its options are added to any profile already loaded with
+//  that name. Returns the number of profiles loaded, or -1 if any option is
+//  unknown or has no value, in which case logs the error and loads nothing.
+CZMQ_EXPORT int
+    zsys_load_socket_profiles (zconfig_t *config);
+
 //  Configure use of IPv6 for new zsock instances. By default sockets accept
 //  and make only IPv4 connections. When you enable IPv6, sockets will accept
 //  and connect to both IPv4 and IPv6 peers. You can override the setting on
@@ -339,6 +420,30 @@ CZMQ_EXPORT extern volatile int zsys_interrupted;
 CZMQ_EXPORT extern volatile int zctx_interrupted;
 //  @end
 
+//  Socket traffic counters - not a part of the official interface to zsys.
+//  zsock registers each socket's counters so zsys_socket_stats can add them.
+CZMQ_EXPORT int
+    zsys_stats_register (zsock_stats_t *stats, int type, const char *filename, size_t line_nbr);
+
+CZMQ_EXPORT void
+    zsys_stats_deregister (zsock_stats_t *stats);
+
+//  Thread object pools - not a part of the official interface to zsys.
+//  zframe and zmsg keep destroyed objects for reuse, see zsys_set_object_pool.
+#define ZSYS_POOL_FRAME 0
+#define ZSYS_POOL_MSG   1
+
+CZMQ_EXPORT void *
+    zsys_pool_alloc (int type, size_t size);
+
+CZMQ_EXPORT void
+    zsys_pool_free (int type, void *object);
+
+//  Socket tuning profiles - not a part of the official interface to zsys.
+//  zsock_set_profile uses this to apply a profile.
+CZMQ_EXPORT int
+    zsys_socket_profile_apply (void *self, const char *profile);
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,11 +49,14 @@ main (int argc, char *argv [])
     zframe_test (verbose); 
     zgossip_test (verbose); 
     zhashx_test (verbose); 
+    zjournal_test (verbose); 
     ziflist_test (verbose); 
     zlistx_test (verbose); 
     zloop_test (verbose); 
+    zloop_pool_test (verbose); 
     zmonitor_test (verbose); 
     zmsg_test (verbose); 
+    zpicture_test (verbose); 
     zpoller_test (verbose); 
     zproxy_test (verbose); 
     zrex_test (verbose); 
@@ -0,0 +1,268 @@
+/*  =========================================================================
+    perf_profiles - measure the built-in socket tuning profiles
+
+    Runs a latency test and a throughput test for each built-in socket
+    profile (see zsock_set_profile), over inproc and over tcp on the
+    loopback interface, and prints one line per run:
+
+    * latency - average round trip of a small message between two DEALER
+      sockets, in microseconds. Profiles that only fit PUB, SUB, PUSH, and
+      PULL sockets, such as lossy-telemetry, skip this test.
+    * throughput - messages per second and MB per second from a PUSH socket
+      to a PULL socket, and the percentage of sent messages that arrived,
+      which is below 100 for profiles that drop messages rather than block.
+
+    Usage: perf_profiles [message-size [message-count [roundtrip-count]]]
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+#include "../include/czmq.h"
+
+static const char *s_profiles [] = {
+    "low-latency", "bulk-throughput", "lossy-telemetry", NULL
+};
+
+//  Settings for one run, shared with the actor at the other end
+
+typedef struct {
+    const char *profile;        //  Profile applied to both sockets
+    char *endpoint;             //  Endpoint the actor connects to
+    size_t size;                //  Message size, in octets
+    size_t count;               //  Messages or round trips to run
+} s_run_t;
+
+//  Returns true if the profile fits sockets of the specified type
+
+static bool
+s_fits (const char *profile, int type)
+{
+    zsock_t *probe = zsock_new (type);
+    bool fits = probe && zsock_set_profile (probe, profile) == 0;
+    zsock_destroy (&probe);
+    return fits;
+}
+
+//  Create a socket with the run's profile, and bind it to a fresh endpoint
+//  for the transport. Returns NULL if that failed.
+
+static zsock_t *
+s_bind (s_run_t *run, int type, const char *transport)
+{
+    static int inproc_nbr = 0;
+    zsock_t *sock = zsock_new (type);
+    if (!sock)
+        return NULL;
+    int rc = zsock_set_profile (sock, run->profile);
+    assert (rc == 0);
+    if (streq (transport, "tcp")) {
+        int port = zsock_bind (sock, "tcp://127.0.0.1:*");
+        if (port > 0)
+            run->endpoint = zsys_sprintf ("tcp://127.0.0.1:%d", port);
+    }
+    else {
+        run->endpoint = zsys_sprintf ("inproc://perf-%d", ++inproc_nbr);
+        if (run->endpoint && zsock_bind (sock, "%s", run->endpoint))
+            zstr_free (&run->endpoint);
+    }
+    if (!run->endpoint)
+        zsock_destroy (&sock);
+    return sock;
+}
+
+//  Create a socket with the run's profile, connected to the run's endpoint.
+//  Returns NULL if that failed.
+
+static zsock_t *
+s_connect (s_run_t *run, int type)
+{
+    zsock_t *sock = zsock_new (type);
+    if (!sock)
+        return NULL;
+    int rc = zsock_set_profile (sock, run->profile);
+    assert (rc == 0);
+    if (zsock_connect (sock, "%s", run->endpoint))
+        zsock_destroy (&sock);
+    return sock;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Latency: the actor echoes each message it gets, until it gets an empty
+//  one
+
+static void
+s_echo_actor (zsock_t *pipe, void *args)
+{
+    s_run_t *run = (s_run_t *) args;
+    zsock_t *echo = s_connect (run, ZMQ_DEALER);
+    assert (echo);
+    zsock_signal (pipe, 0);
+    while (true) {
+        zframe_t *frame = zframe_recv (echo);
+        if (!frame || zframe_size (frame) == 0) {
+            zframe_destroy (&frame);
+            break;
+        }
+        zframe_send (&frame, echo, 0);
+        zframe_destroy (&frame);
+    }
+    zsock_destroy (&echo);
+}
+
+static void
+s_latency (s_run_t *run, const char *transport)
+{
+    if (!s_fits (run->profile, ZMQ_DEALER)) {
+        printf ("%-16s %-7s latency     not for DEALER sockets\n", run->profile, transport);
+        return;
+    }
+    zsock_t *sock = s_bind (run, ZMQ_DEALER, transport);
+    zactor_t *actor = sock? zactor_new (s_echo_actor, run): NULL;
+    if (!actor) {
+        printf ("%-16s %-7s latency     could not start\n", run->profile, transport);
+        zactor_destroy (&actor);
+        zsock_destroy (&sock);
+        zstr_free (&run->endpoint);
+        return;
+    }
+    zframe_t *frame = zframe_new (NULL, run->size);
+    memset (zframe_data (frame), 'L', run->size);
+    zsock_set_rcvtimeo (sock, 5000);
+    size_t done = 0;
+    int64_t started = zclock_usecs ();
+    for (done = 0; done < run->count; done++) {
+        if (zframe_send (&frame, sock, ZFRAME_REUSE))
+            break;
+        zframe_t *reply = zframe_recv (sock);
+        if (!reply)
+            break;
+        zframe_destroy (&reply);
+    }
+    int64_t elapsed = zclock_usecs () - started;
+    zframe_destroy (&frame);
+    zstr_send (sock, "");
+    zactor_destroy (&actor);
+    zsock_destroy (&sock);
+    zstr_free (&run->endpoint);
+
+    if (done < run->count)
+        printf ("%-16s %-7s latency     stopped after %d of %d round trips\n",
+                run->profile, transport, (int) done, (int) run->count);
+    else
+        printf ("%-16s %-7s latency     %8.1f usecs round trip\n",
+                run->profile, transport, (double) elapsed / done);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Throughput: the actor sends the messages as fast as it can, and tells
+//  us how many it sent; a send that fails counts as a drop
+
+static void
+s_sender_actor (zsock_t *pipe, void *args)
+{
+    s_run_t *run = (s_run_t *) args;
+    zsock_t *push = s_connect (run, ZMQ_PUSH);
+    assert (push);
+    zsock_signal (pipe, 0);
+    zframe_t *frame = zframe_new (NULL, run->size);
+    memset (zframe_data (frame), 'T', run->size);
+    //  Wait until the receiver is ready, so we time only the traffic
+    zsock_wait (pipe);
+    size_t sent = 0;
+    size_t index;
+    for (index = 0; index < run->count; index++)
+        if (zframe_send (&frame, push, ZFRAME_REUSE) == 0)
+            sent++;
+    zframe_destroy (&frame);
+    zstr_sendf (pipe, "%d", (int) sent);
+    zsock_destroy (&push);
+}
+
+static void
+s_throughput (s_run_t *run, const char *transport)
+{
+    zsock_t *pull = s_bind (run, ZMQ_PULL, transport);
+    zactor_t *actor = pull? zactor_new (s_sender_actor, run): NULL;
+    if (!actor) {
+        printf ("%-16s %-7s throughput  could not start\n", run->profile, transport);
+        zactor_destroy (&actor);
+        zsock_destroy (&pull);
+        zstr_free (&run->endpoint);
+        return;
+    }
+    //  Give tcp time to connect, then start the sender
+    zclock_sleep (100);
+    zsock_signal (actor, 0);
+
+    //  We stop when we have every message, or after a second with none,
+    //  as messages the profile drops never arrive
+    zsock_set_rcvtimeo (pull, 1000);
+    size_t received = 0;
+    int64_t started = 0;
+    int64_t finished = 0;
+    while (received < run->count) {
+        zframe_t *frame = zframe_recv (pull);
+        if (!frame)
+            break;
+        finished = zclock_usecs ();
+        if (received++ == 0)
+            started = finished;
+        zframe_destroy (&frame);
+    }
+    char *sent_string = zstr_recv (actor);
+    size_t sent = sent_string? (size_t) atoi (sent_string): 0;
+    zstr_free (&sent_string);
+    zactor_destroy (&actor);
+    zsock_destroy (&pull);
+    zstr_free (&run->endpoint);
+
+    double seconds = (double) (finished - started) / 1000000;
+    if (received < 2 || seconds <= 0)
+        printf ("%-16s %-7s throughput  only %d messages arrived\n",
+                run->profile, transport, (int) received);
+    else
+        printf ("%-16s %-7s throughput  %10.0f msg/s %8.1f MB/s %5.1f%% delivered\n",
+                run->profile, transport,
+                received / seconds,
+                received * run->size / seconds / (1024 * 1024),
+                sent? 100.0 * received / sent: 0.0);
+}
+
+
+int
+main (int argc, char *argv [])
+{
+    size_t size = argc > 1? (size_t) atoi (argv [1]): 100;
+    size_t count = argc > 2? (size_t) atoi (argv [2]): 100000;
+    size_t roundtrips = argc > 3? (size_t) atoi (argv [3]): 10000;
+    if (size == 0 || count == 0 || roundtrips == 0) {
+        printf ("usage: perf_profiles [message-size [message-count [roundtrip-count]]]\n");
+        return 1;
+    }
+    printf ("Message size %d octets, %d messages, %d round trips\n",
+            (int) size, (int) count, (int) roundtrips);
+
+    const char *transports [] = { "inproc", "tcp", NULL };
+    int profile_nbr;
+    for (profile_nbr = 0; s_profiles [profile_nbr]; profile_nbr++) {
+        int transport_nbr;
+        for (transport_nbr = 0; transports [transport_nbr]; transport_nbr++) {
+            s_run_t run = { s_profiles [profile_nbr], NULL, size, roundtrips };
+            s_latency (&run, transports [transport_nbr]);
+            run.count = count;
+            s_throughput (&run, transports [transport_nbr]);
+            if (zsys_interrupted)
+                return 1;
+        }
+    }
+    return 0;
+}
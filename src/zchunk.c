@@ -399,7 +399,7 @@ zchunk_unpack (zframe_t *frame)
 {
     assert (frame);
     assert (zframe_is (frame));
-    return zchunk_new (zframe_data (frame), zframe_size (frame));
+    return zchunk_new (zframe_peek (frame), zframe_size (frame));
 }
 
 
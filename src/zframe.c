@@ -21,6 +21,15 @@
     the same frame many times. Frames are binary, and this class has no
     special support for text data.
 @discuss
+    To send large buffers without copying them, use zframe_new_zero_copy,
+    which hands the buffer to libzmq along with a function to free it.
+    libzmq calls that function once, when the frame and all copies of it
+    have been sent or destroyed.
+
+    Programs that create and destroy many frames can call
+    zsys_set_object_pool to keep destroyed frames on a per-thread free list
+    and reuse them, rather than going back to the heap each time. To read
+    many frames without allocating, use zframe_recv_into.
 @end
 */
 
@@ -30,12 +39,35 @@
 //  their data, which lets us do runtime object typing & validation.
 #define ZFRAME_TAG              0x0002cafe
 
+//  Frame data shared by duplicates. Each duplicate holds its own zmq_msg_t
+//  on the data, which libzmq releases when the frame is destroyed, or once
+//  it has been sent, maybe from an I/O thread. So the reference count is
+//  atomic, and a frame that sees a count of one holds the only reference.
+
+typedef struct {
+    zmq_msg_t zmsg;             //  Message that owns the data
+    volatile long refs;         //  Messages using the data
+} s_shared_t;
+
+#if defined (__WINDOWS__)
+#   define s_shared_acquire(ptr) InterlockedIncrement ((LONG volatile *) (ptr))
+#   define s_shared_release(ptr) InterlockedDecrement ((LONG volatile *) (ptr))
+#else
+#   define s_shared_acquire(ptr) __sync_add_and_fetch ((ptr), 1)
+#   define s_shared_release(ptr) __sync_sub_and_fetch ((ptr), 1)
+#endif
+
+//  Frames up to this size are copied when duplicated; libzmq holds them
+//  inline, which is cheaper than a shared reference
+#define ZFRAME_SHARED_MIN       32
+
 //  Structure of our class
 
 struct _zframe_t {
     uint32_t tag;               //  Object tag for runtime detection
     zmq_msg_t zmsg;             //  zmq_msg_t blob for frame
     int more;                   //  More flag, from last read
+    s_shared_t *shared;         //  Data shared with duplicates, or NULL
 };
 
 //  --------------------------------------------------------------------------
@@ -45,7 +77,7 @@ struct _zframe_t {
 zframe_t *
 zframe_new (const void *data, size_t size)
 {
-    zframe_t *self = (zframe_t *) zmalloc (sizeof (zframe_t));
+    zframe_t *self = (zframe_t *) zsys_pool_alloc (ZSYS_POOL_FRAME, sizeof (zframe_t));
     if (self) {
         self->tag = ZFRAME_TAG;
         if (size) {
@@ -60,6 +92,32 @@ zframe_new (const void *data, size_t size)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Create a frame that uses the caller's data as its body, without copying
+//  it. The frame takes ownership of the data, and calls free_fn with the
+//  data and the hint when the frame and any copies of it are sent or
+//  destroyed, and libzmq no longer needs the data. The free function is
+//  called exactly once, and may be called from a libzmq I/O thread. If
+//  free_fn is null, the data must stay valid for as long as libzmq may use
+//  it, e.g. static data. Returns NULL if the frame could not be created,
+//  in which case the caller still owns the data.
+
+zframe_t *
+zframe_new_zero_copy (void *data, size_t size, zframe_free_fn *free_fn, void *hint)
+{
+    assert (data || size == 0);
+    zframe_t *self = (zframe_t *) zsys_pool_alloc (ZSYS_POOL_FRAME, sizeof (zframe_t));
+    if (self) {
+        self->tag = ZFRAME_TAG;
+        if (zmq_msg_init_data (&self->zmsg, data, size, free_fn, hint)) {
+            zsys_pool_free (ZSYS_POOL_FRAME, self);
+            self = NULL;
+        }
+    }
+    return self;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Create an empty (zero-sized) frame. The caller is responsible for 
 //  destroying the return value when finished with it.
@@ -67,7 +125,7 @@ zframe_new (const void *data, size_t size)
 zframe_t *
 zframe_new_empty (void)
 {
-    zframe_t *self = (zframe_t *) zmalloc (sizeof (zframe_t));
+    zframe_t *self = (zframe_t *) zsys_pool_alloc (ZSYS_POOL_FRAME, sizeof (zframe_t));
     if (self) {
         self->tag = ZFRAME_TAG;
         zmq_msg_init (&self->zmsg);
@@ -88,12 +146,24 @@ zframe_destroy (zframe_t **self_p)
         assert (zframe_is (self));
         zmq_msg_close (&self->zmsg);
         self->tag = 0xDeadBeef;
-        free (self);
+        zsys_pool_free (ZSYS_POOL_FRAME, self);
         *self_p = NULL;
     }
 }
 
 
+//  --------------------------------------------------------------------------
+//  Count a received frame in the traffic counters of the socket, if any
+
+static void
+s_count_received (zframe_t *self, void *source)
+{
+    zsock_stats_t *stats = zsock_stats_of (source);
+    if (stats)
+        zsock_stats_received (stats, zmq_msg_size (&self->zmsg), self->more);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Receive frame from socket, returns zframe_t object or NULL if the recv
 //  was interrupted. Does a blocking recv, if you want to not block then use
@@ -110,45 +180,119 @@ zframe_recv (void *source)
             zframe_destroy (&self);
             return NULL;            //  Interrupted or terminated
         }
-        self->more = zsock_rcvmore (handle);
+        self->more = zmq_msg_more (&self->zmsg);
+        s_count_received (self, source);
     }
     return self;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Receive frame from socket into an existing frame, replacing its former
+//  contents, so a loop that reads many frames can use one frame object.
+//  Returns 0 if OK, or -1 if the recv was interrupted, in which case the
+//  frame is left empty. Does a blocking recv, like zframe_recv.
+
+int
+zframe_recv_into (zframe_t *self, void *source)
+{
+    assert (self);
+    assert (zframe_is (self));
+    assert (source);
+    if (zframe_recv_resolved (self, source, zsock_resolve (source), 0)) {
+        zmq_msg_close (&self->zmsg);
+        zmq_msg_init (&self->zmsg);
+        self->shared = NULL;
+        self->more = 0;
+        return -1;              //  Interrupted or terminated
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive frame into an existing frame, as zframe_recv_into, from the
+//  libzmq socket handle that the caller resolved from source. Flags may be
+//  ZFRAME_DONTWAIT. Returns 0 if OK, or -1 if no frame was waiting or the
+//  recv was interrupted, in which case the frame is not changed. Not a
+//  part of the official interface; CZMQ classes use this to read many
+//  frames with one resolve.
+
+int
+zframe_recv_resolved (zframe_t *self, void *source, void *handle, int flags)
+{
+    assert (self);
+    assert (zframe_is (self));
+    assert (source);
+    zmq_msg_t msg;
+    zmq_msg_init (&msg);
+    if (zmq_recvmsg (handle, &msg, (flags & ZFRAME_DONTWAIT)? ZMQ_DONTWAIT: 0) < 0) {
+        zmq_msg_close (&msg);
+        return -1;
+    }
+    zmq_msg_move (&self->zmsg, &msg);
+    self->shared = NULL;
+    self->more = zmq_msg_more (&self->zmsg);
+    s_count_received (self, source);
+    return 0;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Send frame to socket, destroy after sending unless ZFRAME_REUSE is
 //  set or the attempt to send the message errors out.
 
 int
 zframe_send (zframe_t **self_p, void *dest, int flags)
+{
+    assert (dest);
+    assert (self_p);
+    return zframe_send_resolved (self_p, dest, zsock_resolve (dest), flags);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send frame, as zframe_send, on the libzmq socket handle that the caller
+//  resolved from dest. Not a part of the official interface; CZMQ classes
+//  use this to send many frames with one resolve.
+
+int
+zframe_send_resolved (zframe_t **self_p, void *dest, void *handle, int flags)
 {
     assert (dest);
     assert (self_p);
 
-    void *handle = zsock_resolve (dest);
     if (*self_p) {
         zframe_t *self = *self_p;
         assert (zframe_is (self));
 
         int send_flags = (flags & ZFRAME_MORE)? ZMQ_SNDMORE: 0;
         send_flags |= (flags & ZFRAME_DONTWAIT)? ZMQ_DONTWAIT: 0;
+        //  Blocking sends are timed, if the socket counts its traffic
+        zsock_stats_t *stats = zsock_stats_of (dest);
+        int64_t started = stats && !(flags & ZFRAME_DONTWAIT)? zclock_usecs (): 0;
+        size_t size = zmq_msg_size (&self->zmsg);
+        int rc;
         if (flags & ZFRAME_REUSE) {
             zmq_msg_t copy;
             zmq_msg_init (&copy);
             if (zmq_msg_copy (&copy, &self->zmsg))
                 return -1;
-            if (zmq_sendmsg (handle, &copy, send_flags) == -1) {
+            rc = zmq_sendmsg (handle, &copy, send_flags) == -1? -1: 0;
+            if (stats)
+                zsock_stats_sent (stats, size, (flags & ZFRAME_MORE) != 0, rc, started);
+            if (rc == -1)
                 zmq_msg_close (&copy);
-                return -1;
-            }
         }
         else {
-            if (zmq_sendmsg (handle, &self->zmsg, send_flags) >= 0)
+            rc = zmq_sendmsg (handle, &self->zmsg, send_flags) == -1? -1: 0;
+            if (stats)
+                zsock_stats_sent (stats, size, (flags & ZFRAME_MORE) != 0, rc, started);
+            if (rc == 0)
                 zframe_destroy (self_p);
-            else
-                return -1;
         }
+        if (rc == -1)
+            return -1;
     }
     return 0;
 }
@@ -167,7 +311,11 @@ zframe_size (zframe_t *self)
 
 
 //  --------------------------------------------------------------------------
-//  Return pointer to frame data.
+//  Return address of frame data. If the frame shares its data with a
+//  duplicate, first takes a private copy, so the caller may modify it.
+//  Asserts if there is not enough memory for the copy. Note that a pointer
+//  you got before duplicating the frame still refers to the shared data, so
+//  do not modify the data through it.
 
 byte *
 zframe_data (zframe_t *self)
@@ -175,20 +323,120 @@ zframe_data (zframe_t *self)
     assert (self);
     assert (zframe_is (self));
 
+#if defined (ZMQ_SHARED)
+    if (zmq_msg_get (&self->zmsg, ZMQ_SHARED) == 1
+    || (self->shared && self->shared->refs > 1)) {
+        zmq_msg_t copy;
+        size_t size = zmq_msg_size (&self->zmsg);
+        int rc = zmq_msg_init_size (&copy, size);
+        assert (rc == 0);
+        memcpy (zmq_msg_data (&copy), zmq_msg_data (&self->zmsg), size);
+        zmq_msg_move (&self->zmsg, &copy);
+        zmq_msg_close (&copy);
+        self->shared = NULL;
+    }
+#endif
     return (byte *) zmq_msg_data (&self->zmsg);
 }
 
 
+//  --------------------------------------------------------------------------
+//  Return pointer to frame data, without taking a private copy if the frame
+//  shares its data, so the caller must not modify the data. Not a part of
+//  the official interface; CZMQ classes use this to read frames.
+
+const byte *
+zframe_peek (zframe_t *self)
+{
+    assert (self);
+    assert (zframe_is (self));
+
+    return (const byte *) zmq_msg_data (&self->zmsg);
+}
+
+
+#if defined (ZMQ_SHARED)
+//  Drop one reference to data shared by duplicate frames, and release the
+//  data after the last one
+
+static void
+s_shared_free (void *data, void *hint)
+{
+    s_shared_t *shared = (s_shared_t *) hint;
+    if (s_shared_release (&shared->refs) == 0) {
+        zmq_msg_close (&shared->zmsg);
+        free (shared);
+    }
+}
+
+//  Move the frame's data into a shared reference, which the frame then
+//  uses. Returns 0 if OK, -1 if there was not enough memory, in which case
+//  the frame is unchanged.
+
+static int
+s_frame_share (zframe_t *self)
+{
+    s_shared_t *shared = (s_shared_t *) malloc (sizeof (s_shared_t));
+    if (!shared)
+        return -1;
+    shared->refs = 1;
+    zmq_msg_init (&shared->zmsg);
+    zmq_msg_move (&shared->zmsg, &self->zmsg);
+    if (zmq_msg_init_data (&self->zmsg, zmq_msg_data (&shared->zmsg),
+                           zmq_msg_size (&shared->zmsg), s_shared_free, shared)) {
+        zmq_msg_move (&self->zmsg, &shared->zmsg);
+        zmq_msg_close (&shared->zmsg);
+        free (shared);
+        return -1;
+    }
+    self->shared = shared;
+    return 0;
+}
+#endif
+
+
 //  --------------------------------------------------------------------------
 //  Create a new frame that duplicates an existing frame. If frame is null,
-//  or memory was exhausted, returns null.
+//  or memory was exhausted, returns null. Where libzmq allows, the copy
+//  shares the frame data rather than copying it; either frame takes its
+//  own copy if its data is then modified via zframe_data, until the other
+//  frames sharing the data are destroyed or sent.
 
 zframe_t *
 zframe_dup (zframe_t *self)
 {
     if (self) {
         assert (zframe_is (self));
+#if defined (ZMQ_SHARED)
+        zframe_t *copy = zframe_new_empty ();
+        if (!copy)
+            return NULL;
+        size_t size = zmq_msg_size (&self->zmsg);
+        //  We let libzmq copy small frames, and frames it already shares
+        if (size <= ZFRAME_SHARED_MIN
+        ||  zmq_msg_get (&self->zmsg, ZMQ_SHARED) == 1) {
+            if (zmq_msg_copy (&copy->zmsg, &self->zmsg))
+                zframe_destroy (&copy);
+            return copy;
+        }
+        if (!self->shared && s_frame_share (self)) {
+            zframe_destroy (&copy);
+            return NULL;
+        }
+        s_shared_acquire (&self->shared->refs);
+        zmq_msg_close (&copy->zmsg);
+        if (zmq_msg_init_data (&copy->zmsg, zmq_msg_data (&self->zmsg), size,
+                               s_shared_free, self->shared)) {
+            s_shared_release (&self->shared->refs);
+            zmq_msg_init (&copy->zmsg);
+            zframe_destroy (&copy);
+            return NULL;
+        }
+        copy->shared = self->shared;
+        return copy;
+#else
         return zframe_new (zframe_data (self), zframe_size (self));
+#endif
     }
     else
         return NULL;
@@ -209,7 +457,7 @@ zframe_strhex (zframe_t *self)
         hex_char [] = "0123456789ABCDEF";
 
     size_t size = zframe_size (self);
-    byte *data = zframe_data (self);
+    byte *data = (byte *) zmq_msg_data (&self->zmsg);
     char *hex_str = (char *) zmalloc (size * 2 + 1);
     if (!hex_str)
         return NULL;
@@ -237,7 +485,7 @@ zframe_strdup (zframe_t *self)
     size_t size = zframe_size (self);
     char *string = (char *) malloc (size + 1);
     if (string) {
-        memcpy (string, zframe_data (self), size);
+        memcpy (string, (byte *) zmq_msg_data (&self->zmsg), size);
         string [size] = 0;
     }
     return string;
@@ -254,7 +502,7 @@ zframe_streq (zframe_t *self, const char *string)
     assert (zframe_is (self));
 
     if (zframe_size (self) == strlen (string)
-    && memcmp (zframe_data (self), string, strlen (string)) == 0) 
+    && memcmp ((byte *) zmq_msg_data (&self->zmsg), string, strlen (string)) == 0) 
         return true;
     else
         return false;
@@ -303,8 +551,8 @@ zframe_eq (zframe_t *self, zframe_t *other)
         assert (zframe_is (other));
 
         if (zframe_size (self) == zframe_size (other)
-        &&  memcmp (zframe_data (self),
-                    zframe_data (other),
+        &&  memcmp (zmq_msg_data (&self->zmsg),
+                    zmq_msg_data (&other->zmsg),
                     zframe_size (self)) == 0)
             return true;
         else
@@ -326,6 +574,7 @@ zframe_reset (zframe_t *self, const void *data, size_t size)
     zmq_msg_close (&self->zmsg);
     zmq_msg_init_size (&self->zmsg, size);
     memcpy (zmq_msg_data (&self->zmsg), data, size);
+    self->shared = NULL;
 }
 
 
@@ -339,7 +588,7 @@ zframe_print (zframe_t *self, const char *prefix)
     assert (self);
     assert (zframe_is (self));
 
-    byte *data = zframe_data (self);
+    byte *data = (byte *) zmq_msg_data (&self->zmsg);
     size_t size = zframe_size (self);
 
     //  Probe data to check if it looks like unprintable binary
@@ -396,7 +645,8 @@ zframe_recv_nowait (void *source)
             zframe_destroy (&self);
             return NULL;            //  Interrupted or terminated
         }
-        self->more = zsock_rcvmore (handle);
+        self->more = zmq_msg_more (&self->zmsg);
+        s_count_received (self, source);
     }
     return self;
 }
@@ -415,7 +665,7 @@ zframe_fprint (zframe_t *self, const char *prefix, FILE *file)
 
     if (prefix)
         fprintf (file, "%s", prefix);
-    byte *data = zframe_data (self);
+    byte *data = (byte *) zmq_msg_data (&self->zmsg);
     size_t size = zframe_size (self);
 
     int is_bin = 0;
@@ -444,6 +694,15 @@ zframe_fprint (zframe_t *self, const char *prefix, FILE *file)
 //  --------------------------------------------------------------------------
 //  Selftest
 
+//  Count each time a zero-copy buffer is released
+
+static void
+s_free_counted (void *data, void *hint)
+{
+    (*((int *) hint))++;
+    free (data);
+}
+
 void
 zframe_test (bool verbose)
 {
@@ -516,6 +775,104 @@ zframe_test (bool verbose)
     }
     assert (frame_nbr == 10);
 
+    //  Send a large zero-copy frame, several times over; the buffer must
+    //  be used as is, and released exactly once, after the last copy
+    int released = 0;
+    size_t buffer_size = 1024 * 1024;
+    byte *buffer = (byte *) zmalloc (buffer_size);
+    assert (buffer);
+    buffer [buffer_size - 1] = 0xAB;
+    frame = zframe_new_zero_copy (buffer, buffer_size, s_free_counted, &released);
+    assert (frame);
+    assert (zframe_data (frame) == buffer);
+    assert (zframe_size (frame) == buffer_size);
+    rc = zframe_send (&frame, output, ZFRAME_REUSE);
+    assert (rc == 0);
+    rc = zframe_send (&frame, output, 0);
+    assert (rc == 0);
+    assert (frame == NULL);
+    for (frame_nbr = 0; frame_nbr < 2; frame_nbr++) {
+        frame = zframe_recv (input);
+        assert (frame);
+        assert (zframe_size (frame) == buffer_size);
+        assert (zframe_data (frame) [buffer_size - 1] == 0xAB);
+        zframe_destroy (&frame);
+    }
+    assert (released == 1);
+
+    //  Destroying an unsent zero-copy frame also releases the buffer
+    frame = zframe_new_zero_copy (malloc (100), 100, s_free_counted, &released);
+    assert (frame);
+    zframe_destroy (&frame);
+    assert (released == 2);
+
+    //  A duplicate shares its data until either frame is modified
+    frame = zframe_new (NULL, 1000);
+    assert (frame);
+    memset (zframe_data (frame), 'A', 1000);
+    copy = zframe_dup (frame);
+    assert (copy);
+    assert (zframe_eq (frame, copy));
+    zframe_data (copy) [0] = 'B';
+    assert (!zframe_eq (frame, copy));
+    assert (zframe_data (frame) [0] == 'A');
+    zframe_destroy (&copy);
+    zframe_destroy (&frame);
+#if defined (ZMQ_SHARED)
+    //  A duplicated zero-copy buffer is released after the last frame
+    frame = zframe_new_zero_copy (malloc (1000), 1000, s_free_counted, &released);
+    assert (frame);
+    copy = zframe_dup (frame);
+    assert (copy);
+    zframe_destroy (&frame);
+    assert (released == 2);
+    zframe_destroy (&copy);
+    assert (released == 3);
+
+    //  Reading a duplicate does not copy its data, and once the other frame
+    //  is destroyed, the data is no longer shared
+    frame = zframe_new (NULL, 1000);
+    assert (frame);
+    byte *data = zframe_data (frame);
+    copy = zframe_dup (frame);
+    assert (copy);
+    assert (zframe_peek (copy) == data);
+    assert (zframe_peek (frame) == data);
+    zframe_destroy (&copy);
+    assert (zframe_data (frame) == data);
+    zframe_destroy (&frame);
+#endif
+
+    //  With the object pool on, destroyed frames are reused
+    zsys_set_object_pool (100);
+    uint64_t hits = zsys_object_pool_hits ();
+    for (frame_nbr = 0; frame_nbr < 1000; frame_nbr++) {
+        frame = zframe_new ("Hello", 5);
+        assert (frame);
+        assert (zframe_more (frame) == 0);
+        assert (zframe_streq (frame, "Hello"));
+        zframe_destroy (&frame);
+    }
+    assert (zsys_object_pool_hits () >= hits + 512);
+
+    //  Receive several frames into one frame object
+    rc = zstr_sendm (output, "One");
+    assert (rc == 0);
+    rc = zstr_send (output, "Two");
+    assert (rc == 0);
+    frame = zframe_new_empty ();
+    assert (frame);
+    rc = zframe_recv_into (frame, input);
+    assert (rc == 0);
+    assert (zframe_streq (frame, "One"));
+    assert (zframe_more (frame));
+    rc = zframe_recv_into (frame, input);
+    assert (rc == 0);
+    assert (zframe_streq (frame, "Two"));
+    assert (!zframe_more (frame));
+    zframe_destroy (&frame);
+    zsys_set_object_pool (0);
+
     zsock_destroy (&input);
     zsock_destroy (&output);
 
@@ -862,9 +862,9 @@ zhashx_unpack (zframe_t *frame)
     if (zframe_size (frame) < 4)
         return self;            //  Arguable...
 
-    byte *needle = zframe_data (frame);
-    byte *ceiling = needle + zframe_size (frame);
-    size_t nbr_items = ntohl (*(uint32_t *) needle);
+    const byte *needle = zframe_peek (frame);
+    const byte *ceiling = needle + zframe_size (frame);
+    size_t nbr_items = ntohl (*(const uint32_t *) needle);
     needle += 4;
     while (nbr_items && needle < ceiling) {
         //  Get key as string
@@ -877,7 +877,7 @@ zhashx_unpack (zframe_t *frame)
 
             //  Get value as longstr
             if (needle + 4 <= ceiling) {
-                size_t value_size = ntohl (*(uint32_t *) needle);
+                size_t value_size = ntohl (*(const uint32_t *) needle);
                 needle += 4;
                 //  Be wary of malformed frames
                 if (needle + value_size <= ceiling) {
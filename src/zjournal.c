@@ -0,0 +1,1038 @@
+/*  =========================================================================
+    zjournal - append-only message journal
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zjournal class keeps a durable, append-only log of messages in a
+    directory on disk, and replays them either in order or by sequence
+    number. Each message gets a sequence number, counting from zero, in the
+    order it was appended. Messages are stored in the zmsg_encode format.
+@discuss
+    Appends are collected in memory, and written to disk in batches, when
+    the batch is full, or when you call zjournal_flush. If you enable sync,
+    each batch is also flushed to stable storage with a single fsync, so
+    one fsync covers all the messages in the batch.
+
+    The journal is split into segment files, and starts a new segment when
+    the current one reaches the segment size. Each segment keeps a sparse
+    index of every Nth message, which is saved next to the segment when it
+    is full, so that reopening a large journal does not need to read all
+    of it. When the journal is opened, it reads the last segment to find
+    the last complete message, and ignores anything after that, such as a
+    message that was only partly written when a process crashed. Each
+    message carries a CRC, so a message that was torn or damaged on disk
+    is not taken for a complete one.
+
+    Replay maps the segment files into memory where the system supports
+    that, and the frames of replayed messages refer to the mapped file
+    rather than copies of it. The mapping stays valid until all of these
+    frames are destroyed. To capture traffic from a zproxy, append each
+    message received on its CAPTURE socket. A journal may only be used
+    from one thread.
+@end
+*/
+
+#include "../include/czmq.h"
+
+//  Each record is a marker octet, a 4-octet size, a 4-octet CRC-32 of the
+//  encoded message, and the encoded message
+#define RECORD_MARKER       0xD1
+#define RECORD_HEADER       9
+
+//  Default settings
+#define SEGMENT_SIZE        (64 * 1024 * 1024)
+#define BATCH_SIZE          (64 * 1024)
+#define INDEX_INTERVAL      64
+
+#if defined (__WINDOWS__)
+#   define s_map_acquire(ptr) InterlockedIncrement ((LONG volatile *) (ptr))
+#   define s_map_release(ptr) InterlockedDecrement ((LONG volatile *) (ptr))
+#else
+#   define s_map_acquire(ptr) __sync_add_and_fetch ((ptr), 1)
+#   define s_map_release(ptr) __sync_sub_and_fetch ((ptr), 1)
+#endif
+
+//  A segment file mapped into memory. The journal holds one reference, and
+//  each replayed message holds another. Messages may be released from
+//  libzmq I/O threads, so the count is atomic.
+
+typedef struct {
+    byte *data;                 //  File contents
+    size_t size;                //  Size of mapping
+    volatile long refs;         //  Journal and messages using map
+} s_map_t;
+
+//  A segment of the journal, held in one file
+
+typedef struct {
+    char *filename;             //  Segment file name
+    uint64_t first;             //  Sequence number of first message
+    uint64_t count;             //  Number of messages in segment
+    size_t size;                //  Size of records in segment
+    size_t interval;            //  Messages per index entry
+    size_t *index;              //  Offset of every interval'th message
+    size_t index_size;          //  Number of index entries
+    size_t index_limit;         //  Allocated index entries
+    s_map_t *map;               //  Current mapping of file, if any
+} s_segment_t;
+
+//  Structure of our class
+
+struct _zjournal_t {
+    char *path;                 //  Directory holding journal
+    s_segment_t **segments;     //  Segments in sequence order
+    size_t nbr_segments;        //  Number of segments
+    size_t max_segments;        //  Allocated segment slots
+    FILE *handle;               //  Last segment, open for appending
+    byte *batch;                //  Records not yet written
+    size_t batch_size;          //  Size of records not yet written
+    size_t batch_limit;         //  Allocated size of batch
+    size_t batch_max;           //  Write batch when it reaches this size
+    size_t segment_max;         //  Start new segment at this size
+    size_t interval;            //  Messages per index entry
+    bool sync;                  //  Flush batches to stable storage
+    size_t cursor_segment;      //  Replay position, segment
+    size_t cursor_offset;       //  Replay position, offset in segment
+    uint64_t cursor;            //  Sequence number at replay position
+};
+
+//  Local helper functions
+static s_segment_t *s_segment_new (zjournal_t *self, uint64_t first);
+static void s_segment_destroy (s_segment_t **self_p);
+static int s_segment_index (s_segment_t *self, size_t offset);
+static int s_segment_load (s_segment_t *self, bool last);
+static int s_segment_save (s_segment_t *self, bool sync);
+static s_map_t *s_segment_map (s_segment_t *self);
+static int s_open_last (zjournal_t *self);
+static int s_seal_last (zjournal_t *self);
+static int s_add_segment (zjournal_t *self, uint64_t first);
+static int s_reopen_last (zjournal_t *self);
+static int s_sync (FILE *handle);
+static uint32_t s_crc32 (const byte *data, size_t size);
+static void s_map_free (void *data, void *hint);
+
+
+//  --------------------------------------------------------------------------
+//  Create a new journal, or open an existing one, in the specified
+//  directory, which is created if needed. Returns NULL if the directory
+//  could not be created or an existing journal could not be read.
+
+zjournal_t *
+zjournal_new (const char *path)
+{
+    assert (path);
+    if (zsys_dir_create ("%s", path))
+        return NULL;
+
+    zjournal_t *self = (zjournal_t *) zmalloc (sizeof (zjournal_t));
+    if (!self)
+        return NULL;
+    self->path = strdup (path);
+    self->batch_max = BATCH_SIZE;
+    self->segment_max = SEGMENT_SIZE;
+    self->interval = INDEX_INTERVAL;
+    if (!self->path) {
+        zjournal_destroy (&self);
+        return NULL;
+    }
+    //  Load existing segments, in order; the names sort by sequence
+    zdir_t *dir = zdir_new (path, NULL);
+    zfile_t **files = dir? zdir_flatten (dir): NULL;
+    size_t index;
+    for (index = 0; files && files [index]; index++) {
+        const char *filename = zfile_filename (files [index], path);
+        uint64_t first;
+        char extension [8];
+        if (sscanf (filename, "%" SCNu64 ".%7s", &first, extension) != 2
+        ||  strneq (extension, "journal"))
+            continue;
+        if (s_add_segment (self, first)) {
+            zjournal_destroy (&self);
+            break;
+        }
+    }
+    zdir_flatten_free (&files);
+    zdir_destroy (&dir);
+    if (!self)
+        return NULL;
+
+    for (index = 0; index < self->nbr_segments; index++) {
+        s_segment_t *segment = self->segments [index];
+        if (s_segment_load (segment, index == self->nbr_segments - 1)) {
+            zjournal_destroy (&self);
+            return NULL;
+        }
+    }
+    if (self->nbr_segments == 0 && s_add_segment (self, 0)) {
+        zjournal_destroy (&self);
+        return NULL;
+    }
+    if (s_open_last (self)) {
+        zjournal_destroy (&self);
+        return NULL;
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a journal, writing any messages not yet written. Messages that
+//  were replayed from the journal stay valid until they are destroyed.
+
+void
+zjournal_destroy (zjournal_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zjournal_t *self = *self_p;
+        if (zjournal_flush (self))
+            zsys_error ("zjournal: could not write %s, messages lost", self->path);
+        if (self->handle)
+            fclose (self->handle);
+        size_t index;
+        for (index = 0; index < self->nbr_segments; index++)
+            s_segment_destroy (&self->segments [index]);
+        free (self->segments);
+        free (self->batch);
+        free (self->path);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the size at which the journal starts a new segment file. The
+//  default is 64MB. A message larger than this gets a segment of its own.
+
+void
+zjournal_set_segment_size (zjournal_t *self, size_t segment_size)
+{
+    assert (self);
+    self->segment_max = segment_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the size of the batch of appended messages that the journal holds
+//  before writing them to disk. The default is 64KB. Set to zero to write
+//  each message as it is appended.
+
+void
+zjournal_set_batch_size (zjournal_t *self, size_t batch_size)
+{
+    assert (self);
+    self->batch_max = batch_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  If sync is true, the journal flushes each batch it writes to stable
+//  storage, so that appended messages survive a system crash once written.
+//  By default, the journal leaves this to the operating system.
+
+void
+zjournal_set_sync (zjournal_t *self, bool sync)
+{
+    assert (self);
+    self->sync = sync;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set how many messages each index entry covers, for segments created from
+//  now on. Reading a message by sequence number scans up to this many
+//  records. The default is 64.
+
+void
+zjournal_set_index_interval (zjournal_t *self, size_t interval)
+{
+    assert (self);
+    assert (interval > 0);
+    self->interval = interval;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Append a message to the journal. Does not destroy the message. Returns
+//  0 if OK, or -1 if the message could not be written.
+
+int
+zjournal_append (zjournal_t *self, zmsg_t *msg)
+{
+    assert (self);
+    assert (msg);
+    if (!self->handle && s_reopen_last (self))
+        return -1;              //  Could not reopen after failed write
+
+    size_t encoded_size = zmsg_encode_size (msg);
+    if (encoded_size > 0xFFFFFFFF)
+        return -1;              //  Too large for a record
+    size_t record_size = RECORD_HEADER + encoded_size;
+
+    s_segment_t *segment = self->segments [self->nbr_segments - 1];
+    if (segment->count && segment->size + record_size > self->segment_max) {
+        if (s_seal_last (self)
+        ||  s_add_segment (self, segment->first + segment->count)
+        ||  s_open_last (self))
+            return -1;
+        segment = self->segments [self->nbr_segments - 1];
+    }
+    if (self->batch_size + record_size > self->batch_limit) {
+        size_t limit = self->batch_size + record_size;
+        if (limit < self->batch_max)
+            limit = self->batch_max;
+        byte *batch = (byte *) realloc (self->batch, limit);
+        if (!batch)
+            return -1;
+        self->batch = batch;
+        self->batch_limit = limit;
+    }
+    size_t index_size = segment->index_size;
+    if (segment->count % segment->interval == 0
+    &&  s_segment_index (segment, segment->size))
+        return -1;
+
+    byte *record = self->batch + self->batch_size;
+    zmsg_encode_into (msg, record + RECORD_HEADER, encoded_size);
+    uint32_t crc = s_crc32 (record + RECORD_HEADER, encoded_size);
+    record [0] = RECORD_MARKER;
+    record [1] = (byte) ((encoded_size >> 24) & 255);
+    record [2] = (byte) ((encoded_size >> 16) & 255);
+    record [3] = (byte) ((encoded_size >>  8) & 255);
+    record [4] = (byte) ( encoded_size        & 255);
+    record [5] = (byte) ((crc >> 24) & 255);
+    record [6] = (byte) ((crc >> 16) & 255);
+    record [7] = (byte) ((crc >>  8) & 255);
+    record [8] = (byte) ( crc        & 255);
+    self->batch_size += record_size;
+    segment->size += record_size;
+    segment->count++;
+
+    if (self->batch_size >= self->batch_max && zjournal_flush (self)) {
+        //  Take this message back out of the batch, and keep the rest of
+        //  the batch, which we already accepted, to write next time
+        self->batch_size -= record_size;
+        segment->size -= record_size;
+        segment->count--;
+        segment->index_size = index_size;
+        return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Write any appended messages that are still held in memory, and flush
+//  them to stable storage if sync is enabled. Returns 0 if OK, or -1 if
+//  the write failed, in which case the journal keeps the messages, and
+//  writes them again on the next flush.
+
+int
+zjournal_flush (zjournal_t *self)
+{
+    assert (self);
+    if (self->batch_size == 0)
+        return 0;
+    if (!self->handle && s_reopen_last (self))
+        return -1;
+
+    if (fwrite (self->batch, 1, self->batch_size, self->handle) < self->batch_size
+    ||  fflush (self->handle)
+    ||  (self->sync && s_sync (self->handle))) {
+        //  The file may now end with part of the batch, so we go back to
+        //  the end of the last batch we wrote
+        s_segment_t *segment = self->segments [self->nbr_segments - 1];
+        zsys_error ("zjournal: could not write %s", segment->filename);
+        fclose (self->handle);
+        self->handle = NULL;
+        if (s_reopen_last (self))
+            zsys_error ("zjournal: could not reopen %s", segment->filename);
+        return -1;
+    }
+    self->batch_size = 0;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of messages in the journal, which is also the sequence
+//  number of the next message to be appended.
+
+uint64_t
+zjournal_size (zjournal_t *self)
+{
+    assert (self);
+    s_segment_t *segment = self->segments [self->nbr_segments - 1];
+    return segment->first + segment->count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Position replay at the specified sequence number, so the next call to
+//  zjournal_next returns that message. Returns 0 if OK, or -1 if there is
+//  no such message.
+
+int
+zjournal_seek (zjournal_t *self, uint64_t sequence)
+{
+    assert (self);
+    if (sequence >= zjournal_size (self) || zjournal_flush (self))
+        return -1;
+
+    //  Find segment holding message
+    size_t lower = 0;
+    size_t upper = self->nbr_segments - 1;
+    while (lower < upper) {
+        size_t middle = (lower + upper + 1) / 2;
+        if (self->segments [middle]->first <= sequence)
+            lower = middle;
+        else
+            upper = middle - 1;
+    }
+    s_segment_t *segment = self->segments [lower];
+    s_map_t *map = s_segment_map (segment);
+    if (!map)
+        return -1;
+
+    //  Start at nearest index entry, and step over the remaining records
+    uint64_t position = sequence - segment->first;
+    size_t offset = segment->index [position / segment->interval];
+    size_t skip = (size_t) (position % segment->interval);
+    while (skip--) {
+        byte *record = map->data + offset;
+        offset += RECORD_HEADER + ((size_t) record [1] << 24)
+                                + ((size_t) record [2] << 16)
+                                + ((size_t) record [3] << 8)
+                                +  (size_t) record [4];
+    }
+    self->cursor_segment = lower;
+    self->cursor_offset = offset;
+    self->cursor = sequence;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the message at the replay position, and move to the following
+//  message. Replay starts at the first message in the journal, unless you
+//  call zjournal_seek. Returns NULL at the end of the journal, or if the
+//  message could not be read. Frames refer to the journal file rather than
+//  copying it, where the system allows.
+//  Caller owns return value and must destroy it when done.
+
+zmsg_t *
+zjournal_next (zjournal_t *self)
+{
+    assert (self);
+    if (self->cursor >= zjournal_size (self) || zjournal_flush (self))
+        return NULL;
+
+    //  Move to next segment when we're at the end of one
+    s_segment_t *segment = self->segments [self->cursor_segment];
+    while (self->cursor >= segment->first + segment->count) {
+        segment = self->segments [++self->cursor_segment];
+        self->cursor_offset = 0;
+    }
+    s_map_t *map = s_segment_map (segment);
+    if (!map)
+        return NULL;
+
+    byte *record = map->data + self->cursor_offset;
+    size_t size = ((size_t) record [1] << 24)
+                + ((size_t) record [2] << 16)
+                + ((size_t) record [3] << 8)
+                +  (size_t) record [4];
+    self->cursor_offset += RECORD_HEADER + size;
+    self->cursor++;
+
+    s_map_acquire (&map->refs);
+    return zmsg_decode_zero_copy (record + RECORD_HEADER, size, s_map_free, map);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the message with the specified sequence number, or NULL if there
+//  is no such message or it could not be read. Moves the replay position
+//  to the following message.
+//  Caller owns return value and must destroy it when done.
+
+zmsg_t *
+zjournal_read (zjournal_t *self, uint64_t sequence)
+{
+    assert (self);
+    if (zjournal_seek (self, sequence))
+        return NULL;
+    return zjournal_next (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a segment starting at the specified sequence number
+
+static s_segment_t *
+s_segment_new (zjournal_t *self, uint64_t first)
+{
+    s_segment_t *segment = (s_segment_t *) zmalloc (sizeof (s_segment_t));
+    if (segment) {
+        segment->first = first;
+        segment->interval = self->interval;
+        segment->filename = zsys_sprintf ("%s/%020" PRIu64 ".journal", self->path, first);
+        if (!segment->filename)
+            s_segment_destroy (&segment);
+    }
+    return segment;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a segment; its mapping lasts until replayed messages are gone
+
+static void
+s_segment_destroy (s_segment_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        s_segment_t *self = *self_p;
+        if (self->map)
+            s_map_free (NULL, self->map);
+        free (self->index);
+        zstr_free (&self->filename);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add an index entry for a record at the specified offset
+
+static int
+s_segment_index (s_segment_t *self, size_t offset)
+{
+    if (self->index_size == self->index_limit) {
+        size_t limit = self->index_limit? self->index_limit * 2: 16;
+        size_t *index = (size_t *) realloc (self->index, limit * sizeof (size_t));
+        if (!index)
+            return -1;
+        self->index = index;
+        self->index_limit = limit;
+    }
+    self->index [self->index_size++] = offset;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Load a segment from disk, from its saved index if it has one, else by
+//  reading its records. Records after the last complete one are ignored.
+//  Returns 0 if OK, -1 if the segment could not be read.
+
+static int
+s_segment_load (s_segment_t *self, bool last)
+{
+    self->count = 0;
+    self->size = 0;
+    self->index_size = 0;
+
+    //  A full segment has its index saved next to it
+    char *index_name = zsys_sprintf ("%.*s.index",
+        (int) (strlen (self->filename) - strlen (".journal")), self->filename);
+    if (!index_name)
+        return -1;
+    FILE *file = last? NULL: fopen (index_name, "rb");
+    zstr_free (&index_name);
+    if (file) {
+        uint64_t header [4];
+        bool loaded = false;
+        if (fread (header, sizeof (header), 1, file) == 1 && header [2] > 0) {
+            self->count = header [0];
+            self->size = (size_t) header [1];
+            self->interval = (size_t) header [2];
+            self->index_size = (size_t) header [3];
+            self->index_limit = self->index_size;
+            self->index = (size_t *) malloc (self->index_size * sizeof (size_t) + 1);
+            if (self->index) {
+                size_t index;
+                loaded = true;
+                for (index = 0; index < self->index_size && loaded; index++) {
+                    uint64_t offset;
+                    if (fread (&offset, sizeof (offset), 1, file) == 1)
+                        self->index [index] = (size_t) offset;
+                    else
+                        loaded = false;
+                }
+            }
+        }
+        fclose (file);
+        if (loaded)
+            return 0;
+        self->count = 0;
+        self->size = 0;
+        self->index_size = 0;
+    }
+    //  Otherwise we walk the records, checking each one is complete
+    if (!zsys_file_exists (self->filename))
+        return 0;
+    s_map_t *map = s_segment_map (self);
+    if (!map)
+        return -1;
+    size_t offset = 0;
+    while (offset + RECORD_HEADER <= map->size) {
+        byte *record = map->data + offset;
+        size_t size = ((size_t) record [1] << 24)
+                    + ((size_t) record [2] << 16)
+                    + ((size_t) record [3] << 8)
+                    +  (size_t) record [4];
+        uint32_t crc = ((uint32_t) record [5] << 24)
+                     + ((uint32_t) record [6] << 16)
+                     + ((uint32_t) record [7] << 8)
+                     +  (uint32_t) record [8];
+        if (record [0] != RECORD_MARKER
+        ||  map->size - offset - RECORD_HEADER < size
+        ||  s_crc32 (record + RECORD_HEADER, size) != crc)
+            break;
+        if (self->count % self->interval == 0
+        &&  s_segment_index (self, offset))
+            return -1;
+        offset += RECORD_HEADER + size;
+        self->count++;
+    }
+    self->size = offset;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Save a segment's index next to it, so it can be loaded quickly
+
+static int
+s_segment_save (s_segment_t *self, bool sync)
+{
+    char *index_name = zsys_sprintf ("%.*s.index",
+        (int) (strlen (self->filename) - strlen (".journal")), self->filename);
+    if (!index_name)
+        return -1;
+    FILE *file = fopen (index_name, "wb");
+    zstr_free (&index_name);
+    if (!file)
+        return -1;
+
+    uint64_t header [4] = { self->count, self->size, self->interval, self->index_size };
+    int rc = fwrite (header, sizeof (header), 1, file) == 1? 0: -1;
+    size_t index;
+    for (index = 0; index < self->index_size && rc == 0; index++) {
+        uint64_t offset = self->index [index];
+        if (fwrite (&offset, sizeof (offset), 1, file) != 1)
+            rc = -1;
+    }
+    if (rc == 0 && fflush (file))
+        rc = -1;
+    if (rc == 0 && sync)
+        rc = s_sync (file);
+    fclose (file);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return a mapping that covers the segment's records, or NULL if the file
+//  could not be mapped
+
+static s_map_t *
+s_segment_map (s_segment_t *self)
+{
+    if (self->map && self->map->size >= self->size && self->size > 0)
+        return self->map;
+
+    //  When loading a segment we map the whole file, else just the records
+    size_t size = self->size;
+    if (size == 0) {
+        ssize_t file_size = zsys_file_size (self->filename);
+        if (file_size <= 0)
+            return NULL;
+        size = (size_t) file_size;
+    }
+    s_map_t *map = (s_map_t *) zmalloc (sizeof (s_map_t));
+    if (!map)
+        return NULL;
+#if defined (__UNIX__)
+    //  We map a private copy, so writes to replayed frames don't reach
+    //  the file, nor fault
+    int handle = open (self->filename, O_RDONLY);
+    if (handle >= 0) {
+        map->data = (byte *) mmap (NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE, handle, 0);
+        if (map->data == MAP_FAILED)
+            map->data = NULL;
+        close (handle);
+    }
+#else
+    FILE *file = fopen (self->filename, "rb");
+    if (file) {
+        map->data = (byte *) malloc (size);
+        if (map->data && fread (map->data, 1, size, file) != size) {
+            free (map->data);
+            map->data = NULL;
+        }
+        fclose (file);
+    }
+#endif
+    if (!map->data) {
+        free (map);
+        return NULL;
+    }
+    map->size = size;
+    map->refs = 1;
+    if (self->map)
+        s_map_free (NULL, self->map);
+    self->map = map;
+    return map;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Open the last segment for appending. If its file ends with an incomplete
+//  record, we save the segment as it stands, and start a new one after it.
+
+static int
+s_open_last (zjournal_t *self)
+{
+    s_segment_t *segment = self->segments [self->nbr_segments - 1];
+    ssize_t file_size = zsys_file_size (segment->filename);
+    if (file_size > 0 && (size_t) file_size > segment->size) {
+        if (segment->count == 0) {
+            //  Nothing worth keeping, so start the segment afresh
+            if (segment->map) {
+                s_map_free (NULL, segment->map);
+                segment->map = NULL;
+            }
+            if (zsys_file_delete (segment->filename))
+                return -1;
+        }
+        else
+        if (s_segment_save (segment, self->sync)
+        ||  s_add_segment (self, segment->first + segment->count))
+            return -1;
+        else
+            segment = self->segments [self->nbr_segments - 1];
+    }
+    self->handle = fopen (segment->filename, "ab");
+    if (!self->handle)
+        return -1;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Write out the last segment, and save its index, so we can start a new one
+
+static int
+s_seal_last (zjournal_t *self)
+{
+    s_segment_t *segment = self->segments [self->nbr_segments - 1];
+    int rc = zjournal_flush (self);
+    if (self->handle) {
+        fclose (self->handle);
+        self->handle = NULL;
+    }
+    if (rc == 0)
+        rc = s_segment_save (segment, self->sync);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Reopen the last segment after a failed write, cut back to the records
+//  we have written, so that the batch we still hold replaces whatever part
+//  of it reached the file
+
+static int
+s_reopen_last (zjournal_t *self)
+{
+    s_segment_t *segment = self->segments [self->nbr_segments - 1];
+    size_t written = segment->size - self->batch_size;
+    self->handle = fopen (segment->filename, zsys_file_exists (segment->filename)? "r+b": "wb");
+    if (!self->handle)
+        return -1;
+#if defined (__WINDOWS__)
+    int rc = _chsize (_fileno (self->handle), (long) written);
+#else
+    int rc = ftruncate (fileno (self->handle), (off_t) written);
+#endif
+    if (rc == 0)
+        rc = fseek (self->handle, (long) written, SEEK_SET);
+    if (rc) {
+        fclose (self->handle);
+        self->handle = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Add a segment at the end of the journal
+
+static int
+s_add_segment (zjournal_t *self, uint64_t first)
+{
+    if (self->nbr_segments == self->max_segments) {
+        size_t limit = self->max_segments? self->max_segments * 2: 8;
+        s_segment_t **segments = (s_segment_t **) realloc (
+            self->segments, limit * sizeof (s_segment_t *));
+        if (!segments)
+            return -1;
+        self->segments = segments;
+        self->max_segments = limit;
+    }
+    s_segment_t *segment = s_segment_new (self, first);
+    if (!segment)
+        return -1;
+    self->segments [self->nbr_segments++] = segment;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Flush a file to stable storage
+
+static int
+s_sync (FILE *handle)
+{
+#if defined (__WINDOWS__)
+    return _commit (_fileno (handle));
+#elif defined (__linux__)
+    return fdatasync (fileno (handle));
+#else
+    return fsync (fileno (handle));
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the CRC-32 of a block of data, as used by zip and Ethernet. We
+//  work a nibble at a time, which needs only a small table.
+
+static uint32_t
+s_crc32 (const byte *data, size_t size)
+{
+    static const uint32_t table [16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    uint32_t crc = 0xFFFFFFFF;
+    while (size--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table [crc & 15];
+        crc = (crc >> 4) ^ table [crc & 15];
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Drop one reference to a mapping, and unmap it after the last one
+
+static void
+s_map_free (void *data, void *hint)
+{
+    s_map_t *map = (s_map_t *) hint;
+    if (s_map_release (&map->refs) == 0) {
+#if defined (__UNIX__)
+        munmap (map->data, map->size);
+#else
+        free (map->data);
+#endif
+        free (map);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+zjournal_test (bool verbose)
+{
+    printf (" * zjournal: ");
+
+    //  @selftest
+    const char *path = "zjournal.test";
+    zdir_t *dir = zdir_new (path, NULL);
+    if (dir) {
+        zdir_remove (dir, true);
+        zdir_destroy (&dir);
+    }
+    zjournal_t *journal = zjournal_new (path);
+    assert (journal);
+    assert (zjournal_size (journal) == 0);
+    assert (zjournal_next (journal) == NULL);
+    assert (zjournal_read (journal, 0) == NULL);
+
+    //  Append enough messages to fill several small segments
+    zjournal_set_segment_size (journal, 4096);
+    zjournal_set_batch_size (journal, 1024);
+    zjournal_set_index_interval (journal, 8);
+    zjournal_set_sync (journal, true);
+    byte *blank = (byte *) zmalloc (300);
+    assert (blank);
+    uint64_t sequence;
+    for (sequence = 0; sequence < 500; sequence++) {
+        zmsg_t *msg = zmsg_new ();
+        assert (msg);
+        zmsg_addstrf (msg, "%" PRIu64, sequence);
+        zmsg_addmem (msg, blank, (size_t) (sequence % 300));
+        int rc = zjournal_append (journal, msg);
+        assert (rc == 0);
+        zmsg_destroy (&msg);
+    }
+    assert (zjournal_size (journal) == 500);
+
+    //  Replay in order, including messages not yet written
+    for (sequence = 0; sequence < 500; sequence++) {
+        zmsg_t *msg = zjournal_next (journal);
+        assert (msg);
+        char *string = zmsg_popstr (msg);
+        assert (atoi (string) == (int) sequence);
+        zstr_free (&string);
+        zframe_t *frame = zmsg_first (msg);
+        assert (frame);
+        assert (zframe_size (frame) == sequence % 300);
+        zmsg_destroy (&msg);
+    }
+    assert (zjournal_next (journal) == NULL);
+
+    //  Replayed frames outlive the journal
+    zmsg_t *kept = zjournal_read (journal, 299);
+    assert (kept);
+    zjournal_destroy (&journal);
+
+    //  Reopen, and read at random
+    journal = zjournal_new (path);
+    assert (journal);
+    assert (zjournal_size (journal) == 500);
+    for (sequence = 0; sequence < 500; sequence += 37) {
+        zmsg_t *msg = zjournal_read (journal, sequence);
+        assert (msg);
+        char *string = zmsg_popstr (msg);
+        assert (atoi (string) == (int) sequence);
+        zstr_free (&string);
+        zmsg_destroy (&msg);
+    }
+    assert (zjournal_read (journal, 500) == NULL);
+    assert (zframe_size (zmsg_last (kept)) == 299);
+    zmsg_destroy (&kept);
+
+    //  Append after reopening, then replay the tail
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "last");
+    int rc = zjournal_append (journal, msg);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    rc = zjournal_seek (journal, 499);
+    assert (rc == 0);
+    msg = zjournal_next (journal);
+    assert (msg);
+    zmsg_destroy (&msg);
+    msg = zjournal_next (journal);
+    assert (msg);
+    assert (zframe_streq (zmsg_first (msg), "last"));
+    zmsg_destroy (&msg);
+    zjournal_destroy (&journal);
+
+    //  A partly written message is ignored when the journal is reopened,
+    //  as is a message whose CRC does not match
+    assert (s_crc32 ((byte *) "123456789", 9) == 0xCBF43926);
+    dir = zdir_new (path, NULL);
+    assert (dir);
+    zfile_t **files = zdir_flatten (dir);
+    size_t index;
+    for (index = 0; files [index + 1]; index++) ;
+    FILE *file = fopen (zfile_filename (files [index], NULL), "ab");
+    assert (file);
+    fwrite ("\xD1\x00\x00\x00\x05" "\x00\x00\x00\x00" "\x04torn", 14, 1, file);
+    fwrite ("\xD1\x00\x00\x10\x00" "torn", 9, 1, file);
+    fclose (file);
+    zdir_flatten_free (&files);
+    zdir_destroy (&dir);
+    journal = zjournal_new (path);
+    assert (journal);
+    assert (zjournal_size (journal) == 501);
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "after");
+    rc = zjournal_append (journal, msg);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    zjournal_destroy (&journal);
+    journal = zjournal_new (path);
+    assert (journal);
+    assert (zjournal_size (journal) == 502);
+    msg = zjournal_read (journal, 501);
+    assert (msg);
+    assert (zframe_streq (zmsg_first (msg), "after"));
+    zmsg_destroy (&msg);
+    msg = zjournal_read (journal, 500);
+    assert (msg);
+    assert (zframe_streq (zmsg_first (msg), "last"));
+    zmsg_destroy (&msg);
+
+#if defined (__linux__)
+    //  After a failed write, the journal keeps the messages it accepted,
+    //  and the message that triggered the write fails
+    zjournal_set_batch_size (journal, 100);
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "kept");
+    rc = zjournal_append (journal, msg);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    fclose (journal->handle);
+    journal->handle = fopen ("/dev/full", "wb");
+    assert (journal->handle);
+    msg = zmsg_new ();
+    zmsg_addmem (msg, blank, 100);
+    rc = zjournal_append (journal, msg);
+    assert (rc == -1);
+    zmsg_destroy (&msg);
+    assert (zjournal_size (journal) == 503);
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "next");
+    rc = zjournal_append (journal, msg);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    zjournal_destroy (&journal);
+    journal = zjournal_new (path);
+    assert (journal);
+    assert (zjournal_size (journal) == 504);
+    msg = zjournal_read (journal, 502);
+    assert (msg);
+    assert (zframe_streq (zmsg_first (msg), "kept"));
+    zmsg_destroy (&msg);
+    msg = zjournal_next (journal);
+    assert (msg);
+    assert (zframe_streq (zmsg_first (msg), "next"));
+    zmsg_destroy (&msg);
+#endif
+    zjournal_destroy (&journal);
+
+    free (blank);
+    dir = zdir_new (path, NULL);
+    assert (dir);
+    zdir_remove (dir, true);
+    zdir_destroy (&dir);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -23,60 +23,197 @@
 
 #include "../include/czmq.h"
 
+//  The epoll backend needs ZMQ_FD and an int ZMQ_EVENTS
+#if defined (__UTYPE_LINUX) && (ZMQ_VERSION_MAJOR >= 3)
+#   define ZLOOP_EPOLL
+#endif
+
 typedef struct _s_reader_t s_reader_t;
 typedef struct _s_poller_t s_poller_t;
 typedef struct _s_timer_t s_timer_t;
 typedef struct _s_ticket_t s_ticket_t;
+typedef struct _s_link_t s_link_t;
+typedef struct _s_slot_t s_slot_t;
+typedef struct _s_watch_t s_watch_t;
+typedef struct _s_ready_t s_ready_t;
+typedef struct _s_stats_t s_stats_t;
+typedef struct _s_post_t s_post_t;
+
+//  Handler times go into buckets by powers of two: bucket N counts calls
+//  that took less than 2^N usecs, and the last bucket counts longer calls
+#define STATS_BUCKETS 24
+
+//  Readers and pollers have a priority from 0 (the default) to this limit
+//  less one, and higher priorities are serviced first in each pass
+#define PRIORITY_LEVELS 8
+
+//  Statistics for one handler, or for timer lag
+
+struct _s_stats_t {
+    size_t calls;               //  Number of calls
+    int64_t total;              //  Total time, usecs
+    int64_t max;                //  Longest time, usecs
+    size_t buckets [STATS_BUCKETS];
+};
 
 //  Structure of our class
 
 struct _zloop_t {
     zlistx_t *readers;          //  List of socket readers
     zlistx_t *pollers;          //  List of poll items
-    zlistx_t *timers;           //  List of timers
-    zlistx_t *tickets;          //  List of tickets
+    s_timer_t **timers;         //  Timers, as binary heap on expiry time
+    size_t timers_size;         //  Number of timers in heap
+    size_t timers_limit;        //  Allocated size of heap
+    s_timer_t **expired;        //  Timers expired in current pass
+    size_t expired_limit;       //  Allocated size of expired array
+    zhashx_t *timer_ids;        //  Timers, indexed by timer id
+    s_slot_t *wheel;            //  Tickets, as timing wheel on expiry time
+    int64_t wheel_time;         //  Last msec the wheel has handled
+    int64_t ticket_next;        //  No ticket expires before this msec
+    s_ticket_t *ticket_firing;  //  Ticket whose handler is running
     int last_timer_id;          //  Most recent timer id
     size_t max_timers;          //  Limit on number of timers
+    int64_t max_slack;          //  Largest slack of any timer, usecs
+    size_t max_slack_timers;    //  Number of timers with that slack
+    int timer_fd;               //  Precise wakeup for timers, or -1
+    s_poller_t *timer_poller;   //  Poller for precise wakeup
+    int64_t timer_armed;        //  Time the precise wakeup is set for
     size_t ticket_delay;        //  Ticket delay value
     size_t poll_size;           //  Size of poll set
+    size_t poll_limit;          //  Allocated size of poll set
+    size_t priorities [PRIORITY_LEVELS];
+                                //  Number of poll set items per priority
     zmq_pollitem_t *pollset;    //  zmq_poll set
-    s_reader_t *readact;        //  Readers for this poll set
-    s_poller_t *pollact;        //  Pollers for this poll set
-    bool need_rebuild;          //  True if pollset needs rebuilding
+    s_reader_t **readact;       //  Readers for this poll set
+    s_poller_t **pollact;       //  Pollers for this poll set
+    int epoll_handle;           //  epoll descriptor, or -1 for zmq_poll
+    zhashx_t *watches;          //  Readers and pollers, by epoll key
+    size_t last_watch_key;      //  Most recent epoll key
+    s_ready_t *ready;           //  Items to service in this pass
+    size_t ready_size;          //  Number of items ready
+    s_ready_t *pending;         //  Sockets still ready after service
+    size_t pending_size;        //  Number of sockets pending
+    size_t ready_limit;         //  Allocated size of ready and pending
+    size_t last_wait;           //  Number of epoll waits so far
+    void *dispatching;          //  Reader or poller whose handler is running
+    bool stats;                 //  True if we keep handler statistics
+    int64_t watchdog;           //  Report handlers slower than this, usecs
+    s_stats_t lag;              //  How late timers fire
+    s_stats_t timers_ended;     //  Handlers of timers that have ended
+    int64_t overload;           //  Lag that means overload, usecs
+    int64_t woke;               //  Clock time (usecs) this pass woke up
+    int64_t pass_lag;           //  Worst lag in this pass, usecs
+    int shed_priority;          //  Skip readers below this when overloaded
+    int64_t shed_until;         //  Clock time (usecs) overload ends
+    bool shedding;              //  True while skipping low-priority readers
+    s_post_t *volatile posted;  //  Posted callbacks, newest first
+    s_post_t *post_head;        //  Callbacks to run, oldest first
+    s_post_t *post_tail;        //  Last callback to run
+    int post_fd [2];            //  Wakeup signal, read and write ends
+    s_poller_t *post_poller;    //  Poller for wakeup signal
     bool verbose;               //  True if verbose tracing wanted
     bool terminated;            //  True when stopped running
     bool ignore_interrupts;     //  True when this loop should ingnore intterupts
-    zlistx_t *zombies;          //  List of timers to kill
+};
+
+//  When we use epoll, each reader and poller has its own registration,
+//  which we call a watch. Epoll tells us the watch key, which we look up
+//  to find the reader or poller. Keys are never reused, so an event for a
+//  reader or poller that was cancelled in the meantime finds nothing.
+
+struct _s_watch_t {
+    size_t key;                 //  Unique key, low bit set for pollers
+    int fd;                     //  File descriptor registered with epoll
+    bool dup;                   //  True if we duplicated the descriptor
+    size_t wait;                //  Last wait that found this item ready
+};
+
+struct _s_ready_t {
+    size_t key;                 //  Watch key, or slot with zmq_poll
+    int events;                 //  ZMQ_POLLIN, ZMQ_POLLOUT, ZMQ_POLLERR
+    int priority;               //  Priority of ready item
 };
 
 //  Reactor elements are held as structures of their own
 
 struct _s_reader_t {
     void *list_handle;          //  Handle into list
+    size_t poll_index;          //  Position in poll set
+    s_watch_t watch;            //  Registration with epoll
     zsock_t *sock;              //  Socket to read from
+    int events;                 //  Events to poll socket for
     zloop_reader_fn *handler;   //  Function to execute
     void *arg;                  //  Application argument to poll item
     int errors;                 //  If too many errors, kill reader
     bool tolerant;              //  Unless configured as tolerant
+    int priority;               //  Higher priorities are serviced first
+    size_t batch_calls;         //  Most handler calls per pass
+    int64_t batch_msecs;        //  Most time per pass, or 0
+    s_stats_t stats;            //  Handler statistics
 };
 
 struct _s_poller_t {
     void *list_handle;          //  Handle into list
+    size_t poll_index;          //  Position in poll set
+    s_watch_t watch;            //  Registration with epoll
     zmq_pollitem_t item;        //  ZeroMQ socket or file descriptor
     zloop_fn *handler;          //  Function to execute
     void *arg;                  //  Application argument to poll item
     int errors;                 //  If too many errors, kill poller
     bool tolerant;              //  Unless configured as tolerant
+    int priority;               //  Higher priorities are serviced first
+    s_stats_t stats;            //  Handler statistics
 };
 
 struct _s_timer_t {
-    void *list_handle;          //  Handle into list
+    size_t heap_index;          //  Position in timer heap
     int timer_id;               //  Unique timer id, used to cancel timer
     zloop_timer_fn *handler;    //  Function to execute
-    size_t delay;               //  Delay (ms) between executing
+    int64_t delay;              //  Delay (usecs) between executing
     size_t times;               //  Number of times to repeat, 0 for forever
     void *arg;                  //  Application argument to timer
-    int64_t when;               //  Clock time when alarm goes off
+    int64_t when;               //  Clock time (usecs) when alarm goes off
+    int64_t slack;              //  How late (usecs) alarm may go off
+    bool expired;               //  Off heap while expired timers fire
+    bool cancelled;             //  Destroy after handler returns
+    s_stats_t *stats;           //  Handler statistics, if any
+};
+
+//  Other threads post callbacks by pushing them onto a lock-free stack,
+//  which the reactor takes as a whole. Only the reactor removes posts, so
+//  a compare-and-swap is safe without further care.
+
+struct _s_post_t {
+    s_post_t *next;             //  Next post in stack or queue
+    zloop_post_fn *handler;     //  Function to execute
+    void *arg;                  //  Application argument to callback
+};
+
+#if defined (__WINDOWS__)
+#   define s_post_swap(ptr,old,new) \
+        (InterlockedCompareExchangePointer ((PVOID volatile *) (ptr), (new), (old)) == (old))
+#else
+#   define s_post_swap(ptr,old,new) \
+        __sync_bool_compare_and_swap ((ptr), (old), (new))
+#endif
+
+//  Tickets are held in a hashed timing wheel: a ring of slots, one per
+//  msec, where each ticket sits in the slot for its expiry time, so adding,
+//  resetting, and deleting a ticket costs O(1) whatever its delay. Each
+//  pass, we visit the slots for the msecs that have gone by, and fire the
+//  tickets that are due. Tickets due on a later turn of the wheel stay in
+//  their slot. Each slot knows how soon its first ticket may expire, so we
+//  can tell when to wake up without looking at every ticket.
+#define WHEEL_SLOTS 4096
+
+struct _s_link_t {
+    s_link_t *prev;             //  Previous in circular list
+    s_link_t *next;             //  Next in circular list
+};
+
+struct _s_slot_t {
+    s_link_t tickets;           //  Tickets in slot, as circular list
+    int64_t next;               //  No ticket expires before this msec
 };
 
 //  As we pass void * to/from the caller for working with tickets, we
@@ -84,13 +221,12 @@ struct _s_timer_t {
 #define TICKET_TAG              0x0007cafe
 
 struct _s_ticket_t {
+    s_link_t link;              //  Position in wheel slot, must be first
     uint32_t tag;               //  Object tag for runtime detection
-    void *list_handle;          //  Handle into list
-    size_t delay;               //  Delay (ms) before executing
+    uint32_t delay;             //  Delay (ms) before executing
     int64_t when;               //  Clock time to invoke the ticket
     zloop_timer_fn *handler;    //  Function to execute (use timer fn)
     void *arg;                  //  Application argument to function
-    bool deleted;               //  Flag as deleted (to clean up later)
 };
 
 static int
@@ -105,9 +241,11 @@ s_reader_new (zsock_t *sock, zloop_reader_fn handler, void *arg)
     s_reader_t *self = (s_reader_t *) zmalloc (sizeof (s_reader_t));
     if (self) {
         self->sock = sock;
+        self->events = ZMQ_POLLIN;  //  By default, poll for input
         self->handler = handler;
         self->arg = arg;
         self->tolerant = false;     //  By default, errors are bad
+        self->batch_calls = 1;      //  By default, one call per pass
     }
     return self;
 }
@@ -149,14 +287,14 @@ s_poller_destroy (s_poller_t **self_p)
 
 
 static s_timer_t *
-s_timer_new (int timer_id, size_t delay, size_t times, zloop_timer_fn handler, void *arg)
+s_timer_new (int timer_id, int64_t delay, size_t times, zloop_timer_fn handler, void *arg)
 {
     s_timer_t *self = (s_timer_t *) zmalloc (sizeof (s_timer_t));
     if (self) {
         self->timer_id = timer_id;
         self->delay = delay;
         self->times = times;
-        self->when = zclock_mono () + delay;
+        self->when = zclock_usecs () + delay;
         self->handler = handler;
         self->arg = arg;
     }
@@ -169,21 +307,48 @@ s_timer_destroy (s_timer_t **self_p)
     assert (self_p);
     s_timer_t *self = *self_p;
     if (self) {
+        free (self->stats);
         free (self);
         *self_p = NULL;
     }
 }
 
+//  Timers are ordered by the latest time they may go off, which is their
+//  alarm time plus their slack. Timers that expire at the same time are
+//  ordered by timer id, so they fire in the order they were created.
+
 static int
 s_timer_comparator (s_timer_t *timer1, s_timer_t *timer2)
 {
+    if (timer1->when + timer1->slack > timer2->when + timer2->slack)
+        return 1;
+    else
+    if (timer1->when + timer1->slack < timer2->when + timer2->slack)
+        return -1;
+    else
+    if (timer1->timer_id > timer2->timer_id)
+        return 1;
+    else
+    if (timer1->timer_id < timer2->timer_id)
+        return -1;
+    else
+        return 0;
+}
+
+//  Expired timers fire in order of alarm time, then timer id
+
+static int
+s_timer_compare_when (const void *item1, const void *item2)
+{
+    s_timer_t *timer1 = *(s_timer_t **) item1;
+    s_timer_t *timer2 = *(s_timer_t **) item2;
     if (timer1->when > timer2->when)
         return 1;
     else
     if (timer1->when < timer2->when)
         return -1;
     else
-        return 0;
+        return timer1->timer_id > timer2->timer_id? 1: -1;
 }
 
 static s_ticket_t *
@@ -191,8 +356,9 @@ s_ticket_new (size_t delay, zloop_timer_fn handler, void *arg)
 {
     s_ticket_t *self = (s_ticket_t *) zmalloc (sizeof (s_ticket_t));
     if (self) {
+        self->link.prev = self->link.next = &self->link;
         self->tag = TICKET_TAG;
-        self->delay = delay;
+        self->delay = (uint32_t) delay;
         self->when = zclock_mono () + delay;
         self->handler = handler;
         self->arg = arg;
@@ -212,282 +378,1357 @@ s_ticket_destroy (s_ticket_t **self_p)
     }
 }
 
+//  Add a ticket to the end of a list, or remove it from whatever list it
+//  is in. A ticket that is in no list links to itself.
+
+static void
+s_link_append (s_link_t *list, s_link_t *link)
+{
+    link->prev = list->prev;
+    link->next = list;
+    list->prev->next = link;
+    list->prev = link;
+}
+
+static void
+s_link_remove (s_link_t *link)
+{
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->prev = link->next = link;
+}
+
+//  Put a ticket into the wheel slot for its expiry time. We have already
+//  handled the current msec, so a ticket due by then goes into the next
+//  slot.
+
+static void
+s_wheel_add (zloop_t *self, s_ticket_t *ticket)
+{
+    if (ticket->when <= self->wheel_time)
+        ticket->when = self->wheel_time + 1;
+    s_slot_t *slot = &self->wheel [ticket->when & (WHEEL_SLOTS - 1)];
+    s_link_append (&slot->tickets, &ticket->link);
+    if (slot->next > ticket->when)
+        slot->next = ticket->when;
+    if (self->ticket_next > ticket->when)
+        self->ticket_next = ticket->when;
+}
+
+//  Create the wheel on first use of a ticket. Returns 0 if OK, -1 if there
+//  was not enough memory.
+
 static int
-s_ticket_comparator (s_ticket_t *ticket1, s_ticket_t *ticket2)
+s_wheel_open (zloop_t *self)
 {
-    if (ticket1->when > ticket2->when)
-        return 1;
-    else
-    if (ticket1->when < ticket2->when)
+    self->wheel = (s_slot_t *) malloc (WHEEL_SLOTS * sizeof (s_slot_t));
+    if (!self->wheel)
         return -1;
-    else
-        return 0;
+    size_t slot_nbr;
+    for (slot_nbr = 0; slot_nbr < WHEEL_SLOTS; slot_nbr++) {
+        s_slot_t *slot = &self->wheel [slot_nbr];
+        slot->tickets.prev = slot->tickets.next = &slot->tickets;
+        slot->next = INT64_MAX;
+    }
+    self->wheel_time = zclock_mono ();
+    self->ticket_next = INT64_MAX;
+    return 0;
 }
 
-//  Remove timer with specified id, if it exists
-
 static void
-s_timer_remove (zloop_t *self, int timer_id)
+s_wheel_close (zloop_t *self)
 {
-    s_timer_t *timer = (s_timer_t *) zlistx_first (self->timers);
-    while (timer) {
-        if (timer->timer_id == timer_id) {
-            zlistx_delete (self->timers, timer->list_handle);
-            break;
+    if (self->wheel) {
+        size_t slot_nbr;
+        for (slot_nbr = 0; slot_nbr < WHEEL_SLOTS; slot_nbr++) {
+            s_link_t *tickets = &self->wheel [slot_nbr].tickets;
+            while (tickets->next != tickets) {
+                s_ticket_t *ticket = (s_ticket_t *) tickets->next;
+                s_link_remove (&ticket->link);
+                s_ticket_destroy (&ticket);
+            }
         }
-        timer = (s_timer_t *) zlistx_next (self->timers);
+        free (self->wheel);
+        self->wheel = NULL;
     }
 }
 
+//  When we shed load, note how late a handler is called: how long after
+//  the pass woke up for a reader or poller, or how long after its latest
+//  time for a timer. The worst of these is the reactor's lag for the pass.
+
+static void
+s_lag_note (zloop_t *self, int64_t lag)
+{
+    if (self->pass_lag < lag)
+        self->pass_lag = lag;
+}
 
-//  We hold an array of pollers that matches the pollset, so we can
-//  register/cancel pollers orthogonally to executing the pollset
-//  activity on pollers. Returns 0 on success, -1 on failure.
+//  Fire the tickets that are due, visiting the slot for each msec since we
+//  last looked, and going at most once around the wheel. Handlers may reset
+//  and delete any ticket, so we take each slot's tickets aside while we go
+//  through them. A ticket that fires is destroyed, unless its handler reset
+//  it. If a handler signals break, it keeps its ticket, and we put back the
+//  other due tickets without calling them; they fire on the next pass.
+//  Returns 0, or -1 if a handler signaled break.
 
 static int
-s_rebuild_pollset (zloop_t *self)
+s_wheel_expire (zloop_t *self, int64_t time_now)
 {
-    free (self->pollset);
-    free (self->readact);
-    free (self->pollact);
-    self->pollset = NULL;
-    self->readact = NULL;
-    self->pollact = NULL;
+    int64_t time = self->wheel_time + 1;
+    if (time_now - self->wheel_time > WHEEL_SLOTS)
+        time = time_now - WHEEL_SLOTS + 1;
+    self->wheel_time = time_now;
+    if (time_now < self->ticket_next)
+        return 0;               //  Nothing is due yet
 
-    self->poll_size = zlistx_size (self->readers) + zlistx_size (self->pollers);
-    self->pollset = (zmq_pollitem_t *) zmalloc (self->poll_size * sizeof (zmq_pollitem_t));
-    if (!self->pollset)
-        return -1;
+    int rc = 0;
+    for (; time <= time_now; time++) {
+        s_slot_t *slot = &self->wheel [time & (WHEEL_SLOTS - 1)];
+        if (slot->next > time_now)
+            continue;
+        slot->next = INT64_MAX;
+        if (slot->tickets.next == &slot->tickets)
+            continue;           //  Due tickets were deleted
+
+        s_link_t due;
+        due.next = slot->tickets.next;
+        due.prev = slot->tickets.prev;
+        due.next->prev = due.prev->next = &due;
+        slot->tickets.prev = slot->tickets.next = &slot->tickets;
+        while (due.next != &due) {
+            s_ticket_t *ticket = (s_ticket_t *) due.next;
+            s_link_remove (&ticket->link);
+            if (ticket->when > time_now || rc == -1) {
+                s_wheel_add (self, ticket);
+                continue;
+            }
+            if (self->verbose)
+                zsys_debug ("zloop: call ticket handler");
+            self->ticket_firing = ticket;
+            if (self->overload)
+                s_lag_note (self, zclock_usecs () - ticket->when * 1000);
+            rc = ticket->handler (self, 0, ticket->arg);
+            if (self->ticket_firing == ticket) {
+                self->ticket_firing = NULL;
+                if (ticket->link.next != &ticket->link)
+                    continue;   //  Handler reset the ticket
+                if (rc == -1) {
+                    s_wheel_add (self, ticket);
+                    continue;
+                }
+            }
+            //  Else the ticket fired, or the handler deleted it
+            s_ticket_destroy (&ticket);
+        }
+    }
+    //  Find the next ticket that may expire, looking forward from now. No
+    //  ticket in a slot is due before that slot's msec, so we can stop at
+    //  the first slot whose msec is not before the soonest time we found.
+    self->ticket_next = INT64_MAX;
+    for (time = time_now + 1; time <= time_now + WHEEL_SLOTS
+                           && time < self->ticket_next; time++) {
+        s_slot_t *slot = &self->wheel [time & (WHEEL_SLOTS - 1)];
+        if (self->ticket_next > slot->next)
+            self->ticket_next = slot->next;
+    }
+    return rc;
+}
 
-    self->readact = (s_reader_t *) zmalloc (self->poll_size * sizeof (s_reader_t));
-    if (!self->readact)
-        return -1;
+//  Timers are held in a binary min-heap, so the next timer that must go
+//  off is always at the top of the heap. Adding, rescheduling and removing
+//  timers costs O(log n). Each timer knows its own position in the heap.
 
-    self->pollact = (s_poller_t *) zmalloc (self->poll_size * sizeof (s_poller_t));
-    if (!self->pollact)
-        return -1;
+static void
+s_timer_heap_place (zloop_t *self, s_timer_t *timer, size_t index)
+{
+    self->timers [index] = timer;
+    timer->heap_index = index;
+}
 
-    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
-    uint item_nbr = 0;
-    while (reader) {
-        zmq_pollitem_t poll_item = { zsock_resolve (reader->sock), 0, ZMQ_POLLIN };
-        self->pollset [item_nbr] = poll_item;
-        self->readact [item_nbr] = *reader;
-        item_nbr++;
-        reader = (s_reader_t *) zlistx_next (self->readers);
-    }
-    s_poller_t *poller = (s_poller_t *) zlistx_first (self->pollers);
-    while (poller) {
-        self->pollset [item_nbr] = poller->item;
-        self->pollact [item_nbr] = *poller;
-        item_nbr++;
-        poller = (s_poller_t *) zlistx_next (self->pollers);
+static void
+s_timer_heap_sift_up (zloop_t *self, size_t index)
+{
+    s_timer_t *timer = self->timers [index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (s_timer_comparator (self->timers [parent], timer) <= 0)
+            break;
+        s_timer_heap_place (self, self->timers [parent], index);
+        index = parent;
     }
-    self->need_rebuild = false;
-    return 0;
+    s_timer_heap_place (self, timer, index);
 }
 
-static long
-s_tickless (zloop_t *self)
+static void
+s_timer_heap_sift_down (zloop_t *self, size_t index)
 {
-    //  Calculate tickless timer, up to 1 hour
-    int64_t tickless = zclock_mono () + 1000 * 3600;
-    
-    //  Scan timers, which are not sorted
-    //  TODO: sort timers properly on insertion
-    s_timer_t *timer = (s_timer_t *) zlistx_first (self->timers);
-    while (timer) {
-        //  Find earliest timer
-        if (tickless > timer->when)
-            tickless = timer->when;
-        timer = (s_timer_t *) zlistx_next (self->timers);
-    }
-    //  Tickets are sorted, so check first ticket
-    s_ticket_t *ticket = (s_ticket_t *) zlistx_first (self->tickets);
-    if (ticket && tickless > ticket->when)
-        tickless = ticket->when;
-
-    long timeout = (long) (tickless - zclock_mono ());
-    if (timeout < 0)
-        timeout = 0;
-    if (self->verbose)
-        zsys_debug ("zloop polling for %d msec", (int) timeout);
-    
-    return timeout * ZMQ_POLL_MSEC;
+    s_timer_t *timer = self->timers [index];
+    while (true) {
+        size_t child = 2 * index + 1;
+        if (child >= self->timers_size)
+            break;
+        if (child + 1 < self->timers_size
+        &&  s_timer_comparator (self->timers [child + 1], self->timers [child]) < 0)
+            child++;
+        if (s_timer_comparator (timer, self->timers [child]) <= 0)
+            break;
+        s_timer_heap_place (self, self->timers [child], index);
+        index = child;
+    }
+    s_timer_heap_place (self, timer, index);
 }
 
+//  Add timer to heap, growing heap if needed. Returns 0 if OK, -1 if
+//  there was not enough memory.
 
-//  --------------------------------------------------------------------------
-//  Constructor
+static int
+s_timer_heap_add (zloop_t *self, s_timer_t *timer)
+{
+    if (self->timers_size == self->timers_limit) {
+        size_t limit = self->timers_limit? self->timers_limit * 2: 16;
+        s_timer_t **timers = (s_timer_t **) realloc (
+            self->timers, limit * sizeof (s_timer_t *));
+        if (!timers)
+            return -1;
+        self->timers = timers;
+        self->timers_limit = limit;
+    }
+    s_timer_heap_place (self, timer, self->timers_size++);
+    s_timer_heap_sift_up (self, timer->heap_index);
+    return 0;
+}
 
-zloop_t *
-zloop_new (void)
+//  Take timer off heap, without destroying it
+
+static void
+s_timer_heap_detach (zloop_t *self, s_timer_t *timer)
 {
-    zloop_t
-    *self;
+    size_t index = timer->heap_index;
+    assert (index < self->timers_size && self->timers [index] == timer);
+    s_timer_t *last = self->timers [--self->timers_size];
+    if (last != timer) {
+        //  Last timer may have to move up or down from its new place
+        s_timer_heap_place (self, last, index);
+        s_timer_heap_sift_up (self, index);
+        s_timer_heap_sift_down (self, last->heap_index);
+    }
+}
 
-    self = (zloop_t *) zmalloc (sizeof (zloop_t));
-    if (!self)
-        return NULL;
+//  Track the largest slack of any timer, as a timer gets or loses some
+//  slack. When the last timer with the largest slack loses it, we find
+//  the new largest slack before the next collection.
 
-    self->readers = zlistx_new ();
-    if (self->readers)
-        self->pollers = zlistx_new ();
-    if (self->pollers)
-        self->timers = zlistx_new ();
-    if (self->timers)
-        self->zombies = zlistx_new ();
-    if (self->zombies)
-        self->tickets = zlistx_new ();
-    if (self->tickets) {
-        self->last_timer_id = 0;
-        zlistx_set_destructor (self->readers, (czmq_destructor *) s_reader_destroy);
-        zlistx_set_destructor (self->pollers, (czmq_destructor *) s_poller_destroy);
-        zlistx_set_destructor (self->timers, (czmq_destructor *) s_timer_destroy);
-        zlistx_set_comparator (self->timers, (czmq_comparator *) s_timer_comparator);
-        zlistx_set_destructor (self->tickets, (czmq_destructor *) s_ticket_destroy);
-        zlistx_set_comparator (self->tickets, (czmq_comparator *) s_ticket_comparator);
+static void
+s_slack_add (zloop_t *self, int64_t slack)
+{
+    if (slack > self->max_slack) {
+        self->max_slack = slack;
+        self->max_slack_timers = 1;
     }
     else
-        zloop_destroy (&self);
-    return self;
+    if (slack && slack == self->max_slack)
+        self->max_slack_timers++;
 }
 
+static void
+s_slack_remove (zloop_t *self, int64_t slack)
+{
+    if (slack && slack == self->max_slack)
+        self->max_slack_timers--;
+}
 
-//  --------------------------------------------------------------------------
-//  Destructor
-
-void
-zloop_destroy (zloop_t **self_p)
+static void
+s_slack_refresh (zloop_t *self)
 {
-    assert (self_p);
-    if (*self_p) {
-        zloop_t *self = *self_p;
+    if (self->max_slack_timers || !self->max_slack)
+        return;
+    self->max_slack = 0;
+    size_t index;
+    for (index = 0; index < self->timers_size; index++)
+        s_slack_add (self, self->timers [index]->slack);
+}
 
-        //  If we never started the loop, yet manipulated timers, we'll have
-        //  a zombie list
-        while (zlistx_first (self->zombies)) {
-            //  Get timer_id back from pointer
-            ptrdiff_t timer_id = (byte *) zlistx_detach (self->zombies, NULL) - (byte *) NULL;
-            s_timer_remove (self, (int) timer_id);
-        }
-        zlistx_destroy (&self->zombies);
-        zlistx_destroy (&self->readers);
-        zlistx_destroy (&self->pollers);
-        zlistx_destroy (&self->timers);
-        zlistx_destroy (&self->tickets);
-        free (self->pollset);
-        free (self->readact);
-        free (self->pollact);
-        free (self);
-        *self_p = NULL;
-    }
+//  Collect timers whose alarm time has passed, starting at a position in
+//  the heap. These include timers that could still wait, thanks to their
+//  slack, so they share the wakeup. No timer whose latest time is beyond
+//  now plus the largest slack of any timer can be due, so we stop at such
+//  timers, as all timers below them in the heap are later still.
+
+static void
+s_timer_heap_collect (zloop_t *self, size_t index, int64_t time_now, size_t *expired_size)
+{
+    if (index >= self->timers_size)
+        return;
+    s_timer_t *timer = self->timers [index];
+    if (timer->when + timer->slack > time_now + self->max_slack)
+        return;
+    if (timer->when <= time_now)
+        self->expired [(*expired_size)++] = timer;
+    s_timer_heap_collect (self, 2 * index + 1, time_now, expired_size);
+    s_timer_heap_collect (self, 2 * index + 2, time_now, expired_size);
 }
 
+//  Timers are also indexed by timer id, so we can cancel a timer without
+//  searching for it. We store the integer timer id as the key pointer. We
+//  index epoll watches the same way.
 
-//  --------------------------------------------------------------------------
-//  Register socket reader with the reactor. When the reader has messages,
-//  the reactor will call the handler, passing the arg. Returns 0 if OK, -1
-//  if there was an error. If you register the same socket more than once,
-//  each instance will invoke its corresponding handler.
+static size_t
+s_id_hash (const void *key)
+{
+    return (size_t) ((byte *) key - (byte *) NULL);
+}
 
-int
-zloop_reader (zloop_t *self, zsock_t *sock, zloop_reader_fn handler, void *arg)
+static int
+s_id_compare (const void *key1, const void *key2)
 {
-    assert (self);
-    assert (sock);
+    return key1 == key2? 0: 1;
+}
 
-    s_reader_t *reader = s_reader_new (sock, handler, arg);
-    if (reader) {
-        reader->list_handle = zlistx_add_end (self->readers, reader);
-        if (!reader->list_handle) {
-            s_reader_destroy (&reader);
-            return -1;
-        }
-        self->need_rebuild = true;
-        if (self->verbose)
-            zsys_debug ("zloop: register %s reader", zsock_type_str (sock));
-        return 0;
+//  Destroy a timer that has ended or been cancelled, keeping its handler
+//  statistics in the reactor's total for ended timers
+
+static void
+s_timer_retire (zloop_t *self, s_timer_t **timer_p)
+{
+    s_slack_remove (self, (*timer_p)->slack);
+    s_stats_t *stats = (*timer_p)->stats;
+    if (stats) {
+        s_stats_t *ended = &self->timers_ended;
+        ended->calls += stats->calls;
+        ended->total += stats->total;
+        if (ended->max < stats->max)
+            ended->max = stats->max;
+        size_t bucket;
+        for (bucket = 0; bucket < STATS_BUCKETS; bucket++)
+            ended->buckets [bucket] += stats->buckets [bucket];
     }
-    else
-        return -1;
+    s_timer_destroy (timer_p);
 }
 
+//  Remove timer with specified id, if it exists. If the timer is expired
+//  and waiting for its handler to run or return, we only flag it, and the
+//  reactor destroys it afterwards.
 
-//  --------------------------------------------------------------------------
-//  Cancel a socket reader from the reactor. If multiple readers exist for
-//  same socket, cancels ALL of them.
-
-void
-zloop_reader_end (zloop_t *self, zsock_t *sock)
+static void
+s_timer_remove (zloop_t *self, int timer_id)
 {
-    assert (self);
-    assert (sock);
-
-    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
-    while (reader) {
-        if (reader->sock == sock) {
-            zlistx_delete (self->readers, reader->list_handle);
-            self->need_rebuild = true;
+    s_timer_t *timer = (s_timer_t *) zhashx_lookup (
+        self->timer_ids, (byte *) NULL + timer_id);
+    if (timer) {
+        zhashx_delete (self->timer_ids, (byte *) NULL + timer_id);
+        if (timer->expired)
+            timer->cancelled = true;
+        else {
+            s_timer_heap_detach (self, timer);
+            s_timer_retire (self, &timer);
         }
-        reader = (s_reader_t *) zlistx_next (self->readers);
     }
-    if (self->verbose)
-        zsys_debug ("zloop: cancel %s reader", zsock_type_str (sock));
 }
 
 
-//  --------------------------------------------------------------------------
-//  Configure a registered reader to ignore errors. If you do not set this,
-//  then reader that have errors are removed from the reactor silently.
+//  Record one handler call, or one timer's lag, in a set of statistics
 
-void
-zloop_reader_set_tolerant (zloop_t *self, zsock_t *sock)
+static void
+s_stats_record (s_stats_t *stats, int64_t usecs)
 {
-    assert (self);
-    assert (sock);
+    stats->calls++;
+    stats->total += usecs;
+    if (stats->max < usecs)
+        stats->max = usecs;
+    size_t bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && usecs >= ((int64_t) 1 << bucket))
+        bucket++;
+    stats->buckets [bucket]++;
+}
 
-    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
-    while (reader) {
-        if (reader->sock == sock)
-            reader->tolerant = true;
-        reader = (s_reader_t *) zlistx_next (self->readers);
-    }
+//  Add a set of statistics to a message, as six frames: kind, name, calls,
+//  total usecs, longest usecs, and the bucket counts separated by spaces
+
+static void
+s_stats_add (zmsg_t *msg, s_stats_t *stats, const char *kind, const char *name)
+{
+    char buckets [STATS_BUCKETS * 21];
+    size_t length = 0;
+    size_t bucket;
+    for (bucket = 0; bucket < STATS_BUCKETS; bucket++)
+        length += snprintf (buckets + length, sizeof (buckets) - length,
+                            bucket? " %" PRIu64: "%" PRIu64,
+                            (uint64_t) stats->buckets [bucket]);
+    zmsg_addstr (msg, kind);
+    zmsg_addstr (msg, name);
+    zmsg_addstrf (msg, "%" PRIu64, (uint64_t) stats->calls);
+    zmsg_addstrf (msg, "%" PRId64, stats->total);
+    zmsg_addstrf (msg, "%" PRId64, stats->max);
+    zmsg_addstr (msg, buckets);
 }
 
+//  Returns time a handler took since it started, in usecs, and records it
+//  if we're keeping statistics and the handler's owner still exists
 
-//  --------------------------------------------------------------------------
-//  Register low-level libzmq pollitem with the reactor. When the pollitem
-//  is ready, will call the handler, passing the arg. Returns 0 if OK, -1
-//  if there was an error. If you register the pollitem more than once, each
-//  instance will invoke its corresponding handler. A pollitem with
-//  socket=NULL and fd=0 means 'poll on FD zero'.
+static int64_t
+s_handler_done (zloop_t *self, s_stats_t *stats, int64_t started)
+{
+    int64_t usecs = zclock_usecs () - started;
+    if (self->stats && stats)
+        s_stats_record (stats, usecs);
+    return usecs;
+}
 
-int
-zloop_poller (zloop_t *self, zmq_pollitem_t *item, zloop_fn handler, void *arg)
+//  Returns the epoll watch of the reader or poller in a pollset slot
+
+static s_watch_t *
+s_pollset_watch (zloop_t *self, size_t poll_index)
 {
-    assert (self);
+    if (self->readact [poll_index])
+        return &self->readact [poll_index]->watch;
+    else
+        return &self->pollact [poll_index]->watch;
+}
 
-    if (item->socket
-    &&  streq (zsys_sockname (zsock_type (item->socket)), "UNKNOWN"))
-        return -1;
+//  Returns the priority of the reader or poller in a pollset slot
 
-    s_poller_t *poller = s_poller_new (item, handler, arg);
-    if (poller) {
-        poller->list_handle = zlistx_add_end (self->pollers, poller);
-        if (!poller->list_handle) {
-            s_poller_destroy (&poller);
-            return -1;
-        }
-        self->need_rebuild = true;
-        if (self->verbose)
-            zsys_debug ("zloop: register %s poller (%p, %d)",
-                        item->socket? zsys_sockname (zsock_type (item->socket)): "FD",
-                        item->socket, item->fd);
-        return 0;
-    }
+static int
+s_pollset_priority (zloop_t *self, size_t poll_index)
+{
+    if (self->readact [poll_index])
+        return self->readact [poll_index]->priority;
     else
-        return -1;
+        return self->pollact [poll_index]->priority;
+}
+
+//  Returns the number of priorities that readers and pollers are using
+
+static size_t
+s_priority_levels (zloop_t *self)
+{
+    size_t levels = 0;
+    int priority;
+    for (priority = 0; priority < PRIORITY_LEVELS; priority++)
+        if (self->priorities [priority])
+            levels++;
+    return levels;
+}
+
+//  Make room in the ready and pending lists for at least size items.
+//  Returns 0 if OK, -1 if there was not enough memory.
+
+static int
+s_ready_reserve (zloop_t *self, size_t size)
+{
+    if (size <= self->ready_limit)
+        return 0;
+    size_t limit = self->ready_limit? self->ready_limit: 256;
+    while (limit < size)
+        limit *= 2;
+    s_ready_t *ready = (s_ready_t *) realloc (
+        self->ready, limit * sizeof (s_ready_t));
+    if (!ready)
+        return -1;
+    self->ready = ready;
+    s_ready_t *pending = (s_ready_t *) realloc (
+        self->pending, limit * sizeof (s_ready_t));
+    if (!pending)
+        return -1;
+    self->pending = pending;
+    self->ready_limit = limit;
+    return 0;
+}
+
+//  With zmq_poll, collect the ready items in the pollset into the ready
+//  list by priority, highest first, keeping the order of items with the
+//  same priority. Each ready item holds its pollset slot. Returns 0 if OK,
+//  -1 if there was not enough memory.
+
+static int
+s_pollset_sort (zloop_t *self)
+{
+    size_t start [PRIORITY_LEVELS] = { 0 };
+    size_t ready_size = 0;
+    size_t item_nbr;
+    for (item_nbr = 0; item_nbr < self->poll_size; item_nbr++)
+        if (self->pollset [item_nbr].revents) {
+            start [s_pollset_priority (self, item_nbr)]++;
+            ready_size++;
+        }
+    if (s_ready_reserve (self, ready_size))
+        return -1;
+    size_t offset = 0;
+    int priority;
+    for (priority = PRIORITY_LEVELS - 1; priority >= 0; priority--) {
+        size_t count = start [priority];
+        start [priority] = offset;
+        offset += count;
+    }
+    for (item_nbr = 0; item_nbr < self->poll_size; item_nbr++)
+        if (self->pollset [item_nbr].revents) {
+            int priority = s_pollset_priority (self, item_nbr);
+            s_ready_t *ready = &self->ready [start [priority]++];
+            ready->key = item_nbr;
+            ready->events = self->pollset [item_nbr].revents;
+            ready->priority = priority;
+        }
+    self->ready_size = ready_size;
+    return 0;
+}
+
+#if defined (ZLOOP_EPOLL)
+//  Add a socket key to the pending list, so we check its ZMQ_EVENTS on the
+//  next pass whether or not epoll reports it. Returns 0 if OK, -1 if there
+//  was not enough memory.
+
+static int
+s_epoll_pending (zloop_t *self, size_t key)
+{
+    if (s_ready_reserve (self, self->pending_size + 1))
+        return -1;
+    self->pending [self->pending_size].key = key;
+    self->pending [self->pending_size].events = 0;
+    self->pending_size++;
+    return 0;
+}
+
+//  Register the item in a pollset slot with epoll. A ZeroMQ socket signals
+//  on its ZMQ_FD when its state may have changed, so we register that
+//  edge-triggered and ask ZMQ_EVENTS what actually happened. We register
+//  raw FDs level-triggered, as zmq_poll treats them. Epoll refuses the
+//  same FD twice, so if the same socket or FD is registered more than once
+//  we register a duplicate descriptor. Returns 0 if OK, -1 on error.
+
+static int
+s_epoll_add (zloop_t *self, size_t poll_index)
+{
+    zmq_pollitem_t *item = &self->pollset [poll_index];
+    s_watch_t *watch = s_pollset_watch (self, poll_index);
+    struct epoll_event event;
+    memset (&event, 0, sizeof (event));
+
+    int fd;
+    if (item->socket) {
+        size_t fd_size = sizeof (fd);
+        if (zmq_getsockopt (item->socket, ZMQ_FD, &fd, &fd_size))
+            return -1;
+        event.events = EPOLLIN | EPOLLET;
+    }
+    else {
+        fd = item->fd;
+        event.events = (item->events & ZMQ_POLLIN? EPOLLIN: 0)
+                     | (item->events & ZMQ_POLLOUT? EPOLLOUT: 0);
+    }
+    watch->key = (++self->last_watch_key << 1) | (self->pollact [poll_index]? 1: 0);
+    watch->fd = fd;
+    watch->dup = false;
+    event.data.u64 = watch->key;
+
+    int rc = epoll_ctl (self->epoll_handle, EPOLL_CTL_ADD, watch->fd, &event);
+    if (rc == -1 && errno == EEXIST) {
+        watch->fd = dup (fd);
+        if (watch->fd == -1)
+            return -1;
+        watch->dup = true;
+        rc = epoll_ctl (self->epoll_handle, EPOLL_CTL_ADD, watch->fd, &event);
+    }
+    if (rc == 0) {
+        void *owner = self->readact [poll_index]?
+            (void *) self->readact [poll_index]: (void *) self->pollact [poll_index];
+        rc = zhashx_insert (self->watches, (byte *) NULL + watch->key, owner);
+        if (rc)
+            epoll_ctl (self->epoll_handle, EPOLL_CTL_DEL, watch->fd, NULL);
+    }
+    //  The socket may already hold messages, which won't raise an edge
+    if (rc == 0 && item->socket)
+        rc = s_epoll_pending (self, watch->key);
+    if (rc && watch->dup)
+        close (watch->fd);
+    return rc;
+}
+
+//  Remove the item in a pollset slot from epoll
+
+static void
+s_epoll_remove (zloop_t *self, size_t poll_index)
+{
+    s_watch_t *watch = s_pollset_watch (self, poll_index);
+    //  A raw FD may already be closed, so ignore errors
+    epoll_ctl (self->epoll_handle, EPOLL_CTL_DEL, watch->fd, NULL);
+    if (watch->dup)
+        close (watch->fd);
+    zhashx_delete (self->watches, (byte *) NULL + watch->key);
+}
+
+//  Returns the pollset slot of a watched reader or poller, or -1 if it has
+//  been cancelled since its key was reported
+
+static ssize_t
+s_epoll_lookup (zloop_t *self, size_t key)
+{
+    void *owner = zhashx_lookup (self->watches, (byte *) NULL + key);
+    if (!owner)
+        return -1;
+    else
+    if (key & 1)
+        return (ssize_t) ((s_poller_t *) owner)->poll_index;
+    else
+        return (ssize_t) ((s_reader_t *) owner)->poll_index;
+}
+
+//  Sort the ready list by priority, highest first, keeping the order of
+//  items with the same priority. The pending list is empty at this point,
+//  so we sort into that, and swap the lists.
+
+static void
+s_epoll_sort (zloop_t *self)
+{
+    size_t start [PRIORITY_LEVELS] = { 0 };
+    size_t ready_nbr;
+    for (ready_nbr = 0; ready_nbr < self->ready_size; ready_nbr++)
+        start [self->ready [ready_nbr].priority]++;
+    size_t offset = 0;
+    int priority;
+    for (priority = PRIORITY_LEVELS - 1; priority >= 0; priority--) {
+        size_t count = start [priority];
+        start [priority] = offset;
+        offset += count;
+    }
+    for (ready_nbr = 0; ready_nbr < self->ready_size; ready_nbr++) {
+        s_ready_t *ready = &self->ready [ready_nbr];
+        self->pending [start [ready->priority]++] = *ready;
+    }
+    s_ready_t *sorted = self->pending;
+    self->pending = self->ready;
+    self->ready = sorted;
+}
+
+//  Wait for epoll events, collecting the ready list for this pass: sockets
+//  left pending from the last pass, followed by reported items. If any
+//  sockets are pending, we don't block. The timeout is as for zmq_poll. We
+//  get the events for each ready item now, as zmq_poll would. A pending
+//  socket may also be reported by epoll, but goes on the ready list only
+//  once. Returns the number of items ready, or -1 if interrupted or the
+//  context was shut down.
+
+static int
+s_epoll_wait (zloop_t *self, long timeout)
+{
+    struct epoll_event events [256];
+    int rc = epoll_wait (self->epoll_handle, events, 256,
+                         self->pending_size? 0: (int) (timeout / ZMQ_POLL_MSEC));
+    if (rc == -1)
+        return -1;
+    if (s_ready_reserve (self, self->pending_size + rc))
+        return -1;
+
+    self->ready_size = 0;
+    self->last_wait++;
+    size_t ready_nbr;
+    for (ready_nbr = 0; ready_nbr < self->pending_size + rc; ready_nbr++) {
+        size_t key;
+        uint32_t epoll_events = 0;
+        if (ready_nbr < self->pending_size)
+            key = self->pending [ready_nbr].key;
+        else {
+            key = (size_t) events [ready_nbr - self->pending_size].data.u64;
+            epoll_events = events [ready_nbr - self->pending_size].events;
+        }
+        ssize_t poll_index = s_epoll_lookup (self, key);
+        if (poll_index == -1)
+            continue;           //  Cancelled since it was reported
+        s_watch_t *watch = s_pollset_watch (self, (size_t) poll_index);
+        if (watch->wait == self->last_wait)
+            continue;           //  Already on the ready list
+        watch->wait = self->last_wait;
+
+        zmq_pollitem_t *item = &self->pollset [poll_index];
+        int revents = 0;
+        if (item->socket) {
+            //  This also rearms the ZMQ_FD edge, if the socket is idle
+            size_t option_len = sizeof (int);
+            if (zmq_getsockopt (item->socket, ZMQ_EVENTS, &revents, &option_len)) {
+                if (zmq_errno () == ETERM)
+                    return -1;
+                revents = ZMQ_POLLERR;
+            }
+        }
+        else {
+            if (epoll_events & EPOLLIN)
+                revents |= ZMQ_POLLIN;
+            if (epoll_events & EPOLLOUT)
+                revents |= ZMQ_POLLOUT;
+            if (epoll_events & (EPOLLERR | EPOLLHUP))
+                revents |= ZMQ_POLLERR;
+        }
+        revents &= item->events | ZMQ_POLLERR;
+        if (revents) {
+            self->ready [self->ready_size].key = key;
+            self->ready [self->ready_size].events = revents;
+            self->ready [self->ready_size].priority =
+                s_pollset_priority (self, (size_t) poll_index);
+            self->ready_size++;
+        }
+    }
+    self->pending_size = 0;
+    if (self->ready_size > 1 && s_priority_levels (self) > 1)
+        s_epoll_sort (self);
+    return (int) self->ready_size;
+}
+#endif
+
+//  We hold arrays of readers and pollers that match the pollset, so we
+//  can register/cancel readers and pollers orthogonally to executing the
+//  pollset activity. Each slot holds either a reader or a poller, and each
+//  reader or poller knows its own slot. We add new items at the end of the
+//  pollset, and move the last item into the slot of any item we remove,
+//  so changing the pollset never rebuilds it. Returns 0 on success, -1 on
+//  failure.
+
+static int
+s_pollset_add (zloop_t *self, zmq_pollitem_t *item, s_reader_t *reader, s_poller_t *poller)
+{
+    if (self->poll_size == self->poll_limit) {
+        size_t limit = self->poll_limit? self->poll_limit * 2: 16;
+        zmq_pollitem_t *pollset = (zmq_pollitem_t *) realloc (
+            self->pollset, limit * sizeof (zmq_pollitem_t));
+        if (!pollset)
+            return -1;
+        self->pollset = pollset;
+        s_reader_t **readact = (s_reader_t **) realloc (
+            self->readact, limit * sizeof (s_reader_t *));
+        if (!readact)
+            return -1;
+        self->readact = readact;
+        s_poller_t **pollact = (s_poller_t **) realloc (
+            self->pollact, limit * sizeof (s_poller_t *));
+        if (!pollact)
+            return -1;
+        self->pollact = pollact;
+        self->poll_limit = limit;
+    }
+    size_t poll_index = self->poll_size++;
+    self->pollset [poll_index] = *item;
+    self->pollset [poll_index].revents = 0;
+    self->readact [poll_index] = reader;
+    self->pollact [poll_index] = poller;
+    if (reader)
+        reader->poll_index = poll_index;
+    else
+        poller->poll_index = poll_index;
+#if defined (ZLOOP_EPOLL)
+    if (self->epoll_handle != -1 && s_epoll_add (self, poll_index)) {
+        self->poll_size--;
+        return -1;
+    }
+#endif
+    self->priorities [s_pollset_priority (self, poll_index)]++;
+    return 0;
+}
+
+static void
+s_pollset_remove (zloop_t *self, size_t poll_index)
+{
+    assert (poll_index < self->poll_size);
+#if defined (ZLOOP_EPOLL)
+    if (self->epoll_handle != -1)
+        s_epoll_remove (self, poll_index);
+#endif
+    self->priorities [s_pollset_priority (self, poll_index)]--;
+    size_t last_index = --self->poll_size;
+    if (poll_index < last_index) {
+        self->pollset [poll_index] = self->pollset [last_index];
+        self->readact [poll_index] = self->readact [last_index];
+        self->pollact [poll_index] = self->pollact [last_index];
+        if (self->readact [poll_index])
+            self->readact [poll_index]->poll_index = poll_index;
+        else
+            self->pollact [poll_index]->poll_index = poll_index;
+    }
+}
+
+//  While the reactor is overloaded, we stop polling readers below the shed
+//  priority, so their input waits until the overload passes. We apply this
+//  on each pass, to catch readers that were added or changed priority. With
+//  epoll, a socket may have received input while we were not polling it,
+//  so we check it again on the next pass. Returns 0 if OK, -1 if there was
+//  not enough memory.
+
+static int
+s_shed_apply (zloop_t *self, bool shed)
+{
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        zmq_pollitem_t *item = &self->pollset [reader->poll_index];
+        short events = shed && reader->priority < self->shed_priority?
+                       0: (short) reader->events;
+        if (item->events != events) {
+            item->events = events;
+#if defined (ZLOOP_EPOLL)
+            if (events && self->epoll_handle != -1
+            &&  s_epoll_pending (self, reader->watch.key))
+                return -1;
+#endif
+        }
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+    self->shedding = shed;
+    return 0;
+}
+
+//  On Linux, we wake up for timers using a timerfd set to the exact time
+//  the next timer must go off, as zmq_poll and epoll only wait for whole
+//  milliseconds. We open this on first use of a microsecond timer. Returns
+//  0 if OK, -1 if not possible, and then timers may go off up to one msec
+//  late.
+
+static int
+s_timer_fd_wakeup (zloop_t *self, zmq_pollitem_t *item, void *arg)
+{
+#if defined (__UTYPE_LINUX)
+    uint64_t expirations;
+    if (read (item->fd, &expirations, sizeof (expirations)) == -1)
+        assert (errno == EAGAIN);   //  Timer was set again since it fired
+#endif
+    return 0;
+}
+
+static int
+s_timer_fd_open (zloop_t *self)
+{
+#if defined (__UTYPE_LINUX)
+    if (self->timer_fd != -1)
+        return 0;
+    self->timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (self->timer_fd == -1)
+        return -1;
+    zmq_pollitem_t item = { NULL, self->timer_fd, ZMQ_POLLIN };
+    self->timer_poller = s_poller_new (&item, s_timer_fd_wakeup, NULL);
+    if (!self->timer_poller
+    ||  s_pollset_add (self, &item, NULL, self->timer_poller)) {
+        s_poller_destroy (&self->timer_poller);
+        close (self->timer_fd);
+        self->timer_fd = -1;
+        return -1;
+    }
+    self->timer_armed = 0;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static void
+s_timer_fd_close (zloop_t *self)
+{
+#if defined (__UTYPE_LINUX)
+    if (self->timer_poller) {
+        s_pollset_remove (self, self->timer_poller->poll_index);
+        s_poller_destroy (&self->timer_poller);
+    }
+    if (self->timer_fd != -1)
+        close (self->timer_fd);
+#endif
+    self->timer_fd = -1;
+}
+
+//  Set the timerfd to go off at the specified clock time, in usecs. If it
+//  is already set for the same time or earlier, and that time has not yet
+//  passed, we leave it: waking early only costs an extra pass.
+
+static void
+s_timer_fd_arm (zloop_t *self, int64_t when, int64_t time_now)
+{
+#if defined (__UTYPE_LINUX)
+    if (self->timer_fd != -1
+    && (self->timer_armed > when || self->timer_armed <= time_now)) {
+        struct itimerspec spec;
+        memset (&spec, 0, sizeof (spec));
+        spec.it_value.tv_sec = (time_t) (when / 1000000);
+        spec.it_value.tv_nsec = (long) (when % 1000000) * 1000;
+        if (timerfd_settime (self->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0)
+            self->timer_armed = when;
+    }
+#endif
+}
+
+
+static long
+s_tickless (zloop_t *self)
+{
+    //  Calculate tickless timer, up to 1 hour
+    int64_t time_now = zclock_usecs ();
+    int64_t tickless = time_now + (int64_t) 1000000 * 3600;
+
+    //  Timer that must go off first is at top of heap
+    if (self->timers_size) {
+        s_timer_t *timer = self->timers [0];
+        if (tickless > timer->when + timer->slack)
+            tickless = timer->when + timer->slack;
+    }
+    //  The wheel knows how soon the next ticket may expire
+    if (self->wheel && self->ticket_next < tickless / 1000)
+        tickless = self->ticket_next * 1000;
+
+    //  Wake up when overload ends, to poll shed readers again
+    if (self->shedding && tickless > self->shed_until)
+        tickless = self->shed_until;
+
+    s_timer_fd_arm (self, tickless, time_now);
+
+    //  Round up, so we don't wake before the deadline
+    long timeout = (long) ((tickless - time_now + 999) / 1000);
+    if (timeout < 0 || self->post_head)
+        timeout = 0;            //  Don't wait if posts are left over
+    if (self->verbose)
+        zsys_debug ("zloop polling for %d msec", (int) timeout);
+
+    return timeout * ZMQ_POLL_MSEC;
+}
+
+
+//  Open the wakeup signal for posted callbacks. On Linux this is an
+//  eventfd, with the same descriptor for both ends; on other systems it
+//  is a pipe. If not possible, leaves both descriptors at -1.
+
+static void
+s_post_open (zloop_t *self)
+{
+#if defined (__UTYPE_LINUX)
+    self->post_fd [0] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    self->post_fd [1] = self->post_fd [0];
+#elif defined (__UNIX__)
+    if (pipe (self->post_fd) == 0) {
+        fcntl (self->post_fd [0], F_SETFL, O_NONBLOCK);
+        fcntl (self->post_fd [1], F_SETFL, O_NONBLOCK);
+    }
+    else
+        self->post_fd [0] = self->post_fd [1] = -1;
+#endif
+}
+
+static void
+s_post_close (zloop_t *self)
+{
+#if defined (__UNIX__)
+    if (self->post_fd [0] != -1)
+        close (self->post_fd [0]);
+    if (self->post_fd [1] != self->post_fd [0])
+        close (self->post_fd [1]);      //  Pipe has two descriptors
+#endif
+    self->post_fd [0] = self->post_fd [1] = -1;
+}
+
+//  Raise and clear the wakeup signal
+
+static void
+s_post_signal (zloop_t *self)
+{
+#if defined (__UTYPE_LINUX)
+    uint64_t signal = 1;
+    if (write (self->post_fd [1], &signal, sizeof (signal)) == -1)
+        assert (errno == EAGAIN);   //  Counter is full, so already raised
+#elif defined (__UNIX__)
+    byte signal = 0;
+    if (write (self->post_fd [1], &signal, sizeof (signal)) == -1)
+        assert (errno == EAGAIN);   //  Pipe is full, so already raised
+#endif
+}
+
+static void
+s_post_clear (zloop_t *self)
+{
+#if defined (__UNIX__)
+    byte buffer [64];
+    while (read (self->post_fd [0], buffer, sizeof (buffer)) == sizeof (buffer))
+        ;
+#endif
+}
+
+//  Run callbacks posted by other threads, oldest first. We take all new
+//  posts off the stack and add them to the queue, in the order they were
+//  posted. If a callback returns -1, we leave the rest for the next time
+//  the reactor runs. Returns 0, or -1 if a callback ended the reactor.
+
+static int
+s_post_run (zloop_t *self)
+{
+    s_post_t *posted = self->posted;
+    while (posted && !s_post_swap (&self->posted, posted, NULL))
+        posted = self->posted;
+
+    //  Stack holds newest first, so reverse it onto the end of the queue
+    s_post_t *reversed = NULL;
+    s_post_t *last = posted;
+    while (posted) {
+        s_post_t *next = posted->next;
+        posted->next = reversed;
+        reversed = posted;
+        posted = next;
+    }
+    if (reversed) {
+        if (self->post_tail)
+            self->post_tail->next = reversed;
+        else
+            self->post_head = reversed;
+        self->post_tail = last;
+    }
+    while (self->post_head) {
+        s_post_t *post = self->post_head;
+        self->post_head = post->next;
+        if (!self->post_head)
+            self->post_tail = NULL;
+        if (self->verbose)
+            zsys_debug ("zloop: call posted handler");
+        int rc = post->handler (self, post->arg);
+        free (post);
+        if (rc == -1)
+            return -1;
+    }
+    return 0;
+}
+
+//  The wakeup signal is raised whenever a post lands on an empty stack. We
+//  clear it before taking posts, so a post that lands afterwards raises
+//  it again, and is never left waiting.
+
+static int
+s_post_wakeup (zloop_t *self, zmq_pollitem_t *item, void *arg)
+{
+    s_post_clear (self);
+    return s_post_run (self);
+}
+
+//  Register the wakeup signal in the pollset, from the reactor thread.
+//  Returns 0 if OK, -1 if not possible.
+
+static int
+s_post_register (zloop_t *self)
+{
+    if (self->post_poller || self->post_fd [0] == -1)
+        return 0;
+    zmq_pollitem_t item = { NULL, self->post_fd [0], ZMQ_POLLIN };
+    self->post_poller = s_poller_new (&item, s_post_wakeup, NULL);
+    if (!self->post_poller)
+        return -1;
+    if (s_pollset_add (self, &item, NULL, self->post_poller)) {
+        s_poller_destroy (&self->post_poller);
+        return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Constructor
+
+zloop_t *
+zloop_new (void)
+{
+    zloop_t
+    *self;
+
+    self = (zloop_t *) zmalloc (sizeof (zloop_t));
+    if (!self)
+        return NULL;
+
+    self->epoll_handle = -1;
+    self->post_fd [0] = self->post_fd [1] = -1;
+    self->timer_fd = -1;
+    self->readers = zlistx_new ();
+    if (self->readers)
+        self->pollers = zlistx_new ();
+    if (self->pollers)
+        self->timer_ids = zhashx_new ();
+    if (self->timer_ids)
+        self->watches = zhashx_new ();
+    if (self->watches) {
+        self->last_timer_id = 0;
+        //  Without a wakeup signal, zloop_post will fail
+        s_post_open (self);
+        zlistx_set_destructor (self->readers, (czmq_destructor *) s_reader_destroy);
+        zlistx_set_destructor (self->pollers, (czmq_destructor *) s_poller_destroy);
+        zhashx_set_key_hasher (self->timer_ids, s_id_hash);
+        zhashx_set_key_comparator (self->timer_ids, s_id_compare);
+        zhashx_set_key_duplicator (self->timer_ids, NULL);
+        zhashx_set_key_destructor (self->timer_ids, NULL);
+        zhashx_set_key_hasher (self->watches, s_id_hash);
+        zhashx_set_key_comparator (self->watches, s_id_compare);
+        zhashx_set_key_duplicator (self->watches, NULL);
+        zhashx_set_key_destructor (self->watches, NULL);
+    }
+    else
+        zloop_destroy (&self);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destructor
+
+void
+zloop_destroy (zloop_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zloop_t *self = *self_p;
+        zloop_set_epoll (self, false);
+        if (self->post_poller) {
+            s_pollset_remove (self, self->post_poller->poll_index);
+            s_poller_destroy (&self->post_poller);
+        }
+        while (self->posted) {
+            s_post_t *post = self->posted;
+            self->posted = post->next;
+            free (post);
+        }
+        while (self->post_head) {
+            s_post_t *post = self->post_head;
+            self->post_head = post->next;
+            free (post);
+        }
+        s_post_close (self);
+        s_timer_fd_close (self);
+        zlistx_destroy (&self->readers);
+        zlistx_destroy (&self->pollers);
+        s_wheel_close (self);
+        while (self->timers_size)
+            s_timer_destroy (&self->timers [--self->timers_size]);
+        free (self->timers);
+        free (self->expired);
+        zhashx_destroy (&self->timer_ids);
+        free (self->pollset);
+        free (self->readact);
+        free (self->pollact);
+        zhashx_destroy (&self->watches);
+        free (self->ready);
+        free (self->pending);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Register socket reader with the reactor. When the reader has messages,
+//  the reactor will call the handler, passing the arg. Returns 0 if OK, -1
+//  if there was an error. If you register the same socket more than once,
+//  each instance will invoke its corresponding handler.
+
+int
+zloop_reader (zloop_t *self, zsock_t *sock, zloop_reader_fn handler, void *arg)
+{
+    assert (self);
+    assert (sock);
+
+    s_reader_t *reader = s_reader_new (sock, handler, arg);
+    if (reader) {
+        zmq_pollitem_t poll_item = { zsock_resolve (sock), 0, ZMQ_POLLIN };
+        if (s_pollset_add (self, &poll_item, reader, NULL)) {
+            s_reader_destroy (&reader);
+            return -1;
+        }
+        reader->list_handle = zlistx_add_end (self->readers, reader);
+        if (!reader->list_handle) {
+            s_pollset_remove (self, reader->poll_index);
+            s_reader_destroy (&reader);
+            return -1;
+        }
+        if (self->verbose)
+            zsys_debug ("zloop: register %s reader", zsock_type_str (sock));
+        return 0;
+    }
+    else
+        return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Cancel a socket reader from the reactor. If multiple readers exist for
+//  same socket, cancels ALL of them.
+
+void
+zloop_reader_end (zloop_t *self, zsock_t *sock)
+{
+    assert (self);
+    assert (sock);
+
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock) {
+            if (reader == self->dispatching)
+                self->dispatching = NULL;
+            s_pollset_remove (self, reader->poll_index);
+            zlistx_delete (self->readers, reader->list_handle);
+        }
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+    if (self->verbose)
+        zsys_debug ("zloop: cancel %s reader", zsock_type_str (sock));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Configure a registered reader to ignore errors. If you do not set this,
+//  then reader that have errors are removed from the reactor silently.
+
+void
+zloop_reader_set_tolerant (zloop_t *self, zsock_t *sock)
+{
+    assert (self);
+    assert (sock);
+
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock)
+            reader->tolerant = true;
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Configure a registered reader to drain its socket in batches. While the
+//  socket still has input, the reactor calls the handler again, up to the
+//  specified number of calls or milliseconds per pass, whichever comes
+//  first, and then moves on to other readers. If msecs is zero, only the
+//  number of calls is limited. Setting calls to 1 restores the default of
+//  one call per pass.
+
+void
+zloop_reader_set_batch (zloop_t *self, zsock_t *sock, size_t calls, size_t msecs)
+{
+    assert (self);
+    assert (sock);
+    assert (calls > 0);
+
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock) {
+            reader->batch_calls = calls;
+            reader->batch_msecs = msecs;
+        }
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the priority of a registered reader, from 0 (the default) to 7. In
+//  each pass, the reactor services ready readers and pollers in order of
+//  priority, highest first, and items with the same priority in the order
+//  they were registered. Give control and heartbeat sockets a higher
+//  priority than bulk data, so a flood of data does not delay them.
+
+void
+zloop_reader_set_priority (zloop_t *self, zsock_t *sock, int priority)
+{
+    assert (self);
+    assert (sock);
+    assert (priority >= 0 && priority < PRIORITY_LEVELS);
+
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock) {
+            self->priorities [reader->priority]--;
+            reader->priority = priority;
+            self->priorities [reader->priority]++;
+        }
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the events a registered reader waits for: ZMQ_POLLIN (the default),
+//  ZMQ_POLLOUT, both, or zero to pause the reader. With ZMQ_POLLOUT, the
+//  reactor calls the handler when the socket can accept a message without
+//  blocking, so a producer that hit the high-water mark can wait for its
+//  peer to drain, instead of blocking or spinning. The handler can check
+//  zsock_events to tell input from output. Drop ZMQ_POLLOUT when there is
+//  nothing more to send, or the reactor will call the handler on each pass.
+
+void
+zloop_reader_set_events (zloop_t *self, zsock_t *sock, int events)
+{
+    assert (self);
+    assert (sock);
+    assert (!(events & ~(ZMQ_POLLIN | ZMQ_POLLOUT)));
+
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock) {
+            reader->events = events;
+            if (!self->shedding || reader->priority >= self->shed_priority)
+                self->pollset [reader->poll_index].events = (short) events;
+#if defined (ZLOOP_EPOLL)
+            //  The socket may be writable already, which won't raise an edge
+            if (events && self->epoll_handle != -1)
+                s_epoll_pending (self, reader->watch.key);
+#endif
+        }
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Check a registered reader's socket again on the next pass, whether or
+//  not it signals. With epoll, call this from a handler that sends on a
+//  socket registered as a reader in the same loop, since sending can
+//  consume the signal that would have woken that reader. With zmq_poll,
+//  this does nothing, as every socket is checked on each pass.
+
+void
+zloop_reader_rearm (zloop_t *self, zsock_t *sock)
+{
+    assert (self);
+    assert (sock);
+#if defined (ZLOOP_EPOLL)
+    if (self->epoll_handle == -1)
+        return;
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        if (reader->sock == sock)
+            s_epoll_pending (self, reader->watch.key);
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Register low-level libzmq pollitem with the reactor. When the pollitem
+//  is ready, will call the handler, passing the arg. Returns 0 if OK, -1
+//  if there was an error. If you register the pollitem more than once, each
+//  instance will invoke its corresponding handler. A pollitem with
+//  socket=NULL and fd=0 means 'poll on FD zero'.
+
+int
+zloop_poller (zloop_t *self, zmq_pollitem_t *item, zloop_fn handler, void *arg)
+{
+    assert (self);
+
+    if (item->socket
+    &&  streq (zsys_sockname (zsock_type (item->socket)), "UNKNOWN"))
+        return -1;
+
+    s_poller_t *poller = s_poller_new (item, handler, arg);
+    if (poller) {
+        if (s_pollset_add (self, item, NULL, poller)) {
+            s_poller_destroy (&poller);
+            return -1;
+        }
+        poller->list_handle = zlistx_add_end (self->pollers, poller);
+        if (!poller->list_handle) {
+            s_pollset_remove (self, poller->poll_index);
+            s_poller_destroy (&poller);
+            return -1;
+        }
+        if (self->verbose)
+            zsys_debug ("zloop: register %s poller (%p, %d)",
+                        item->socket? zsys_sockname (zsock_type (item->socket)): "FD",
+                        item->socket, item->fd);
+        return 0;
+    }
+    else
+        return -1;
 }
 
 
@@ -513,9 +1754,10 @@ zloop_poller_end (zloop_t *self, zmq_pollitem_t *item)
                 match = true;
         }
         if (match) {
+            if (poller == self->dispatching)
+                self->dispatching = NULL;
+            s_pollset_remove (self, poller->poll_index);
             zlistx_delete (self->pollers, poller->list_handle);
-            //  Force rebuild to avoid reading from freed poller
-            self->need_rebuild = true;
         }
         poller = (s_poller_t *) zlistx_next (self->pollers);
     }
@@ -556,34 +1798,61 @@ zloop_poller_set_tolerant (zloop_t *self, zmq_pollitem_t *item)
 
 
 //  --------------------------------------------------------------------------
-//  Register a timer that expires after some delay and repeats some number of
-//  times. At each expiry, will call the handler, passing the arg. To run a
-//  timer forever, use 0 times. Returns a timer_id that is used to cancel the
-//  timer in the future. Returns -1 if there was an error.
-//
-//  TODO: if we returned a void *handle to the timer then we could work
-//  directly into the list rather than scanning... how to do this without
-//  breaking the API or making the code horribly complex?
+//  Set the priority of a registered poller, specified by socket or FD, as
+//  for readers. Overload shedding does not apply to pollers.
 
-int
-zloop_timer (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler, void *arg)
+void
+zloop_poller_set_priority (zloop_t *self, zmq_pollitem_t *item, int priority)
 {
     assert (self);
+    assert (priority >= 0 && priority < PRIORITY_LEVELS);
+
+    s_poller_t *poller = (s_poller_t *) zlistx_first (self->pollers);
+    while (poller) {
+        bool match = false;
+        if (item->socket) {
+            if (item->socket == poller->item.socket)
+                match = true;
+        }
+        else {
+            if (item->fd == poller->item.fd)
+                match = true;
+        }
+        if (match) {
+            self->priorities [poller->priority]--;
+            poller->priority = priority;
+            self->priorities [poller->priority]++;
+        }
+        poller = (s_poller_t *) zlistx_next (self->pollers);
+    }
+}
+
+
+//  Register a timer with a delay in usecs. Returns the timer id, or -1
+//  if there was an error.
+
+static int
+s_timer_register (zloop_t *self, int64_t delay, size_t times, zloop_timer_fn handler, void *arg)
+{
     //  Catch excessive use of timers
-    if (self->max_timers && zlistx_size (self->timers) == self->max_timers) {
+    if (self->max_timers && self->timers_size == self->max_timers) {
         zsys_error ("zloop: timer limit reached (max=%d)", self->max_timers);
         return -1;
     }
     int timer_id = s_next_timer_id (self);
     s_timer_t *timer = s_timer_new (timer_id, delay, times, handler, arg);
     if (timer) {
-        timer->list_handle = zlistx_add_end (self->timers, timer);
-        if (!timer->list_handle) {
+        if (zhashx_insert (self->timer_ids, (byte *) NULL + timer_id, timer)) {
+            s_timer_destroy (&timer);
+            return -1;
+        }
+        if (s_timer_heap_add (self, timer)) {
+            zhashx_delete (self->timer_ids, (byte *) NULL + timer_id);
             s_timer_destroy (&timer);
             return -1;
         }
         if (self->verbose)
-            zsys_debug ("zloop: register timer id=%d delay=%d times=%d",
+            zsys_debug ("zloop: register timer id=%d delay=%dus times=%d",
                         timer_id, (int) delay, (int) times);
         return timer_id;
     }
@@ -593,24 +1862,77 @@ zloop_timer (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler,
 
 
 //  --------------------------------------------------------------------------
-//  Cancel a timer by timer id (as returned by zloop_timer()).
-//  Returns 0 on success.
+//  Register a timer that expires after some delay and repeats some number of
+//  times. At each expiry, will call the handler, passing the arg. To run a
+//  timer forever, use 0 times. Returns a timer_id that is used to cancel the
+//  timer in the future. Returns -1 if there was an error.
+
+int
+zloop_timer (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler, void *arg)
+{
+    assert (self);
+    return s_timer_register (self, (int64_t) delay * 1000, times, handler, arg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Register a timer with a delay in microseconds, which otherwise works as
+//  zloop_timer. On Linux, the reactor wakes up at the exact time the timer
+//  is due; on other systems it may wake up to one msec late.
 
 int
-zloop_timer_end (zloop_t *self, int timer_id)
+zloop_timer_us (zloop_t *self, size_t delay, size_t times, zloop_timer_fn handler, void *arg)
 {
     assert (self);
+    //  If we can't wake precisely, we still run timers, only later
+    s_timer_fd_open (self);
+    return s_timer_register (self, (int64_t) delay, times, handler, arg);
+}
 
-    if (self->terminated)
-        s_timer_remove (self, timer_id);
-    else
-    //  We cannot touch self->timers because we may be executing that
-    //  from inside the poll loop. So, we hold the arg on the zombie
-    //  list, and process that list when we're done executing timers.
-    //  This hack lets us store an integer timer ID as a pointer
-    if (zlistx_add_end (self->zombies, (byte *) NULL + timer_id) == NULL)
+
+//  --------------------------------------------------------------------------
+//  Allow a timer to go off up to the specified number of usecs late. The
+//  reactor uses this to handle several timers in one wakeup, so low
+//  priority timers should have some slack. A timer with slack still goes
+//  off as early as it can, if the reactor is awake. Timers have no slack
+//  by default. Returns 0 if OK, -1 if there is no such timer.
+
+int
+zloop_timer_set_slack (zloop_t *self, int timer_id, size_t slack)
+{
+    assert (self);
+    s_timer_t *timer = (s_timer_t *) zhashx_lookup (
+        self->timer_ids, (byte *) NULL + timer_id);
+    if (!timer)
         return -1;
 
+    s_slack_remove (self, timer->slack);
+    if (timer->expired)
+        timer->slack = slack;   //  Off heap until its handler returns
+    else {
+        //  Changing slack changes place in heap
+        s_timer_heap_detach (self, timer);
+        timer->slack = slack;
+        int rc = s_timer_heap_add (self, timer);
+        assert (rc == 0);       //  Cannot fail, as heap held the timer
+    }
+    s_slack_add (self, timer->slack);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Cancel a timer by timer id (as returned by zloop_timer()). The timer is
+//  found by its id without a search, and taken off the timer heap, so this
+//  costs O(log n) in the number of timers. It is safe to call from any
+//  handler, including the handler of the timer being cancelled. Returns 0
+//  on success.
+
+int
+zloop_timer_end (zloop_t *self, int timer_id)
+{
+    assert (self);
+    s_timer_remove (self, timer_id);
     if (self->verbose)
         zsys_debug ("zloop: cancel timer id=%d", timer_id);
 
@@ -627,102 +1949,519 @@ zloop_timer_end (zloop_t *self, int timer_id)
 //  cost of ticket timers is constant, no matter the number of clients. You
 //  must set the ticket delay using zloop_set_ticket_delay before creating a
 //  ticket. Returns a handle to the timer that you should use in
-//  zloop_ticket_reset and zloop_ticket_delete.
+//  zloop_ticket_reset and zloop_ticket_delete. A ticket fires once, and is
+//  then deleted, unless its handler resets it.
 
 void *
 zloop_ticket (zloop_t *self, zloop_timer_fn handler, void *arg)
 {
     assert (self);
     assert (self->ticket_delay > 0);
+    if (!self->wheel && s_wheel_open (self))
+        return NULL;
     s_ticket_t *ticket = s_ticket_new (self->ticket_delay, handler, arg);
-    if (ticket) {
-        ticket->list_handle = zlistx_add_end (self->tickets, ticket);
-        if (!ticket->list_handle)
-            s_ticket_destroy (&ticket);
-    }
+    if (ticket)
+        s_wheel_add (self, ticket);
     return ticket;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Reset a ticket timer, which moves it to the end of the ticket list and
-//  resets its execution time. This is a very fast operation.
+//  Reset a ticket timer, which moves it to the wheel slot for its new
+//  execution time. This is a very fast operation.
 
 void
 zloop_ticket_reset (zloop_t *self, void *handle)
 {
     s_ticket_t *ticket = (s_ticket_t *) handle;
     assert (ticket->tag == TICKET_TAG);
+    s_link_remove (&ticket->link);
     ticket->when = zclock_mono () + ticket->delay;
-    zlistx_move_end (self->tickets, ticket->list_handle);
+    s_wheel_add (self, ticket);
 }
 
 
 //  --------------------------------------------------------------------------
-//  Delete a ticket timer. We do not actually delete the ticket here, as
-//  other code may still refer to the ticket. We mark as deleted, and remove
-//  later and safely.
+//  Set the delay for one ticket, in msecs, in place of the ticket delay it
+//  was created with, and reset the ticket. Use this when different tickets
+//  need different delays.
+
+void
+zloop_ticket_set_delay (zloop_t *self, void *handle, size_t delay)
+{
+    s_ticket_t *ticket = (s_ticket_t *) handle;
+    assert (ticket->tag == TICKET_TAG);
+    assert (delay <= UINT32_MAX);
+    ticket->delay = (uint32_t) delay;
+    zloop_ticket_reset (self, handle);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Delete a ticket timer. This frees the ticket at once, unless it is the
+//  ticket whose handler is running, which we free when the handler returns.
 
 void
 zloop_ticket_delete (zloop_t *self, void *handle)
 {
     s_ticket_t *ticket = (s_ticket_t *) handle;
     assert (ticket->tag == TICKET_TAG);
-    ticket->deleted = true;
-    //  Move deleted tickets to end of list for fast cleanup
-    zlistx_move_end (self->tickets, ticket->list_handle);
+    s_link_remove (&ticket->link);
+    if (ticket == self->ticket_firing)
+        self->ticket_firing = NULL;
+    else
+        s_ticket_destroy (&ticket);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Post a callback to the reactor from any thread. The reactor calls the
+//  handler, passing the arg, on its own thread, as soon as it wakes up.
+//  Callbacks run in the order they were posted. If a callback returns -1,
+//  the reactor ends. This is the only zloop method that is safe to call
+//  from another thread. Returns 0 if OK, -1 if there was not enough
+//  memory, or posting is not supported on this platform.
+
+int
+zloop_post (zloop_t *self, zloop_post_fn handler, void *arg)
+{
+    assert (self);
+    assert (handler);
+    if (self->post_fd [0] == -1)
+        return -1;
+
+    s_post_t *post = (s_post_t *) malloc (sizeof (s_post_t));
+    if (!post)
+        return -1;
+    post->handler = handler;
+    post->arg = arg;
+    s_post_t *head;
+    do {
+        head = self->posted;
+        post->next = head;
+    } while (!s_post_swap (&self->posted, head, post));
+
+    //  Reactor clears the signal before it takes posts, so we only need
+    //  to raise it when the stack was empty
+    if (!head)
+        s_post_signal (self);
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the ticket delay, which applies to tickets created from now on.
+//  Existing tickets keep their delay.
+
+void
+zloop_set_ticket_delay (zloop_t *self, size_t ticket_delay)
+{
+    assert (self);
+    self->ticket_delay = ticket_delay;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set verbose tracing of reactor on/off
+
+void
+zloop_set_verbose (zloop_t *self, bool verbose)
+{
+    assert (self);
+    self->verbose = verbose;
+}
+
+//  --------------------------------------------------------------------------
+//  Ignore zsys_interrupted flag in this loop. By default, a zloop_start will
+//  exit as soon as it detects zsys_interrupted is set to something other than
+//  zero. Calling zloop_ignore_interrupts will supress this behavior.
+
+void
+zloop_ignore_interrupts(zloop_t *self)
+{
+    assert (self);
+    self->ignore_interrupts = true;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set hard limit on number of timers allowed. Timers are held in a heap,
+//  so the cost of adding, cancelling and expiring a timer grows only slowly
+//  with the number of timers. For high-volume expiry cases, ticket timers
+//  are still cheaper. If the hard limit is reached, the reactor stops
+//  creating new timers and logs an error.
+
+void
+zloop_set_max_timers (zloop_t *self, size_t max_timers)
+{
+    assert (self);
+    self->max_timers = max_timers;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Use epoll instead of zmq_poll to wait for readers and pollers, if epoll
+//  is true, or go back to zmq_poll if false. With epoll, the cost of each
+//  pass is proportional to the number of active sockets rather than to the
+//  number of registered sockets. Sockets are watched through their ZMQ_FD,
+//  which only signals a change of state, and after calling a handler the
+//  reactor checks that handler's socket again on the next pass. A handler
+//  that sends on another socket registered in the same loop may consume
+//  that socket's signal, so its reader will not wake for input that is
+//  already waiting. Such a handler should call zloop_reader_rearm for that
+//  socket. Returns 0 if OK, -1 if epoll is not available on this platform,
+//  or could not be set up.
+//  Call this before zloop_start, not from a handler.
+
+int
+zloop_set_epoll (zloop_t *self, bool epoll)
+{
+    assert (self);
+#if defined (ZLOOP_EPOLL)
+    if (epoll && self->epoll_handle == -1) {
+        self->epoll_handle = epoll_create1 (EPOLL_CLOEXEC);
+        if (self->epoll_handle == -1)
+            return -1;
+        size_t poll_index;
+        for (poll_index = 0; poll_index < self->poll_size; poll_index++)
+            if (s_epoll_add (self, poll_index)) {
+                while (poll_index)
+                    s_epoll_remove (self, --poll_index);
+                close (self->epoll_handle);
+                self->epoll_handle = -1;
+                self->pending_size = 0;
+                return -1;
+            }
+    }
+    else
+    if (!epoll && self->epoll_handle != -1) {
+        size_t poll_index;
+        for (poll_index = 0; poll_index < self->poll_size; poll_index++)
+            s_epoll_remove (self, poll_index);
+        close (self->epoll_handle);
+        self->epoll_handle = -1;
+        self->ready_size = 0;
+        self->pending_size = 0;
+    }
+    return 0;
+#else
+    return epoll? -1: 0;
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Keep statistics on handlers, if stats is true. For each reader, poller,
+//  and timer, the reactor counts calls and keeps a histogram of how long
+//  the handler took. It also measures how late timers fire. Turning on
+//  statistics clears any previous values. Statistics are off by default.
+
+void
+zloop_set_stats (zloop_t *self, bool stats)
+{
+    assert (self);
+    if (stats && !self->stats) {
+        memset (&self->lag, 0, sizeof (s_stats_t));
+        s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+        while (reader) {
+            memset (&reader->stats, 0, sizeof (s_stats_t));
+            reader = (s_reader_t *) zlistx_next (self->readers);
+        }
+        s_poller_t *poller = (s_poller_t *) zlistx_first (self->pollers);
+        while (poller) {
+            memset (&poller->stats, 0, sizeof (s_stats_t));
+            poller = (s_poller_t *) zlistx_next (self->pollers);
+        }
+        size_t timer_nbr;
+        for (timer_nbr = 0; timer_nbr < self->timers_size; timer_nbr++) {
+            free (self->timers [timer_nbr]->stats);
+            self->timers [timer_nbr]->stats = NULL;
+        }
+    }
+    self->stats = stats;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Report any reader, poller, or timer handler that takes longer than the
+//  specified number of msecs, as a warning on the system log. Set to zero
+//  to turn off reporting, which is the default.
+
+void
+zloop_set_watchdog (zloop_t *self, size_t msecs)
+{
+    assert (self);
+    self->watchdog = (int64_t) msecs * 1000;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Shed load when the reactor is overloaded. The reactor measures its lag
+//  on each pass: how late it calls each timer and ticket handler, after the
+//  time the timer was due (allowing for its slack), and how long each ready
+//  reader and poller waits after the reactor wakes up before its handler is
+//  called. If the lag is more than the specified number of msecs, then for
+//  the next msecs the reactor stops polling readers with a priority below
+//  the specified priority. Their input waits on the socket, rather than
+//  delaying higher-priority readers and timers. The reactor stays
+//  overloaded until no pass has had too much lag for msecs. Set msecs to
+//  zero to turn off shedding, which is the default.
+
+void
+zloop_set_overload (zloop_t *self, size_t msecs, int priority)
+{
+    assert (self);
+    assert (priority >= 0 && priority <= PRIORITY_LEVELS);
+    self->overload = (int64_t) msecs * 1000;
+    self->shed_priority = priority;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return a snapshot of the reactor's statistics, as a message with six
+//  frames for each set of statistics: kind ("lag", "reader", "poller", or
+//  "timer"), name (socket type, "FD", or timer id), number of calls, total
+//  usecs, longest usecs, and a histogram of calls as counts separated by
+//  spaces. Histogram bucket N counts calls that took less than 2^N usecs,
+//  and the last bucket counts all longer calls. The first set is timer lag,
+//  which measures how late timers fired. Timers that have ended or been
+//  cancelled are added together in one last set, named "ended". Returns
+//  NULL if statistics are not enabled. Caller must destroy the message when
+//  finished with it.
+
+zmsg_t *
+zloop_stats (zloop_t *self)
+{
+    assert (self);
+    if (!self->stats)
+        return NULL;
+
+    zmsg_t *msg = zmsg_new ();
+    if (!msg)
+        return NULL;
+    s_stats_add (msg, &self->lag, "lag", "timers");
+    s_reader_t *reader = (s_reader_t *) zlistx_first (self->readers);
+    while (reader) {
+        s_stats_add (msg, &reader->stats, "reader", zsock_type_str (reader->sock));
+        reader = (s_reader_t *) zlistx_next (self->readers);
+    }
+    s_poller_t *poller = (s_poller_t *) zlistx_first (self->pollers);
+    while (poller) {
+        s_stats_add (msg, &poller->stats, "poller", poller->item.socket?
+                     zsys_sockname (zsock_type (poller->item.socket)): "FD");
+        poller = (s_poller_t *) zlistx_next (self->pollers);
+    }
+    size_t timer_nbr;
+    for (timer_nbr = 0; timer_nbr < self->timers_size; timer_nbr++) {
+        s_timer_t *timer = self->timers [timer_nbr];
+        if (timer->stats) {
+            char name [16];
+            snprintf (name, sizeof (name), "%d", timer->timer_id);
+            s_stats_add (msg, timer->stats, "timer", name);
+        }
+    }
+    if (self->timers_ended.calls)
+        s_stats_add (msg, &self->timers_ended, "timer", "ended");
+    return msg;
+}
+
+
+//  Call a reader's handler, timing it if we're keeping statistics or have
+//  a watchdog. The reader stays in self->dispatching unless the handler
+//  cancels it. Returns the handler's return code.
+
+static int
+s_reader_call (zloop_t *self, s_reader_t *reader)
+{
+    self->dispatching = reader;
+    if (self->overload)
+        s_lag_note (self, zclock_usecs () - self->woke);
+    if (!self->stats && !self->watchdog)
+        return reader->handler (self, reader->sock, reader->arg);
+
+    const char *type = zsock_type_str (reader->sock);
+    int64_t started = zclock_usecs ();
+    int rc = reader->handler (self, reader->sock, reader->arg);
+    int64_t usecs = s_handler_done (self,
+        self->dispatching == reader? &reader->stats: NULL, started);
+    if (self->watchdog && usecs > self->watchdog)
+        zsys_warning ("zloop: %s reader handler took %d msecs",
+                      type, (int) (usecs / 1000));
+    return rc;
+}
+
+//  Call a poller's handler, as for a reader
+
+static int
+s_poller_call (zloop_t *self, s_poller_t *poller, zmq_pollitem_t *item)
+{
+    self->dispatching = poller;
+    if (self->overload)
+        s_lag_note (self, zclock_usecs () - self->woke);
+    if (!self->stats && !self->watchdog)
+        return poller->handler (self, item, poller->arg);
+
+    int64_t started = zclock_usecs ();
+    int rc = poller->handler (self, item, poller->arg);
+    int64_t usecs = s_handler_done (self,
+        self->dispatching == poller? &poller->stats: NULL, started);
+    if (self->watchdog && usecs > self->watchdog)
+        zsys_warning ("zloop: %s poller handler (%p, %d) took %d msecs",
+                      item->socket? zsys_sockname (zsock_type (item->socket)): "FD",
+                      item->socket, item->fd, (int) (usecs / 1000));
+    return rc;
 }
 
+//  Call a timer's handler, as for a reader. Expired timers are only
+//  destroyed after their handler returns, so the timer is always valid.
+
+static int
+s_timer_call (zloop_t *self, s_timer_t *timer)
+{
+    if (self->overload)
+        s_lag_note (self, zclock_usecs () - timer->when - timer->slack);
+    if (!self->stats && !self->watchdog)
+        return timer->handler (self, timer->timer_id, timer->arg);
+
+    int64_t started = zclock_usecs ();
+    int rc = timer->handler (self, timer->timer_id, timer->arg);
+    if (self->stats && !timer->stats)
+        timer->stats = (s_stats_t *) zmalloc (sizeof (s_stats_t));
+    int64_t usecs = s_handler_done (self, timer->stats, started);
+    if (self->watchdog && usecs > self->watchdog)
+        zsys_warning ("zloop: timer id=%d handler took %d msecs",
+                      timer->timer_id, (int) (usecs / 1000));
+    return rc;
+}
 
-//  --------------------------------------------------------------------------
-//  Set the ticket delay, which applies to all tickets. If you lower the
-//  delay and there are already tickets created, the results are undefined.
+//  Call a batching reader's handler until its socket has no more input, or
+//  it has used its budget of calls or time. We stop if the handler cancels
+//  the reader. Returns the last return code from the handler.
 
-void
-zloop_set_ticket_delay (zloop_t *self, size_t ticket_delay)
+static int
+s_reader_drain (zloop_t *self, s_reader_t *reader)
 {
-    assert (self);
-    self->ticket_delay = ticket_delay;
+    int64_t deadline = reader->batch_msecs? zclock_mono () + reader->batch_msecs: 0;
+    size_t calls = 0;
+    int rc;
+    while (true) {
+        rc = s_reader_call (self, reader);
+        if (rc == -1 || self->dispatching != reader)
+            break;              //  Handler ended reactor or cancelled reader
+        if (++calls == reader->batch_calls)
+            break;
+        if (deadline && zclock_mono () >= deadline)
+            break;
+        if (!(zsock_events (reader->sock) & reader->events))
+            break;
+    }
+    return rc;
 }
 
 
-//  --------------------------------------------------------------------------
-//  Set verbose tracing of reactor on/off
+//  Call the handler for the reader or poller in a pollset slot, according
+//  to the events in the slot. Returns the handler's return code, or 0 if
+//  no handler was called. If the item fails twice in a row, we cancel it.
 
-void
-zloop_set_verbose (zloop_t *self, bool verbose)
+static int
+s_pollset_dispatch (zloop_t *self, size_t item_nbr)
 {
-    assert (self);
-    self->verbose = verbose;
-}
+    int rc = 0;
+    zmq_pollitem_t item = self->pollset [item_nbr];
+    s_reader_t *reader = self->readact [item_nbr];
+    if (reader) {
+        if ((item.revents & ZMQ_POLLERR) && !reader->tolerant) {
+            if (self->verbose)
+                zsys_warning ("zloop: can't read %s socket: %s",
+                              zsock_type_str (reader->sock),
+                              zmq_strerror (zmq_errno ()));
+            //  Give handler one chance to handle error, then kill
+            //  reader because it'll disrupt the reactor otherwise.
+            if (reader->errors++) {
+                zloop_reader_end (self, reader->sock);
+                return 0;
+            }
+        }
+        else
+            reader->errors = 0;     //  A non-error happened
 
-//  --------------------------------------------------------------------------
-//  Ignore zsys_interrupted flag in this loop. By default, a zloop_start will
-//  exit as soon as it detects zsys_interrupted is set to something other than
-//  zero. Calling zloop_ignore_interrupts will supress this behavior.
+        if (item.revents) {
+            if (self->verbose)
+                zsys_debug ("zloop: call %s socket handler",
+                            zsock_type_str (reader->sock));
+            if (reader->batch_calls == 1)
+                rc = s_reader_call (self, reader);
+            else
+                rc = s_reader_drain (self, reader);
+        }
+    }
+    else {
+        s_poller_t *poller = self->pollact [item_nbr];
+        assert (item.socket == poller->item.socket);
 
-void
-zloop_ignore_interrupts(zloop_t *self)
-{
-    assert (self);
-    self->ignore_interrupts = true;
+        if ((item.revents & ZMQ_POLLERR) && !poller->tolerant) {
+            if (self->verbose)
+                zsys_warning ("zloop: can't poll %s socket (%p, %d): %s",
+                              poller->item.socket ?
+                              zsys_sockname (zsock_type (poller->item.socket)) : "FD",
+                              poller->item.socket, poller->item.fd,
+                              zmq_strerror (zmq_errno ()));
+            //  Give handler one chance to handle error, then kill
+            //  poller because it'll disrupt the reactor otherwise.
+            if (poller->errors++) {
+                zmq_pollitem_t poller_item = poller->item;
+                zloop_poller_end (self, &poller_item);
+                return 0;
+            }
+        }
+        else
+            poller->errors = 0;     //  A non-error happened
+
+        if (item.revents) {
+            if (self->verbose)
+                zsys_debug ("zloop: call %s socket handler (%p, %d)",
+                            poller->item.socket ?
+                            zsys_sockname (zsock_type (poller->item.socket)) : "FD",
+                            poller->item.socket, poller->item.fd);
+            rc = s_poller_call (self, poller, &item);
+        }
+    }
+    self->dispatching = NULL;
+    return rc;
 }
 
 
-//  --------------------------------------------------------------------------
-//  Set hard limit on number of timers allowed. Setting more than a small
-//  number of timers (10-100) can have a dramatic impact on the performance
-//  of the reactor. For high-volume cases, use ticket timers. If the hard
-//  limit is reached, the reactor stops creating new timers and logs an
-//  error.
+#if defined (ZLOOP_EPOLL)
+//  Call the handlers for the ready list. After calling a socket handler,
+//  we check the socket again on the next pass, since it may still hold
+//  messages, and epoll won't report it again until it's drained. If a
+//  handler signals break, we also keep any sockets we did not get to.
+//  Other sockets are checked again only if a handler asks for that with
+//  zloop_reader_rearm. Takes the current return code, and returns the new
+//  one.
 
-void
-zloop_set_max_timers (zloop_t *self, size_t max_timers)
+static int
+s_epoll_dispatch (zloop_t *self, int rc)
 {
-    assert (self);
-    self->max_timers = max_timers;
+    size_t ready_nbr;
+    for (ready_nbr = 0; ready_nbr < self->ready_size; ready_nbr++) {
+        size_t key = self->ready [ready_nbr].key;
+        ssize_t poll_index = s_epoll_lookup (self, key);
+        if (poll_index == -1)
+            continue;           //  Cancelled by an earlier handler
+        if (rc != -1) {
+            self->pollset [poll_index].revents = (short) self->ready [ready_nbr].events;
+            rc = s_pollset_dispatch (self, (size_t) poll_index);
+            poll_index = s_epoll_lookup (self, key);
+        }
+        if (poll_index != -1
+        &&  self->pollset [poll_index].socket
+        &&  s_epoll_pending (self, key))
+            rc = -1;
+    }
+    return rc;
 }
-
+#endif
 
 //  --------------------------------------------------------------------------
 //  Start the reactor. Takes control of the thread and returns when the 0MQ
@@ -737,15 +2476,23 @@ zloop_start (zloop_t *self)
     assert (self);
     int rc = 0;
 
+    //  We can only add the wakeup signal for posts on the reactor thread
+    if (s_post_register (self))
+        return -1;
+
     //  Main reactor loop
     while (self->ignore_interrupts || !zsys_interrupted) {
-        if (self->need_rebuild) {
-            //  If s_rebuild_pollset() fails, break out of the loop and
-            //  return its error
-            rc = s_rebuild_pollset (self);
-            if (rc)
-                break;
+        //  Keep shedding readers until the overload has passed
+        if (self->shedding
+        &&  s_shed_apply (self, self->overload && zclock_usecs () < self->shed_until)) {
+            rc = -1;
+            break;
         }
+#if defined (ZLOOP_EPOLL)
+        if (self->epoll_handle != -1)
+            rc = s_epoll_wait (self, s_tickless (self));
+        else
+#endif
         rc = zmq_poll (self->pollset, (int) self->poll_size, s_tickless (self));
         if (rc == -1 || (!self->ignore_interrupts && zsys_interrupted)) {
             if (self->verbose)
@@ -753,117 +2500,121 @@ zloop_start (zloop_t *self)
             rc = 0;
             break;              //  Context has been shut down
         }
+        if (self->overload) {
+            self->woke = zclock_usecs ();
+            self->pass_lag = 0;
+        }
+
+        //  Run any callbacks that other threads have posted to us
+        if ((self->posted || self->post_head) && s_post_run (self) == -1) {
+            rc = -1;
+            break;
+        }
 
-        //  Handle any timers that have now expired
-        int64_t time_now = zclock_mono ();
-        s_timer_t *timer = (s_timer_t *) zlistx_first (self->timers);
-        while (timer) {
-            if (time_now >= timer->when) {
+        //  Handle any timers that have now expired, including timers with
+        //  slack that could still wait. We take all expired timers off the
+        //  heap first, so each timer fires at most once per pass, and
+        //  handlers can safely create new timers.
+        int64_t time_now = zclock_usecs ();
+        if (self->expired_limit < self->timers_size) {
+            free (self->expired);
+            self->expired_limit = self->timers_limit;
+            self->expired = (s_timer_t **) malloc (
+                self->expired_limit * sizeof (s_timer_t *));
+            if (!self->expired) {
+                self->expired_limit = 0;
+                rc = -1;
+                break;
+            }
+        }
+        size_t expired_size = 0;
+        s_slack_refresh (self);
+        s_timer_heap_collect (self, 0, time_now, &expired_size);
+        if (expired_size > 1)
+            qsort (self->expired, expired_size, sizeof (s_timer_t *),
+                   s_timer_compare_when);
+        size_t expired_nbr;
+        for (expired_nbr = 0; expired_nbr < expired_size; expired_nbr++) {
+            s_timer_t *timer = self->expired [expired_nbr];
+            s_timer_heap_detach (self, timer);
+            if (self->stats)
+                s_stats_record (&self->lag, time_now - timer->when);
+            timer->expired = true;
+        }
+        for (expired_nbr = 0; expired_nbr < expired_size; expired_nbr++) {
+            s_timer_t *timer = self->expired [expired_nbr];
+            //  If a handler signaled break, we put back remaining timers
+            //  without calling them. Handlers may cancel any timer.
+            if (rc != -1 && !timer->cancelled) {
                 if (self->verbose)
                     zsys_debug ("zloop: call timer handler id=%d", timer->timer_id);
-                rc = timer->handler (self, timer->timer_id, timer->arg);
-                if (rc == -1)
-                    break;      //  Timer handler signaled break
-                if (timer->times && --timer->times == 0)
-                    zlistx_delete (self->timers, timer->list_handle);
-                else
-                    timer->when += timer->delay;
+                rc = s_timer_call (self, timer);
+                if (rc != -1 && !timer->cancelled) {
+                    if (timer->times && --timer->times == 0)
+                        s_timer_remove (self, timer->timer_id);
+                    else
+                        timer->when += timer->delay;
+                }
+            }
+            timer->expired = false;
+            if (timer->cancelled)
+                s_timer_retire (self, &timer);
+            else {
+                //  Cannot fail, as heap held these timers before
+                int rc_add = s_timer_heap_add (self, timer);
+                assert (rc_add == 0);
             }
-            timer = (s_timer_t *) zlistx_next (self->timers);
         }
 
         //  Handle any tickets that have now expired
-        s_ticket_t *ticket = (s_ticket_t *) zlistx_first (self->tickets);
-        while (ticket && time_now >= ticket->when) {
-            if (self->verbose)
-                zsys_debug ("zloop: call ticket handler");
-            if (ticket->handler (self, 0, ticket->arg) == -1)
-                break;      //  Timer handler signaled break
-            zlistx_delete (self->tickets, ticket->list_handle);
-            ticket = (s_ticket_t *) zlistx_next (self->tickets);
-        }
-
-        //  Handle any tickets that were flagged for deletion
-        ticket = (s_ticket_t *) zlistx_last (self->tickets);
-        while (ticket && ticket->deleted) {
-            zlistx_delete (self->tickets, ticket->list_handle);
-            ticket = (s_ticket_t *) zlistx_last (self->tickets);
-        }
-
-        //  Handle any readers and pollers that are ready
-        size_t item_nbr;
-        for (item_nbr = 0; item_nbr < self->poll_size && rc >= 0; item_nbr++) {
-            s_reader_t *reader = &self->readact [item_nbr];
-            if (reader->handler) {
-                if ((self->pollset [item_nbr].revents & ZMQ_POLLERR)
-                && !reader->tolerant) {
-                    if (self->verbose)
-                        zsys_warning ("zloop: can't read %s socket: %s",
-                                      zsock_type_str (reader->sock),
-                                      zmq_strerror (zmq_errno ()));
-                    //  Give handler one chance to handle error, then kill
-                    //  reader because it'll disrupt the reactor otherwise.
-                    if (reader->errors++) {
-                        zloop_reader_end (self, reader->sock);
-                        self->pollset [item_nbr].revents = 0;
-                    }
-                }
-                else
-                    reader->errors = 0;     //  A non-error happened
-
-                if (self->pollset [item_nbr].revents) {
-                    if (self->verbose)
-                        zsys_debug ("zloop: call %s socket handler",
-                                    zsock_type_str (reader->sock));
-                    rc = reader->handler (self, reader->sock, reader->arg);
-                    if (rc == -1 || self->need_rebuild)
-                        break;
-                }
-            }
-            else {
-                s_poller_t *poller = &self->pollact [item_nbr];
-                assert (self->pollset [item_nbr].socket == poller->item.socket);
-
-                if ((self->pollset [item_nbr].revents & ZMQ_POLLERR)
-                && !poller->tolerant) {
-                    if (self->verbose)
-                        zsys_warning ("zloop: can't poll %s socket (%p, %d): %s",
-                                      poller->item.socket ?
-                                      zsys_sockname (zsock_type (poller->item.socket)) : "FD",
-                                      poller->item.socket, poller->item.fd,
-                                      zmq_strerror (zmq_errno ()));
-                    //  Give handler one chance to handle error, then kill
-                    //  poller because it'll disrupt the reactor otherwise.
-                    if (poller->errors++) {
-                        zloop_poller_end (self, &poller->item);
+        if (self->wheel && rc != -1)
+            rc = s_wheel_expire (self, time_now / 1000);
+
+        //  Handle any readers and pollers that are ready. Handlers may add
+        //  and cancel readers and pollers as we go. New items have no events
+        //  yet. When an item is cancelled, the last item moves into its
+        //  slot, so we never call a cancelled handler; a moved item that
+        //  lands below the current slot is serviced on the next pass. With
+        //  more than one priority in use, we first sort the ready items by
+        //  priority, and clear events as we go, so that an item that moves
+        //  to a slot we have yet to reach is not called twice. With epoll,
+        //  the ready list is already in priority order.
+        if (self->epoll_handle == -1 && s_priority_levels (self) <= 1) {
+            size_t item_nbr;
+            for (item_nbr = 0; item_nbr < self->poll_size && rc >= 0; item_nbr++)
+                rc = s_pollset_dispatch (self, item_nbr);
+        }
+        else
+        if (self->epoll_handle == -1) {
+            if (rc >= 0 && s_pollset_sort (self))
+                rc = -1;
+            size_t ready_nbr;
+            for (ready_nbr = 0; ready_nbr < self->ready_size && rc >= 0; ready_nbr++) {
+                size_t item_nbr = self->ready [ready_nbr].key;
+                if (item_nbr < self->poll_size && self->pollset [item_nbr].revents) {
+                    rc = s_pollset_dispatch (self, item_nbr);
+                    if (item_nbr < self->poll_size)
                         self->pollset [item_nbr].revents = 0;
-                    }
-                }
-                else
-                    poller->errors = 0;     //  A non-error happened
-
-                if (self->pollset [item_nbr].revents) {
-                    if (self->verbose)
-                        zsys_debug ("zloop: call %s socket handler (%p, %d)",
-                                    poller->item.socket ?
-                                    zsys_sockname (zsock_type (poller->item.socket)) : "FD",
-                                    poller->item.socket, poller->item.fd);
-                    rc = poller->handler (self, &self->pollset [item_nbr], poller->arg);
-                    if (rc == -1 || self->need_rebuild)
-                        break;
                 }
             }
+            self->ready_size = 0;
         }
-        //  Now handle any timer zombies
-        //  This is going to be slow if we have many timers; we might use
-        //  a faster lookup on the timer list.
-        while (zlistx_first (self->zombies)) {
-            //  Get timer_id back from pointer
-            ptrdiff_t timer_id = (byte *) zlistx_detach (self->zombies, NULL) - (byte *) NULL;
-            s_timer_remove (self, (int) timer_id);
-        }
+#if defined (ZLOOP_EPOLL)
+        else
+            rc = s_epoll_dispatch (self, rc);
+#endif
         if (rc == -1)
             break;
+
+        //  If a handler was called too late, shed low-priority readers for
+        //  a while
+        if (self->overload && self->pass_lag > self->overload) {
+            if (!self->shedding && self->verbose)
+                zsys_debug ("zloop: overloaded, lag was %d msecs",
+                            (int) (self->pass_lag / 1000));
+            self->shed_until = zclock_usecs () + self->overload;
+            self->shedding = true;
+        }
     }
     self->terminated = true;
     return rc;
@@ -896,6 +2647,192 @@ s_socket_event (zloop_t *loop, zsock_t *handle, void *arg)
     return -1;
 }
 
+static int
+s_timer_event_once (zloop_t *loop, int timer_id, void *called)
+{
+    //  Repeating timer cancels itself on first call
+    (*((int *) called))++;
+    return zloop_timer_end (loop, timer_id);
+}
+
+static int
+s_socket_event_cancel (zloop_t *loop, zsock_t *reader, void *other)
+{
+    //  Read message and cancel the other reader, which is also ready
+    char *message = zstr_recv (reader);
+    assert (message);
+    zstr_free (&message);
+    zloop_reader_end (loop, (zsock_t *) other);
+    return 0;
+}
+
+static int
+s_socket_event_count (zloop_t *loop, zsock_t *reader, void *count)
+{
+    //  Read one message only, leaving any others for the next call
+    char *message = zstr_recv (reader);
+    assert (message);
+    zstr_free (&message);
+    (*((int *) count))++;
+    return 0;
+}
+
+static int
+s_socket_event_relay (zloop_t *loop, zsock_t *reader, void *sockets)
+{
+    //  Read request, have the worker reply to the backend, and then send
+    //  the request on the backend, as a broker would. Sending on the
+    //  backend can consume its signal, so we ask the reactor to check it
+    char *message = zstr_recv (reader);
+    assert (message);
+    zstr_free (&message);
+    zstr_send (((zsock_t **) sockets) [0], "REPLY");
+    zstr_send (((zsock_t **) sockets) [1], "REQUEST");
+    zloop_reader_rearm (loop, ((zsock_t **) sockets) [1]);
+    return 0;
+}
+
+static int
+s_socket_event_reply (zloop_t *loop, zsock_t *reader, void *replied)
+{
+    //  Read the reply and end the reactor
+    char *message = zstr_recv (reader);
+    assert (message);
+    *((bool *) replied) = streq (message, "REPLY");
+    zstr_free (&message);
+    return -1;
+}
+
+static int
+s_socket_event_seen (zloop_t *loop, zsock_t *reader, void *count)
+{
+    //  Read message and note how many calls the batching reader had
+    char *message = zstr_recv (reader);
+    assert (message);
+    zstr_free (&message);
+    ((int *) count) [1] = ((int *) count) [0];
+    return 0;
+}
+
+static int
+s_socket_event_order (zloop_t *loop, zsock_t *reader, void *order)
+{
+    //  Read message and append it to the order of calls
+    char *message = zstr_recv (reader);
+    assert (message);
+    strcat ((char *) order, message);
+    zstr_free (&message);
+    return 0;
+}
+
+static int
+s_timer_event_end (zloop_t *loop, int timer_id, void *arg)
+{
+    //  Cancel this timer and end the reactor
+    zloop_timer_end (loop, timer_id);
+    return -1;
+}
+
+static int
+s_socket_event_last (zloop_t *loop, zsock_t *reader, void *count)
+{
+    //  Read message, and end the reactor on a later pass, so the rest of
+    //  this pass still runs
+    char *message = zstr_recv (reader);
+    assert (message);
+    zstr_free (&message);
+    (*((int *) count))++;
+    zloop_timer (loop, 1, 1, s_timer_event_end, NULL);
+    return 0;
+}
+
+static int
+s_socket_event_slow (zloop_t *loop, zsock_t *reader, void *count)
+{
+    //  Take long enough to overload the reactor, then read message and end
+    //  the reactor on a later pass
+    zclock_sleep (35);
+    return s_socket_event_last (loop, reader, count);
+}
+
+//  Send as many messages as the socket takes without blocking, out of 20
+//  in all, then stop waiting for output
+
+static int
+s_socket_event_produce (zloop_t *loop, zsock_t *writer, void *produce)
+{
+    int *counts = (int *) produce;
+    counts [1]++;               //  Handler calls
+    while (counts [0] < 20 && zstr_send (writer, "DATA") == 0)
+        counts [0]++;           //  Messages sent
+    if (counts [0] == 20)
+        zloop_reader_set_events (loop, writer, 0);
+    return 0;
+}
+
+static int
+s_socket_event_consume (zloop_t *loop, zsock_t *reader, void *received)
+{
+    char *message = zstr_recv (reader);
+    zstr_free (&message);
+    //  End the reactor once we have all messages
+    return ++*((int *) received) == 20? -1: 0;
+}
+
+//  Posting test, shared by reactor and posting thread
+
+typedef struct {
+    zloop_t *loop;
+    int count;
+} s_post_test_t;
+
+static int
+s_post_event (zloop_t *loop, void *arg)
+{
+    //  Count callback, and end the reactor on the last one
+    s_post_test_t *test = (s_post_test_t *) arg;
+    return ++test->count == 1000? -1: 0;
+}
+
+static void
+s_post_actor (zsock_t *pipe, void *arg)
+{
+    //  Post callbacks to the reactor from another thread
+    s_post_test_t *test = (s_post_test_t *) arg;
+    zsock_signal (pipe, 0);
+    int post_nbr;
+    for (post_nbr = 0; post_nbr < 1000; post_nbr++) {
+        int rc = zloop_post (test->loop, s_post_event, test);
+        assert (rc == 0);
+    }
+    //  Wait for $TERM from zactor_destroy
+    char *command = zstr_recv (pipe);
+    zstr_free (&command);
+}
+
+static int
+s_timer_event_usecs (zloop_t *loop, int timer_id, void *fired)
+{
+    //  Note when the timer went off
+    *((int64_t *) fired) = zclock_usecs ();
+    return 0;
+}
+
+static int
+s_ticket_event_count (zloop_t *loop, int timer_id, void *count)
+{
+    (*((int *) count))++;
+    return 0;
+}
+
+static int
+s_ticket_event_delete (zloop_t *loop, int timer_id, void *other)
+{
+    //  Delete another ticket which is due at the same time
+    zloop_ticket_delete (loop, *((void **) other));
+    return 0;
+}
+
 static int
 s_timer_event3 (zloop_t *loop, int timer_id, void *called)
 {
@@ -904,6 +2841,23 @@ s_timer_event3 (zloop_t *loop, int timer_id, void *called)
     return -1;
 }
 
+//  Check that every timer expires no earlier than its parent in the heap,
+//  and that each timer knows its own position
+
+static bool
+s_timer_heap_valid (zloop_t *loop)
+{
+    size_t index;
+    for (index = 0; index < loop->timers_size; index++) {
+        if (loop->timers [index]->heap_index != index)
+            return false;
+        if (index > 0
+        &&  s_timer_comparator (loop->timers [(index - 1) / 2], loop->timers [index]) > 0)
+            return false;
+    }
+    return true;
+}
+
 void
 zloop_test (bool verbose)
 {
@@ -964,6 +2918,461 @@ zloop_test (bool verbose)
     //  zloop runs the handler which will terminate the loop
     assert (timer_event_called);
     zsys_interrupted = 0;
+    zloop_destroy (&loop);
+
+    //  Check timer heap stays ordered with many timers
+    loop = zloop_new ();
+    assert (loop);
+    int timer_nbr;
+    for (timer_nbr = 0; timer_nbr < 100000; timer_nbr++) {
+        rc = zloop_timer (loop, 1000 + randof (100000), 1, s_timer_event, NULL);
+        assert (rc != -1);
+    }
+    assert (loop->timers_size == 100000);
+    assert (s_timer_heap_valid (loop));
+
+    //  Cancel every third timer; timer ids in a new reactor start at 1
+    for (timer_nbr = 0; timer_nbr < 100000; timer_nbr += 3)
+        zloop_timer_end (loop, timer_nbr + 1);
+    assert (loop->timers_size == 66666);
+    assert (zhashx_size (loop->timer_ids) == 66666);
+    assert (s_timer_heap_valid (loop));
+
+    //  Take timers off the top of the heap; they must come in order
+    int64_t last_when = 0;
+    while (loop->timers_size) {
+        s_timer_t *timer = loop->timers [0];
+        assert (timer->when >= last_when);
+        last_when = timer->when;
+        s_timer_remove (loop, timer->timer_id);
+    }
+    assert (zhashx_size (loop->timer_ids) == 0);
+    zloop_destroy (&loop);
+
+    //  Check tickets with their own delays; deleted tickets and tickets
+    //  with the long default delay must not fire
+    loop = zloop_new ();
+    assert (loop);
+    zloop_set_ticket_delay (loop, 10000);
+    int ticket_count = 0;
+    int ticket_nbr;
+    for (ticket_nbr = 0; ticket_nbr < 3000; ticket_nbr++) {
+        void *ticket = zloop_ticket (loop, s_ticket_event_count, &ticket_count);
+        assert (ticket);
+        if (ticket_nbr % 3 == 0)
+            zloop_ticket_delete (loop, ticket);
+        else
+        if (ticket_nbr % 3 == 1)
+            zloop_ticket_set_delay (loop, ticket, 1 + randof (20));
+    }
+    //  A ticket that deletes another ticket due in the same msec
+    void *deleted_ticket = NULL;
+    zloop_set_ticket_delay (loop, 5);
+    zloop_ticket (loop, s_ticket_event_delete, &deleted_ticket);
+    deleted_ticket = zloop_ticket (loop, s_ticket_event_count, &ticket_count);
+    timer_event_called = false;
+    zloop_timer (loop, 50, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (ticket_count == 1000);
+    //  The wheel still knows when the long tickets expire
+    assert (loop->ticket_next > loop->wheel_time);
+    assert (loop->ticket_next <= loop->wheel_time + 10000);
+    zloop_destroy (&loop);
+
+    //  Check a timer can cancel itself from its own handler
+    loop = zloop_new ();
+    assert (loop);
+    int once_called = 0;
+    zloop_timer (loop, 1, 0, s_timer_event_once, &once_called);
+    timer_event_called = false;
+    zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (once_called == 1);
+    //  Only the timer that ended the reactor is left
+    assert (loop->timers_size == 1);
+    assert (zhashx_size (loop->timer_ids) == 1);
+    zloop_destroy (&loop);
+
+    //  Check a handler can cancel another ready reader; the reactor must
+    //  not call the cancelled reader, and must keep dispatching
+    loop = zloop_new ();
+    assert (loop);
+    zsock_t *output2 = zsock_new_pair ("@inproc://zloop.test2");
+    assert (output2);
+    zsock_t *input2 = zsock_new_pair (">inproc://zloop.test2");
+    assert (input2);
+    zsock_t *output3 = zsock_new_pair ("@inproc://zloop.test3");
+    assert (output3);
+    zsock_t *input3 = zsock_new_pair (">inproc://zloop.test3");
+    assert (input3);
+    zloop_reader (loop, input2, s_socket_event_cancel, input3);
+    zloop_reader (loop, input3, s_socket_event_cancel, input2);
+    assert (zlistx_size (loop->readers) == 2);
+    zstr_send (output2, "PING");
+    zstr_send (output3, "PING");
+    timer_event_called = false;
+    zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (zlistx_size (loop->readers) == 1);
+
+    //  Exactly one of the two messages is left unread
+    char *message2 = zstr_recv_nowait (input2);
+    char *message3 = zstr_recv_nowait (input3);
+    assert ((message2 == NULL) != (message3 == NULL));
+    zstr_free (&message2);
+    zstr_free (&message3);
+    zsock_destroy (&input2);
+    zsock_destroy (&output2);
+    zsock_destroy (&input3);
+    zsock_destroy (&output3);
+    zloop_destroy (&loop);
+
+    //  Check the epoll backend, where the platform has it. Messages sent
+    //  before we start must be read, as must messages left behind by a
+    //  handler, though the socket signals only once. Registering the same
+    //  socket twice needs two epoll registrations.
+    loop = zloop_new ();
+    assert (loop);
+    if (zloop_set_epoll (loop, true) == 0) {
+        output2 = zsock_new_pair ("@inproc://zloop.test4");
+        assert (output2);
+        input2 = zsock_new_pair (">inproc://zloop.test4");
+        assert (input2);
+        //  Each pass calls both readers, so send an even number of messages
+        int count;
+        for (count = 0; count < 4; count++)
+            zstr_send (output2, "PING");
+        count = 0;
+        zloop_reader (loop, input2, s_socket_event_count, &count);
+        zloop_reader (loop, input2, s_socket_event_count, &count);
+        timer_event_called = false;
+        timer_id = zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+        zloop_start (loop);
+        assert (timer_event_called);
+        assert (count == 4);
+        zloop_timer_end (loop, timer_id);
+        //  Two readers, and the wakeup signal for posts
+        assert (zhashx_size (loop->watches) == 3);
+
+        //  Switching back to zmq_poll keeps the readers
+        zloop_set_epoll (loop, false);
+        assert (zhashx_size (loop->watches) == 0);
+        zstr_send (output2, "PING");
+        zstr_send (output2, "PING");
+        zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+        zloop_start (loop);
+        assert (count == 6);
+        zloop_reader_end (loop, input2);
+        assert (zlistx_size (loop->readers) == 0);
+        zsock_destroy (&input2);
+        zsock_destroy (&output2);
+    }
+
+    zloop_destroy (&loop);
+
+    //  With epoll, a handler that sends on another reader's socket can
+    //  consume that socket's signal, as a broker does when a reply is
+    //  already waiting on its backend. Once the handler rearms the reader,
+    //  the reactor must still read it.
+    loop = zloop_new ();
+    assert (loop);
+    if (zloop_set_epoll (loop, true) == 0) {
+        output2 = zsock_new_pair ("@inproc://zloop.test4");
+        assert (output2);
+        input2 = zsock_new_pair (">inproc://zloop.test4");
+        assert (input2);
+        zsock_t *sockets [2];
+        sockets [0] = zsock_new_pair ("@inproc://zloop.test5");
+        assert (sockets [0]);
+        sockets [1] = zsock_new_pair (">inproc://zloop.test5");
+        assert (sockets [1]);
+        bool replied = false;
+        zloop_reader (loop, input2, s_socket_event_relay, sockets);
+        zloop_reader (loop, sockets [1], s_socket_event_reply, &replied);
+        timer_id = zloop_timer (loop, 1000, 1, s_timer_event3, &timer_event_called);
+        zstr_send (output2, "REQUEST");
+        zloop_start (loop);
+        assert (replied);
+        zloop_timer_end (loop, timer_id);
+        char *request = zstr_recv (sockets [0]);
+        assert (streq (request, "REQUEST"));
+        zstr_free (&request);
+        zsock_destroy (&sockets [0]);
+        zsock_destroy (&sockets [1]);
+        zsock_destroy (&input2);
+        zsock_destroy (&output2);
+    }
+    zloop_destroy (&loop);
+
+    //  Check a batching reader drains up to its budget in one pass, and
+    //  then lets the next reader run
+    loop = zloop_new ();
+    assert (loop);
+    output2 = zsock_new_pair ("@inproc://zloop.test5");
+    assert (output2);
+    input2 = zsock_new_pair (">inproc://zloop.test5");
+    assert (input2);
+    output3 = zsock_new_pair ("@inproc://zloop.test6");
+    assert (output3);
+    input3 = zsock_new_pair (">inproc://zloop.test6");
+    assert (input3);
+    int counts [2] = { 0, 0 };
+    zloop_reader (loop, input2, s_socket_event_count, &counts [0]);
+    zloop_reader_set_batch (loop, input2, 4, 0);
+    zloop_reader (loop, input3, s_socket_event_seen, counts);
+    int msg_nbr;
+    for (msg_nbr = 0; msg_nbr < 10; msg_nbr++)
+        zstr_send (output2, "PING");
+    zstr_send (output3, "PING");
+    timer_event_called = false;
+    zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (counts [0] == 10);
+    assert (counts [1] == 4);
+    zsock_destroy (&input2);
+    zsock_destroy (&output2);
+    zsock_destroy (&input3);
+    zsock_destroy (&output3);
+
+    zloop_destroy (&loop);
+
+    //  Check statistics on handlers and timer lag
+    loop = zloop_new ();
+    assert (loop);
+    assert (zloop_stats (loop) == NULL);
+    zloop_set_stats (loop, true);
+    zloop_set_watchdog (loop, 1000);
+    output2 = zsock_new_pair ("@inproc://zloop.test7");
+    assert (output2);
+    input2 = zsock_new_pair (">inproc://zloop.test7");
+    assert (input2);
+    counts [0] = 0;
+    zloop_reader (loop, input2, s_socket_event_count, &counts [0]);
+    zstr_send (output2, "PING");
+    zstr_send (output2, "PING");
+    int64_t fired = 0;
+    zloop_timer (loop, 5, 1, s_timer_event_usecs, &fired);
+    timer_event_called = false;
+    zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (fired);
+    assert (timer_event_called);
+    zmsg_t *stats = zloop_stats (loop);
+    assert (stats);
+    //  Timer lag, then reader, then timer, then ended timers, six frames
+    //  each; the timer that ended the reactor is still registered
+    assert (zmsg_size (stats) == 24);
+    char *kind = zmsg_popstr (stats);
+    assert (streq (kind, "lag"));
+    zstr_free (&kind);
+    zframe_t *frame = zmsg_pop (stats);
+    zframe_destroy (&frame);
+    char *calls = zmsg_popstr (stats);
+    assert (streq (calls, "2"));
+    zstr_free (&calls);
+    frame = zmsg_pop (stats);
+    zframe_destroy (&frame);
+    frame = zmsg_pop (stats);
+    zframe_destroy (&frame);
+    frame = zmsg_pop (stats);
+    zframe_destroy (&frame);
+    kind = zmsg_popstr (stats);
+    assert (streq (kind, "reader"));
+    zstr_free (&kind);
+    char *name = zmsg_popstr (stats);
+    assert (streq (name, "PAIR"));
+    zstr_free (&name);
+    calls = zmsg_popstr (stats);
+    assert (streq (calls, "2"));
+    zstr_free (&calls);
+    while (zmsg_size (stats) > 6) {
+        frame = zmsg_pop (stats);
+        zframe_destroy (&frame);
+    }
+    kind = zmsg_popstr (stats);
+    assert (streq (kind, "timer"));
+    zstr_free (&kind);
+    name = zmsg_popstr (stats);
+    assert (streq (name, "ended"));
+    zstr_free (&name);
+    calls = zmsg_popstr (stats);
+    assert (streq (calls, "1"));
+    zstr_free (&calls);
+    zmsg_destroy (&stats);
+    zsock_destroy (&input2);
+    zsock_destroy (&output2);
+
+    zloop_destroy (&loop);
+
+    //  Check a microsecond timer goes off no earlier than due
+    loop = zloop_new ();
+    assert (loop);
+    int64_t started = zclock_usecs ();
+    fired = 0;
+    zloop_timer_us (loop, 500, 1, s_timer_event_usecs, &fired);
+    timer_event_called = false;
+    timer_id = zloop_timer_us (loop, 800, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (fired >= started + 500);
+    zloop_timer_end (loop, timer_id);
+
+    //  Check a timer with slack shares a later timer's wakeup
+    started = zclock_usecs ();
+    fired = 0;
+    timer_id = zloop_timer (loop, 10, 1, s_timer_event_usecs, &fired);
+    rc = zloop_timer_set_slack (loop, timer_id, 30000);
+    assert (rc == 0);
+    timer_event_called = false;
+    zloop_timer (loop, 25, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (fired >= started + 20000);
+    assert (zloop_timer_set_slack (loop, -2, 0) == -1);
+    //  The slack timer has gone, so collection no longer allows for it
+    assert (loop->max_slack_timers == 0);
+    zloop_start (loop);
+    assert (loop->max_slack == 0);
+    //  A later deadline does not set the timerfd again
+    int64_t armed = loop->timer_armed;
+    s_tickless (loop);
+    assert (loop->timer_armed == armed);
+    zloop_destroy (&loop);
+
+    //  Check higher-priority readers are serviced first, with zmq_poll and
+    //  with epoll if we have it
+    loop = zloop_new ();
+    assert (loop);
+    output2 = zsock_new_pair ("@inproc://zloop.test8");
+    assert (output2);
+    input2 = zsock_new_pair (">inproc://zloop.test8");
+    assert (input2);
+    output3 = zsock_new_pair ("@inproc://zloop.test9");
+    assert (output3);
+    input3 = zsock_new_pair (">inproc://zloop.test9");
+    assert (input3);
+    char order [8] = "";
+    zloop_reader (loop, input2, s_socket_event_order, order);
+    zloop_reader (loop, input3, s_socket_event_order, order);
+    zloop_reader_set_priority (loop, input3, 1);
+    zstr_send (output2, "B");
+    zstr_send (output3, "C");
+    timer_event_called = false;
+    timer_id = zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+    zloop_start (loop);
+    assert (timer_event_called);
+    assert (streq (order, "CB"));
+    zloop_timer_end (loop, timer_id);
+    if (zloop_set_epoll (loop, true) == 0) {
+        order [0] = 0;
+        zstr_send (output2, "B");
+        zstr_send (output3, "C");
+        timer_id = zloop_timer (loop, 20, 1, s_timer_event3, &timer_event_called);
+        zloop_start (loop);
+        assert (streq (order, "CB"));
+        zloop_timer_end (loop, timer_id);
+        zloop_set_epoll (loop, false);
+    }
+    zloop_reader_end (loop, input2);
+    zloop_reader_end (loop, input3);
+    assert (loop->priorities [0] == 1);     //  Wakeup for posts
+    assert (loop->priorities [1] == 0);
+
+    //  Check a timer that fires later than the overload limit overloads
+    //  the reactor. The reader sleeps past the limit and so delays the
+    //  timer, so this does not depend on how busy the host is.
+    counts [0] = counts [1] = 0;
+    zloop_reader (loop, input2, s_socket_event_slow, &counts [0]);
+    zloop_set_overload (loop, 30, 1);
+    fired = 0;
+    zloop_timer (loop, 1, 1, s_timer_event_usecs, &fired);
+    started = zclock_usecs ();
+    zstr_send (output2, "PING");
+    zloop_start (loop);
+    assert (counts [0] == 1);
+    assert (fired - started >= 35000);
+    assert (loop->shed_until);
+
+    //  While overloaded, the reactor sheds low-priority readers, and still
+    //  services high-priority readers. We hold the overload for as long as
+    //  the test needs, rather than racing its end.
+    zloop_reader (loop, input3, s_socket_event_last, &counts [1]);
+    zloop_reader_set_priority (loop, input3, 1);
+    loop->shedding = true;
+    loop->shed_until = zclock_usecs () + 60 * 1000000;
+    zstr_send (output2, "PING");
+    zstr_send (output3, "PING");
+    zloop_start (loop);
+    assert (counts [0] == 1);
+    assert (counts [1] == 1);
+
+    //  When the overload ends, the shed reader gets its input
+    loop->shed_until = zclock_usecs ();
+    zloop_start (loop);
+    assert (counts [0] == 2);
+    zsock_destroy (&input2);
+    zsock_destroy (&output2);
+    zsock_destroy (&input3);
+    zsock_destroy (&output3);
+    zloop_destroy (&loop);
+
+    //  Check a producer can wait for output when it hits the high-water
+    //  mark, with zmq_poll and with epoll if we have it
+    loop = zloop_new ();
+    assert (loop);
+    zsock_t *producer = zsock_new (ZMQ_PUSH);
+    assert (producer);
+    zsock_set_sndhwm (producer, 1);
+    zsock_set_sndtimeo (producer, 0);
+    rc = zsock_bind (producer, "inproc://zloop.test10");
+    assert (rc == 0);
+    zsock_t *consumer = zsock_new (ZMQ_PULL);
+    assert (consumer);
+    zsock_set_rcvhwm (consumer, 1);
+    rc = zsock_connect (consumer, "inproc://zloop.test10");
+    assert (rc == 0);
+    int backend;
+    for (backend = 0; backend < 2; backend++) {
+        if (backend == 1 && zloop_set_epoll (loop, true))
+            break;
+        int produce [2] = { 0, 0 };
+        int received = 0;
+        zloop_reader (loop, producer, s_socket_event_produce, produce);
+        zloop_reader_set_events (loop, producer, ZMQ_POLLOUT);
+        zloop_reader (loop, consumer, s_socket_event_consume, &received);
+        timer_event_called = false;
+        timer_id = zloop_timer (loop, 1000, 1, s_timer_event3, &timer_event_called);
+        rc = zloop_start (loop);
+        assert (rc == -1);
+        assert (!timer_event_called);
+        assert (received == 20);
+        assert (produce [0] == 20);
+        //  The producer waited for the consumer more than once
+        assert (produce [1] > 1);
+        zloop_timer_end (loop, timer_id);
+        zloop_reader_end (loop, producer);
+        zloop_reader_end (loop, consumer);
+    }
+    zsock_destroy (&producer);
+    zsock_destroy (&consumer);
+    zloop_destroy (&loop);
+
+    //  Check callbacks posted from another thread all run in the reactor
+    loop = zloop_new ();
+    assert (loop);
+    if (loop->post_fd [0] != -1) {
+        s_post_test_t post_test = { loop, 0 };
+        zactor_t *poster = zactor_new (s_post_actor, &post_test);
+        assert (poster);
+        rc = zloop_start (loop);
+        assert (rc == -1);
+        assert (post_test.count == 1000);
+        zactor_destroy (&poster);
+    }
 
     //  cleanup
     zloop_destroy (&loop);
@@ -0,0 +1,559 @@
+/*  =========================================================================
+    zloop_pool - pool of reactors, each on its own thread
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zloop_pool class runs a number of zloop reactors, each on its own
+    thread, so an application can spread its sockets over several cores.
+    Each loop is an ordinary zloop, and its handlers use the usual zloop
+    API to add readers and timers to their own loop.
+@discuss
+    Create the pool, configure its loops, and start it. Before you start
+    the pool, you can work with each loop directly. After that, each loop
+    belongs to its own thread, and you can only reach it by registering
+    readers through the pool, or by posting callbacks to it. The loop then
+    calls these from its own thread. A socket registered with a loop
+    belongs to that loop's thread until it is cancelled.
+
+    To choose a loop for a new socket, use zloop_pool_shard to hash a key,
+    such as a client identity, so the same key always gets the same loop,
+    or use zloop_pool_least_loaded to pick the loop with fewest readers.
+    On Linux, you can pin each loop's thread to a CPU.
+
+    On Windows, zloop_post is not supported, so you can only register and
+    cancel readers before you start the pool.
+@end
+*/
+
+//  We need CPU affinity functions, which glibc only declares on request
+#if defined (__linux__) && !defined (_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+#include "../include/czmq.h"
+
+//  The reactor thread counts its readers and flags when it has ended, and
+//  other threads read these, so we use atomic operations on them
+#if defined (__WINDOWS__)
+#   define s_atomic_add(ptr,value) InterlockedExchangeAdd ((LONG volatile *) (ptr), (value))
+#else
+#   define s_atomic_add(ptr,value) __sync_fetch_and_add ((ptr), (value))
+#endif
+#define s_atomic_get(ptr) s_atomic_add ((ptr), 0)
+
+//  While we wait for a reactor to handle a request, we check this often
+//  (msecs) whether the reactor has ended
+#define REQUEST_CHECK           100
+
+//  Each loop in the pool, with the thread that runs it
+
+typedef struct {
+    zloop_t *loop;              //  Reactor for this thread
+    zactor_t *actor;            //  Thread running reactor, once started
+    int cpu;                    //  CPU to pin thread to, or -1
+    long readers;               //  Readers registered through pool
+    long stopped;               //  Non-zero once the reactor has ended
+} s_shard_t;
+
+//  Structure of our class
+
+struct _zloop_pool_t {
+    s_shard_t *shards;          //  Loops in pool
+    size_t size;                //  Number of loops
+    bool started;               //  True once threads are running
+};
+
+//  A reader registration or cancellation, posted to a loop
+
+typedef struct {
+    s_shard_t *shard;           //  Loop to register with
+    zsock_t *sock;              //  Socket to read from
+    zloop_reader_fn *handler;   //  Function to execute
+    void *arg;                  //  Application argument to reader
+    zsock_t *done;              //  Signal when handled, if waiting
+    int rc;                     //  Result of request
+} s_request_t;
+
+
+//  --------------------------------------------------------------------------
+//  Create a new pool of the specified number of reactors. The reactors do
+//  not run until you call zloop_pool_start.
+
+zloop_pool_t *
+zloop_pool_new (size_t size)
+{
+    assert (size > 0);
+    zloop_pool_t *self = (zloop_pool_t *) zmalloc (sizeof (zloop_pool_t));
+    if (!self)
+        return NULL;
+
+    self->shards = (s_shard_t *) zmalloc (size * sizeof (s_shard_t));
+    if (self->shards) {
+        size_t shard_nbr;
+        for (shard_nbr = 0; shard_nbr < size; shard_nbr++) {
+            self->shards [shard_nbr].cpu = -1;
+            self->shards [shard_nbr].loop = zloop_new ();
+            if (!self->shards [shard_nbr].loop)
+                break;
+            self->size++;
+        }
+    }
+    if (self->size < size)
+        zloop_pool_destroy (&self);
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a pool. Stops all reactors, and waits for their threads to end.
+
+void
+zloop_pool_destroy (zloop_pool_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zloop_pool_t *self = *self_p;
+        size_t shard_nbr;
+        for (shard_nbr = 0; shard_nbr < self->size; shard_nbr++)
+            zactor_destroy (&self->shards [shard_nbr].actor);
+        for (shard_nbr = 0; shard_nbr < self->size; shard_nbr++)
+            zloop_destroy (&self->shards [shard_nbr].loop);
+        free (self->shards);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of reactors in the pool
+
+size_t
+zloop_pool_size (zloop_pool_t *self)
+{
+    assert (self);
+    return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the reactor with the specified index, from 0 to size - 1. Until
+//  you start the pool, you may configure the reactor, and register readers,
+//  pollers, and timers with it. After that, only use the reactor from its
+//  own handlers, or through zloop_post.
+
+zloop_t *
+zloop_pool_loop (zloop_pool_t *self, size_t index)
+{
+    assert (self);
+    assert (index < self->size);
+    return self->shards [index].loop;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pin the thread for the specified reactor to a CPU, when the pool starts.
+//  Set cpu to -1 to let the thread run on any CPU, which is the default.
+//  Pinning is only supported on Linux, and is ignored elsewhere. Call this
+//  before zloop_pool_start.
+
+void
+zloop_pool_set_cpu (zloop_pool_t *self, size_t index, int cpu)
+{
+    assert (self);
+    assert (index < self->size);
+    assert (!self->started);
+    self->shards [index].cpu = cpu;
+}
+
+
+//  Pin the calling thread to a CPU, if we can
+
+static void
+s_shard_pin (int cpu)
+{
+#if defined (__UTYPE_LINUX) && defined (CPU_SET)
+    cpu_set_t cpus;
+    CPU_ZERO (&cpus);
+    CPU_SET (cpu, &cpus);
+    int rc = pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus);
+    if (rc)
+        zsys_warning ("zloop_pool: can't pin thread to CPU %d: %s",
+                      cpu, strerror (rc));
+#endif
+}
+
+//  Handle a command from the pool, which is only ever $TERM
+
+static int
+s_shard_command (zloop_t *loop, zsock_t *pipe, void *arg)
+{
+    char *command = zstr_recv (pipe);
+    bool terminate = !command || streq (command, "$TERM");
+    zstr_free (&command);
+    return terminate? -1: 0;
+}
+
+//  Run one reactor until the pool is destroyed, or a handler ends it
+
+static void
+s_shard_actor (zsock_t *pipe, void *args)
+{
+    s_shard_t *shard = (s_shard_t *) args;
+    if (shard->cpu != -1)
+        s_shard_pin (shard->cpu);
+
+    //  Commands from the pool come first, even when the loop is busy
+    int rc = zloop_reader (shard->loop, pipe, s_shard_command, NULL);
+    if (rc == 0)
+        zloop_reader_set_priority (shard->loop, pipe, 7);
+    zsock_signal (pipe, 0);
+    if (rc == 0) {
+        zloop_start (shard->loop);
+        zloop_reader_end (shard->loop, pipe);
+    }
+    //  The reactor runs no more posted requests
+    s_atomic_add (&shard->stopped, 1);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Start each reactor on its own thread. Returns 0 if OK, -1 if a thread
+//  could not be started. The reactors run until you destroy the pool, or
+//  until a handler returns -1, which ends only that handler's reactor.
+//  Requests to a reactor that has ended return -1, except that
+//  zloop_pool_reader_end still cancels the reader.
+
+int
+zloop_pool_start (zloop_pool_t *self)
+{
+    assert (self);
+    assert (!self->started);
+    self->started = true;
+    size_t shard_nbr;
+    for (shard_nbr = 0; shard_nbr < self->size; shard_nbr++) {
+        s_shard_t *shard = &self->shards [shard_nbr];
+        shard->actor = zactor_new (s_shard_actor, shard);
+        if (!shard->actor)
+            return -1;
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the index of the reactor for a key, such as a client identity.
+//  The same key always gives the same reactor.
+
+size_t
+zloop_pool_shard (zloop_pool_t *self, const char *key)
+{
+    assert (self);
+    assert (key);
+    //  Bernstein hash, as zhashx uses for string keys
+    size_t key_hash = 0;
+    while (*key)
+        key_hash = 33 * key_hash ^ *key++;
+    return key_hash % self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the index of the reactor with fewest readers registered through
+//  the pool. If several reactors have the fewest, returns the first.
+
+size_t
+zloop_pool_least_loaded (zloop_pool_t *self)
+{
+    assert (self);
+    size_t least = 0;
+    size_t shard_nbr;
+    for (shard_nbr = 1; shard_nbr < self->size; shard_nbr++)
+        if (s_atomic_get (&self->shards [shard_nbr].readers)
+        <   s_atomic_get (&self->shards [least].readers))
+            least = shard_nbr;
+    return least;
+}
+
+
+//  Register or cancel a reader, on the reactor's own thread
+
+static int
+s_reader_add (zloop_t *loop, void *arg)
+{
+    s_request_t *request = (s_request_t *) arg;
+    request->rc = zloop_reader (loop, request->sock, request->handler, request->arg);
+    if (request->rc == 0)
+        s_atomic_add (&request->shard->readers, 1);
+    if (request->done)
+        zsock_signal (request->done, 0);
+    return 0;
+}
+
+static int
+s_reader_remove (zloop_t *loop, void *arg)
+{
+    s_request_t *request = (s_request_t *) arg;
+    zloop_reader_end (loop, request->sock);
+    if (s_atomic_get (&request->shard->readers))
+        s_atomic_add (&request->shard->readers, -1);
+    request->rc = 0;
+    if (request->done)
+        zsock_signal (request->done, 0);
+    return 0;
+}
+
+//  Run a request on its reactor, and wait until the reactor has done so.
+//  Before the pool starts, we run the request directly. A reactor that has
+//  ended runs no more requests, so we check for that while we wait, and
+//  don't wait for ever. Returns the result of the request, or -1 if the
+//  reactor did not run it.
+
+static int
+s_request_run (zloop_pool_t *self, s_request_t *request, zloop_post_fn handler)
+{
+    if (!self->started) {
+        handler (request->shard->loop, request);
+        return request->rc;
+    }
+    if (s_atomic_get (&request->shard->stopped))
+        return -1;
+
+    zsock_t *backend;
+    zsock_t *frontend = zsys_create_pipe (&backend);
+    if (!frontend)
+        return -1;
+    zsock_set_rcvtimeo (frontend, REQUEST_CHECK);
+    request->done = backend;
+    request->rc = -1;
+    if (zloop_post (request->shard->loop, handler, request) == 0) {
+        while (zsock_wait (frontend) == -1) {
+            if (s_atomic_get (&request->shard->stopped)) {
+                //  The reactor either ran our request before it ended,
+                //  or never will
+                zsock_set_rcvtimeo (frontend, 0);
+                if (zsock_wait (frontend) == -1)
+                    request->rc = -1;
+                break;
+            }
+        }
+    }
+    zsock_destroy (&frontend);
+    zsock_destroy (&backend);
+    return request->rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Register a socket reader with the specified reactor, and wait until the
+//  reactor has done so. The reactor's own thread calls the handler, as for
+//  zloop_reader, and the socket belongs to that thread until you cancel the
+//  reader. Do not call this from a handler in the pool: use zloop_reader on
+//  the handler's own reactor instead. Returns 0 if OK, -1 if the reactor
+//  could not register the reader, or has ended. On Windows, this works only
+//  until the pool starts.
+
+int
+zloop_pool_reader (zloop_pool_t *self, size_t index, zsock_t *sock, zloop_reader_fn handler, void *arg)
+{
+    assert (self);
+    assert (index < self->size);
+    assert (sock);
+
+    s_request_t request = { &self->shards [index], sock, handler, arg, NULL, 0 };
+    return s_request_run (self, &request, s_reader_add);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Cancel a socket reader from the specified reactor, and wait until the
+//  reactor has done so, after which the socket again belongs to the caller.
+//  Do not call this from a handler in the pool: use zloop_reader_end on the
+//  handler's own reactor instead. Returns 0 if OK, -1 if the request could
+//  not be passed to the reactor. If the reactor has ended, this cancels the
+//  reader directly, so do not call it for the same reactor from two threads
+//  at once. On Windows, this works only until the pool starts.
+
+int
+zloop_pool_reader_end (zloop_pool_t *self, size_t index, zsock_t *sock)
+{
+    assert (self);
+    assert (index < self->size);
+    assert (sock);
+
+    s_request_t request = { &self->shards [index], sock, NULL, NULL, NULL, 0 };
+    int rc = s_request_run (self, &request, s_reader_remove);
+    if (rc == -1 && s_atomic_get (&request.shard->stopped)) {
+        //  The reactor ended without running our request, and its thread
+        //  no longer uses the loop, so we cancel the reader ourselves
+        request.done = NULL;
+        s_reader_remove (request.shard->loop, &request);
+        rc = request.rc;
+    }
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Post a callback to the specified reactor, which calls it from its own
+//  thread, as for zloop_post. You may call this from any thread. Returns 0
+//  if OK, -1 if the callback could not be posted, or the reactor has ended.
+//  A callback posted just as the reactor ends is not called.
+
+int
+zloop_pool_post (zloop_pool_t *self, size_t index, zloop_post_fn handler, void *arg)
+{
+    assert (self);
+    assert (index < self->size);
+    if (s_atomic_get (&self->shards [index].stopped))
+        return -1;
+    return zloop_post (self->shards [index].loop, handler, arg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+static int
+s_echo_event (zloop_t *loop, zsock_t *reader, void *arg)
+{
+    //  Send message back with the name of the thread's reactor
+    char *message = zstr_recv (reader);
+    assert (message);
+    zstr_sendf (reader, "%s:%p", message, (void *) loop);
+    zstr_free (&message);
+    return 0;
+}
+
+static int
+s_post_event (zloop_t *loop, void *arg)
+{
+    //  Tell the test thread which reactor ran the callback
+    zstr_sendf ((zsock_t *) arg, "%p", (void *) loop);
+    return 0;
+}
+
+static int
+s_end_event (zloop_t *loop, void *arg)
+{
+    //  End the reactor
+    return -1;
+}
+
+void
+zloop_pool_test (bool verbose)
+{
+    printf (" * zloop_pool: ");
+
+    //  @selftest
+    zloop_pool_t *pool = zloop_pool_new (3);
+    assert (pool);
+    assert (zloop_pool_size (pool) == 3);
+    assert (zloop_pool_loop (pool, 0) != zloop_pool_loop (pool, 1));
+    zloop_pool_set_cpu (pool, 0, 0);
+
+    //  The same key always goes to the same reactor
+    size_t index = zloop_pool_shard (pool, "client-1");
+    assert (index < 3);
+    assert (zloop_pool_shard (pool, "client-1") == index);
+
+    //  Register one reader before and one after we start the pool, and
+    //  check each is served by the reactor we gave it to
+    zsock_t *client1 = zsock_new_pair ("@inproc://zloop_pool.test1");
+    assert (client1);
+    zsock_t *server1 = zsock_new_pair (">inproc://zloop_pool.test1");
+    assert (server1);
+    int rc = zloop_pool_reader (pool, zloop_pool_least_loaded (pool),
+                                server1, s_echo_event, NULL);
+    assert (rc == 0);
+    assert (zloop_pool_least_loaded (pool) == 1);
+
+    rc = zloop_pool_start (pool);
+    assert (rc == 0);
+
+    zsock_t *client2 = zsock_new_pair ("@inproc://zloop_pool.test2");
+    assert (client2);
+    zsock_t *server2 = zsock_new_pair (">inproc://zloop_pool.test2");
+    assert (server2);
+    rc = zloop_pool_reader (pool, 2, server2, s_echo_event, NULL);
+    assert (rc == 0);
+
+    char expected [64];
+    zstr_send (client1, "ping");
+    char *reply = zstr_recv (client1);
+    snprintf (expected, sizeof (expected), "ping:%p", (void *) zloop_pool_loop (pool, 0));
+    assert (streq (reply, expected));
+    zstr_free (&reply);
+
+    zstr_send (client2, "ping");
+    reply = zstr_recv (client2);
+    snprintf (expected, sizeof (expected), "ping:%p", (void *) zloop_pool_loop (pool, 2));
+    assert (streq (reply, expected));
+    zstr_free (&reply);
+
+    //  Posted callbacks run on the reactor we post to
+    zsock_t *backend;
+    zsock_t *frontend = zsys_create_pipe (&backend);
+    assert (frontend);
+    rc = zloop_pool_post (pool, 1, s_post_event, backend);
+    assert (rc == 0);
+    reply = zstr_recv (frontend);
+    snprintf (expected, sizeof (expected), "%p", (void *) zloop_pool_loop (pool, 1));
+    assert (streq (reply, expected));
+    zstr_free (&reply);
+    zsock_destroy (&frontend);
+    zsock_destroy (&backend);
+
+    //  Once cancelled, the sockets are ours again
+    rc = zloop_pool_reader_end (pool, 0, server1);
+    assert (rc == 0);
+    rc = zloop_pool_reader_end (pool, 2, server2);
+    assert (rc == 0);
+    zsock_destroy (&server1);
+    zsock_destroy (&client1);
+    zsock_destroy (&server2);
+    zsock_destroy (&client2);
+
+    //  A request behind a callback that ends its reactor is never run, so
+    //  we get an error rather than wait for ever, as we do for requests to
+    //  that reactor from then on
+    server1 = zsock_new_pair (">inproc://zloop_pool.test3");
+    assert (server1);
+    server2 = zsock_new_pair (">inproc://zloop_pool.test4");
+    assert (server2);
+    rc = zloop_pool_reader (pool, 0, server2, s_echo_event, NULL);
+    assert (rc == 0);
+    rc = zloop_pool_reader (pool, 1, server1, s_echo_event, NULL);
+    assert (rc == 0);
+    assert (zloop_pool_least_loaded (pool) == 2);
+    rc = zloop_pool_post (pool, 1, s_end_event, NULL);
+    assert (rc == 0);
+    rc = zloop_pool_reader (pool, 1, server1, s_echo_event, NULL);
+    assert (rc == -1);
+    rc = zloop_pool_post (pool, 1, s_end_event, NULL);
+    assert (rc == -1);
+
+    //  We can still cancel a reader on a reactor that has ended
+    rc = zloop_pool_reader_end (pool, 1, server1);
+    assert (rc == 0);
+    assert (zloop_pool_least_loaded (pool) == 1);
+    rc = zloop_pool_reader_end (pool, 0, server2);
+    assert (rc == 0);
+    zsock_destroy (&server1);
+    zsock_destroy (&server2);
+
+    zloop_pool_destroy (&pool);
+    assert (pool == NULL);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -39,14 +39,53 @@
 //  their data, which lets us do runtime object typing & validation.
 #define ZMSG_TAG            0x0003cafe
 
+//  Most messages have a few frames, which we hold in the message itself.
+//  Larger messages spill into an array on the heap.
+#define ZMSG_INLINE_FRAMES  4
+
 //  Structure of our class
 
 struct _zmsg_t {
     uint32_t tag;               //  Object tag for runtime detection
-    zlist_t *frames;            //  List of frames
+    zframe_t **frames;          //  Array of frames, inline or on heap
+    size_t head;                //  Index of first frame in array
+    size_t size;                //  Number of frames in message
+    size_t limit;               //  Number of slots in array
+    size_t cursor;              //  Current frame + 1, or 0 if none
     size_t content_size;        //  Total content size
+    zframe_t *inline_frames [ZMSG_INLINE_FRAMES];
 };
 
+static int s_frames_push (zmsg_t *self, zframe_t *frame);
+static int s_frames_append (zmsg_t *self, zframe_t *frame);
+static zframe_t *s_frames_pop (zmsg_t *self);
+static void s_encode (zmsg_t *self, byte *buffer, size_t buffer_size);
+
+//  A buffer decoded by zmsg_decode_zero_copy, shared by the frames that
+//  refer to it. Frames may be released from libzmq I/O threads, so the
+//  reference count is atomic.
+
+typedef struct {
+    byte *buffer;               //  Encoded message
+    zframe_free_fn *free_fn;    //  Releases buffer, or NULL
+    void *hint;                 //  Hint for free_fn
+    volatile long refs;         //  Frames using buffer, plus decoder
+} s_shared_buffer_t;
+
+static void s_shared_buffer_release (void *data, void *hint);
+
+#if defined (__WINDOWS__)
+#   define s_shared_acquire(ptr) InterlockedIncrement ((LONG volatile *) (ptr))
+#   define s_shared_release(ptr) InterlockedDecrement ((LONG volatile *) (ptr))
+#else
+#   define s_shared_acquire(ptr) __sync_add_and_fetch ((ptr), 1)
+#   define s_shared_release(ptr) __sync_sub_and_fetch ((ptr), 1)
+#endif
+
+//  Frames up to this size are copied when decoding without copying; libzmq
+//  holds them inline, which is cheaper than a shared reference
+#define ZMSG_SHARED_MIN     32
+
 
 //  --------------------------------------------------------------------------
 //  Constructor
@@ -54,12 +93,11 @@ struct _zmsg_t {
 zmsg_t *
 zmsg_new (void)
 {
-    zmsg_t *self = (zmsg_t *) zmalloc (sizeof (zmsg_t));
+    zmsg_t *self = (zmsg_t *) zsys_pool_alloc (ZSYS_POOL_MSG, sizeof (zmsg_t));
     if (self) {
         self->tag = ZMSG_TAG;
-        self->frames = zlist_new ();
-        if (!self->frames)
-            zmsg_destroy (&self);
+        self->frames = self->inline_frames;
+        self->limit = ZMSG_INLINE_FRAMES;
     }
     return self;
 }
@@ -75,12 +113,13 @@ zmsg_destroy (zmsg_t **self_p)
     if (*self_p) {
         zmsg_t *self = *self_p;
         assert (zmsg_is (self));
-        zframe_t *frame;
-        while ((frame = (zframe_t *) zlist_pop (self->frames)))
-            zframe_destroy (&frame);
-        zlist_destroy (&self->frames);
+        size_t index;
+        for (index = self->head; index < self->head + self->size; index++)
+            zframe_destroy (&self->frames [index]);
+        if (self->frames != self->inline_frames)
+            free (self->frames);
         self->tag = 0xDeadBeef;
-        free (self);
+        zsys_pool_free (ZSYS_POOL_MSG, self);
         *self_p = NULL;
     }
 }
@@ -100,18 +139,18 @@ zmsg_recv (void *source)
     if (!self)
         return NULL;
 
-    void *handle = zsock_resolve (source);
     while (true) {
-        zframe_t *frame = zframe_recv (handle);
+        zframe_t *frame = zframe_recv (source);
         if (!frame) {
             zmsg_destroy (&self);
             break;              //  Interrupted or terminated
         }
+        bool more = zframe_more (frame) == 1;
         if (zmsg_append (self, &frame)) {
             zmsg_destroy (&self);
             break;
         }
-        if (!zsock_rcvmore (handle))
+        if (!more)
             break;              //  Last message frame
     }
     return self;
@@ -122,7 +161,8 @@ zmsg_recv (void *source)
 //  Send message to destination socket, and destroy the message after sending
 //  it successfully. If the message has no frames, sends nothing but destroys
 //  the message anyhow. Nullifies the caller's reference to the message (as
-//  it is a destructor).
+//  it is a destructor). If sending fails, the message keeps the frames that
+//  were not sent, and the caller still owns it.
 
 int
 zmsg_send (zmsg_t **self_p, void *dest)
@@ -132,16 +172,18 @@ zmsg_send (zmsg_t **self_p, void *dest)
     zmsg_t *self = *self_p;
 
     int rc = 0;
-    void *handle = zsock_resolve (dest);
     if (self) {
         assert (zmsg_is (self));
-        zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+        zframe_t *frame = s_frames_pop (self);
         while (frame) {
-            rc = zframe_send (&frame, handle,
-                              zlist_size (self->frames) ? ZFRAME_MORE : 0);
-            if (rc != 0)
+            size_t frame_size = zframe_size (frame);
+            rc = zframe_send (&frame, dest, self->size? ZFRAME_MORE: 0);
+            if (rc != 0) {
+                s_frames_push (self, frame);
                 break;
-            frame = (zframe_t *) zlist_pop (self->frames);
+            }
+            self->content_size -= frame_size;
+            frame = s_frames_pop (self);
         }
         if (rc == 0)
             zmsg_destroy (self_p);
@@ -159,7 +201,7 @@ zmsg_size (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    return zlist_size (self->frames);
+    return self->size;
 }
 
 
@@ -192,7 +234,7 @@ zmsg_prepend (zmsg_t *self, zframe_t **frame_p)
     zframe_t *frame = *frame_p;
     *frame_p = NULL;            //  We now own frame
     self->content_size += zframe_size (frame);
-    return zlist_push (self->frames, frame);
+    return s_frames_push (self, frame);
 }
 
 
@@ -211,7 +253,7 @@ zmsg_append (zmsg_t *self, zframe_t **frame_p)
     zframe_t *frame = *frame_p;
     *frame_p = NULL;            //  We now own frame
     self->content_size += zframe_size (frame);
-    return zlist_append (self->frames, frame);
+    return s_frames_append (self, frame);
 }
 
 
@@ -225,7 +267,7 @@ zmsg_pop (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+    zframe_t *frame = s_frames_pop (self);
     if (frame)
         self->content_size -= zframe_size (frame);
 
@@ -246,7 +288,7 @@ zmsg_pushmem (zmsg_t *self, const void *src, size_t size)
     zframe_t *frame = zframe_new (src, size);
     if (frame) {
         self->content_size += size;
-        return zlist_push (self->frames, frame);
+        return s_frames_push (self, frame);
     }
     else
         return -1;
@@ -265,13 +307,44 @@ zmsg_addmem (zmsg_t *self, const void *src, size_t size)
     zframe_t *frame = zframe_new (src, size);
     if (frame) {
         self->content_size += size;
-        return zlist_append (self->frames, frame);
+        return s_frames_append (self, frame);
     }
     else
         return -1;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Add caller's data to the end of the message as a new frame, without
+//  copying it. The message takes ownership of the data, and calls free_fn
+//  with the data and the hint exactly once, when libzmq no longer needs
+//  the data, as for zframe_new_zero_copy. Returns 0 on success, -1 on
+//  error, in which case the data has already been released.
+
+int
+zmsg_addmem_zero_copy (zmsg_t *self, void *data, size_t size, zframe_free_fn *free_fn, void *hint)
+{
+    assert (self);
+    assert (zmsg_is (self));
+
+    zframe_t *frame = zframe_new_zero_copy (data, size, free_fn, hint);
+    if (frame) {
+        self->content_size += size;
+        if (s_frames_append (self, frame)) {
+            self->content_size -= size;
+            zframe_destroy (&frame);
+            return -1;
+        }
+        return 0;
+    }
+    else {
+        if (free_fn)
+            (free_fn) (data, hint);
+        return -1;
+    }
+}
+
+
 //  --------------------------------------------------------------------------
 //  Push string as new frame to front of message.
 //  Returns 0 on success, -1 on error.
@@ -287,7 +360,7 @@ zmsg_pushstr (zmsg_t *self, const char *string)
     zframe_t *frame = zframe_new (string, len);
     if (frame) {
         self->content_size += len;
-        return zlist_push (self->frames, frame);
+        return s_frames_push (self, frame);
     }
     else
         return -1;
@@ -309,7 +382,7 @@ zmsg_addstr (zmsg_t *self, const char *string)
     zframe_t *frame = zframe_new (string, len);
     if (frame) {
         self->content_size += len;
-        return zlist_append (self->frames, frame);
+        return s_frames_append (self, frame);
     }
     else
         return -1;
@@ -339,7 +412,7 @@ zmsg_pushstrf (zmsg_t *self, const char *format, ...)
     free (string);
     if (frame) {
         self->content_size += len;
-        return zlist_push (self->frames, frame);
+        return s_frames_push (self, frame);
     }
     else
         return -1;
@@ -369,7 +442,7 @@ zmsg_addstrf (zmsg_t *self, const char *format, ...)
     free (string);
     if (frame) {
         self->content_size += len;
-        return zlist_append (self->frames, frame);
+        return s_frames_append (self, frame);
     }
     else
         return -1;
@@ -386,7 +459,7 @@ zmsg_popstr (zmsg_t *self)
     assert (self);
     assert (zmsg_is (self));
 
-    zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+    zframe_t *frame = s_frames_pop (self);
     char *string = NULL;
     if (frame) {
         self->content_size -= zframe_size (frame);
@@ -409,15 +482,17 @@ zmsg_addmsg (zmsg_t *self, zmsg_t **msg_p)
     assert (zmsg_is (self));
     assert (msg_p);
 
+    //  Encode straight into the new frame
     zmsg_t *msg = *msg_p;
-    byte *data;
-    size_t len = zmsg_encode (msg, &data);
-    int r = zmsg_addmem (self, data, len);
+    zframe_t *frame = zframe_new (NULL, zmsg_encode_size (msg));
+    if (!frame)
+        return -1;
+    zmsg_encode_into (msg, zframe_data (frame), zframe_size (frame));
+    int r = zmsg_append (self, &frame);
     if (r == 0) {
         zmsg_destroy (&msg);
         *msg_p = NULL;
     }
-    free (data);
     return r;
 }
 
@@ -438,7 +513,7 @@ zmsg_popmsg (zmsg_t *self)
         return NULL;
 
     size_t len = zframe_size (frame);
-    byte *data = zframe_data (frame);
+    const byte *data = zframe_peek (frame);
     zmsg_t *msg = zmsg_decode (data, len);
     zframe_destroy (&frame);
     return msg;
@@ -454,8 +529,22 @@ zmsg_remove (zmsg_t *self, zframe_t *frame)
     assert (self);
     assert (zmsg_is (self));
 
+    size_t index;
+    for (index = 0; index < self->size; index++)
+        if (self->frames [self->head + index] == frame)
+            break;
+    if (index == self->size)
+        return;                 //  Frame is not in message
+
     self->content_size -= zframe_size (frame);
-    zlist_remove (self->frames, frame);
+    memmove (self->frames + self->head + index,
+             self->frames + self->head + index + 1,
+             (self->size - index - 1) * sizeof (zframe_t *));
+    self->size--;
+    //  Keep the cursor on the same frame, or on the frame before the one
+    //  we removed, so that zmsg_next returns the frame after it
+    if (self->cursor > index)
+        self->cursor--;
 }
 
 
@@ -468,7 +557,8 @@ zmsg_first (zmsg_t *self)
 {
     assert (self);
     assert (zmsg_is (self));
-    return (zframe_t *) zlist_first (self->frames);
+    self->cursor = 0;
+    return zmsg_next (self);
 }
 
 
@@ -481,7 +571,13 @@ zmsg_next (zmsg_t *self)
 {
     assert (self);
     assert (zmsg_is (self));
-    return (zframe_t *) zlist_next (self->frames);
+    if (self->cursor < self->size)
+        return self->frames [self->head + self->cursor++];
+    else {
+        //  Past the end, we go back to the start, as zlist does
+        self->cursor = 0;
+        return NULL;
+    }
 }
 
 
@@ -493,7 +589,8 @@ zmsg_last (zmsg_t *self)
 {
     assert (self);
     assert (zmsg_is (self));
-    return (zframe_t *) zlist_last (self->frames);
+    self->cursor = self->size;
+    return self->size? self->frames [self->head + self->size - 1]: NULL;
 }
 
 
@@ -516,7 +613,7 @@ zmsg_save (zmsg_t *self, FILE *file)
         size_t frame_size = zframe_size (frame);
         if (fwrite (&frame_size, sizeof (frame_size), 1, file) != 1)
             return -1;
-        if (fwrite (zframe_data (frame), frame_size, 1, file) != 1)
+        if (fwrite (zframe_peek (frame), frame_size, 1, file) != 1)
             return -1;
         frame = zmsg_next (self);
     }
@@ -585,44 +682,53 @@ zmsg_encode (zmsg_t *self, byte **buffer)
     assert (self);
     assert (zmsg_is (self));
 
-    //  Calculate real size of buffer
+    //  We write every byte, so the buffer needn't be zeroed
+    size_t buffer_size = zmsg_encode_size (self);
+    *buffer = (byte *) malloc (buffer_size);
+    if (*buffer)
+        s_encode (self, *buffer, buffer_size);
+    return buffer_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the size of the buffer that zmsg_encode would produce for this
+//  message.
+
+size_t
+zmsg_encode_size (zmsg_t *self)
+{
+    assert (self);
+    assert (zmsg_is (self));
+
     size_t buffer_size = 0;
-    zframe_t *frame = zmsg_first (self);
-    while (frame) {
-        size_t frame_size = zframe_size (frame);
-        if (frame_size < 255)
-            buffer_size += frame_size + 1;
-        else
-            buffer_size += frame_size + 1 + 4;
-        frame = zmsg_next (self);
+    size_t index;
+    for (index = 0; index < self->size; index++) {
+        size_t frame_size = zframe_size (self->frames [self->head + index]);
+        buffer_size += frame_size < 255? frame_size + 1: frame_size + 1 + 4;
     }
-    *buffer = (byte *) zmalloc (buffer_size);
+    return buffer_size;
+}
 
-    if (*buffer) {
-        //  Encode message now
-        byte *dest = *buffer;
-        frame = zmsg_first (self);
-        while (frame) {
-            size_t frame_size = zframe_size (frame);
-            if (frame_size < 255) {
-                *dest++ = (byte) frame_size;
-                memcpy (dest, zframe_data (frame), frame_size);
-                dest += frame_size;
-            }
-            else {
-                *dest++ = 0xFF;
-                *dest++ = (frame_size >> 24) & 255;
-                *dest++ = (frame_size >> 16) & 255;
-                *dest++ = (frame_size >>  8) & 255;
-                *dest++ =  frame_size        & 255;
-                memcpy (dest, zframe_data (frame), frame_size);
-                dest += frame_size;
-            }
-            frame = zmsg_next (self);
-        }
-        assert ((dest - *buffer) == buffer_size);
+
+//  --------------------------------------------------------------------------
+//  Serialize message into a caller-provided buffer, in the same format as
+//  zmsg_encode. Returns the encoded size. If this is larger than the
+//  buffer_size, the buffer was too small and nothing was written; use
+//  zmsg_encode_size to size the buffer beforehand.
+
+size_t
+zmsg_encode_into (zmsg_t *self, byte *buffer, size_t buffer_size)
+{
+    assert (self);
+    assert (zmsg_is (self));
+
+    size_t encoded_size = zmsg_encode_size (self);
+    if (encoded_size <= buffer_size) {
+        assert (buffer);
+        s_encode (self, buffer, encoded_size);
     }
-    return buffer_size;
+    return encoded_size;
 }
 
 
@@ -638,45 +744,115 @@ zmsg_decode (const byte *buffer, size_t buffer_size)
     if (!self)
         return NULL;
 
-    const byte *source = buffer;
-    const byte *limit = buffer + buffer_size;
-    while (source < limit) {
-        size_t frame_size = *source++;
-        if (frame_size == 255) {
-            if (source > limit - 4) {
-                zmsg_destroy (&self);
-                break;
-            }
-            frame_size = (source [0] << 24)
-                       + (source [1] << 16)
-                       + (source [2] << 8)
-                       +  source [3];
-            source += 4;
-        }
-        if (source > limit - frame_size) {
+    size_t offset = 0;
+    size_t frame_size;
+    const byte *data;
+    while ((data = zmsg_decode_next (buffer, buffer_size, &offset, &frame_size))) {
+        zframe_t *frame = zframe_new (data, frame_size);
+        if (!frame || zmsg_append (self, &frame)) {
             zmsg_destroy (&self);
-            break;
-        }
-        zframe_t *frame = zframe_new (source, frame_size);
-        if (frame) {
-            if (zmsg_append (self, &frame)) {
-                zmsg_destroy (&self);
-                break;
-            }
-            source += frame_size;
+            return NULL;        //  Insufficient memory
         }
+    }
+    if (offset < buffer_size)
+        zmsg_destroy (&self);   //  Badly formatted buffer
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decodes a serialized message buffer created by zmsg_encode (), like
+//  zmsg_decode, but without copying the frame data. The frames refer to the
+//  buffer, which the message takes ownership of. When the message and all
+//  frames from it are sent or destroyed, calls free_fn with the buffer and
+//  hint, as for zframe_new_zero_copy. Returns NULL if the buffer was badly
+//  formatted or there was insufficient memory to work, in which case the
+//  buffer has already been released.
+
+zmsg_t *
+zmsg_decode_zero_copy (byte *buffer, size_t buffer_size, zframe_free_fn *free_fn, void *hint)
+{
+    s_shared_buffer_t *shared = (s_shared_buffer_t *) zmalloc (sizeof (s_shared_buffer_t));
+    zmsg_t *self = shared? zmsg_new (): NULL;
+    if (!self) {
+        free (shared);
+        if (free_fn)
+            (free_fn) (buffer, hint);
+        return NULL;
+    }
+    shared->buffer = buffer;
+    shared->free_fn = free_fn;
+    shared->hint = hint;
+    shared->refs = 1;           //  Our own reference, while decoding
+
+    size_t offset = 0;
+    size_t frame_size;
+    const byte *data;
+    while ((data = zmsg_decode_next (buffer, buffer_size, &offset, &frame_size))) {
+        zframe_t *frame;
+        if (frame_size <= ZMSG_SHARED_MIN)
+            frame = zframe_new (data, frame_size);
         else {
+            s_shared_acquire (&shared->refs);
+            frame = zframe_new_zero_copy ((void *) data, frame_size,
+                                          s_shared_buffer_release, shared);
+            if (!frame)
+                s_shared_buffer_release (NULL, shared);
+        }
+        if (!frame || zmsg_append (self, &frame)) {
             zmsg_destroy (&self);
-            break;
+            break;              //  Insufficient memory
         }
     }
+    if (self && offset < buffer_size)
+        zmsg_destroy (&self);   //  Badly formatted buffer
+    s_shared_buffer_release (NULL, shared);
     return self;
 }
 
 
+//  --------------------------------------------------------------------------
+//  Walk the frames of a serialized message buffer created by zmsg_encode (),
+//  without creating a message or frames. Start with *offset_p at zero; each
+//  call returns the address of the next frame's data within the buffer, sets
+//  *frame_size_p to its size, and moves *offset_p past it. Returns NULL when
+//  there are no more frames, in which case *offset_p equals buffer_size, or
+//  if the buffer is badly formatted, in which case it is less.
+
+const byte *
+zmsg_decode_next (const byte *buffer, size_t buffer_size, size_t *offset_p, size_t *frame_size_p)
+{
+    assert (offset_p);
+    assert (frame_size_p);
+
+    size_t offset = *offset_p;
+    if (offset >= buffer_size)
+        return NULL;
+
+    size_t frame_size = buffer [offset++];
+    if (frame_size == 255) {
+        if (buffer_size - offset < 4)
+            return NULL;
+        frame_size = ((size_t) buffer [offset]     << 24)
+                   + ((size_t) buffer [offset + 1] << 16)
+                   + ((size_t) buffer [offset + 2] << 8)
+                   +  (size_t) buffer [offset + 3];
+        offset += 4;
+    }
+    if (buffer_size - offset < frame_size)
+        return NULL;
+
+    *offset_p = offset + frame_size;
+    *frame_size_p = frame_size;
+    return buffer + offset;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Create copy of message, as new message object. Returns a fresh zmsg_t
 //  object. If message is null, or memory was exhausted, returns null.
+//  The copy shares frame data with the original, as zframe_dup does, so
+//  copying a large message costs no more than copying a small one.
 
 zmsg_t *
 zmsg_dup (zmsg_t *self)
@@ -685,13 +861,15 @@ zmsg_dup (zmsg_t *self)
         assert (zmsg_is (self));
         zmsg_t *copy = zmsg_new ();
         if (copy) {
-            zframe_t *frame = zmsg_first (self);
-            while (frame) {
-                if (zmsg_addmem (copy, zframe_data (frame), zframe_size (frame))) {
+            size_t index;
+            for (index = 0; index < self->size; index++) {
+                zframe_t *frame = zframe_dup (self->frames [self->head + index]);
+                if (!frame || s_frames_append (copy, frame)) {
+                    zframe_destroy (&frame);
                     zmsg_destroy (&copy);
                     break;      //  Abandon attempt to copy message
                 }
-                frame = zmsg_next (self);
+                copy->content_size += zframe_size (frame);
             }
         }
         return copy;
@@ -734,17 +912,14 @@ zmsg_eq (zmsg_t *self, zmsg_t *other)
     if (!self || !other)
         return false;
     
-    if (zlist_size (self->frames) != zlist_size (other->frames))
+    if (self->size != other->size)
         return false;
     
-    zframe_t *self_frame = (zframe_t *) zlist_first (self->frames);
-    zframe_t *other_frame = (zframe_t *) zlist_first (other->frames);
-    while (self_frame && other_frame) {
-        if (!zframe_eq (self_frame, other_frame))
+    size_t index;
+    for (index = 0; index < self->size; index++)
+        if (!zframe_eq (self->frames [self->head + index],
+                        other->frames [other->head + index]))
             return false;
-        self_frame = (zframe_t *) zlist_next (self->frames);
-        other_frame = (zframe_t *) zlist_next (other->frames);
-    }
     return true;
 }
 
@@ -774,7 +949,7 @@ zmsg_signal (zmsg_t *self)
     if (zmsg_size (self) == 1
     &&  zmsg_content_size (self) == 8) {
         zframe_t *frame = zmsg_first (self);
-        int64_t signal_value = *((int64_t *) zframe_data (frame));
+        int64_t signal_value = *((const int64_t *) zframe_peek (frame));
         if ((signal_value & 0xFFFFFFFFFFFFFF00L) == 0x7766554433221100L)
             return signal_value & 255;
     }
@@ -825,9 +1000,8 @@ zmsg_recv_nowait (void *source)
     if (!self)
         return NULL;
 
-    void *handle = zsock_resolve (source);
     while (true) {
-        zframe_t *frame = zframe_recv_nowait (handle);
+        zframe_t *frame = zframe_recv_nowait (source);
         if (!frame) {
             zmsg_destroy (&self);
             break;              //  Interrupted or terminated
@@ -870,7 +1044,7 @@ zmsg_push (zmsg_t *self, zframe_t *frame)
     assert (self);
     assert (frame);
     self->content_size += zframe_size (frame);
-    return zlist_push (self->frames, frame);
+    return s_frames_push (self, frame);
 }
 
 
@@ -886,7 +1060,7 @@ zmsg_add (zmsg_t *self, zframe_t *frame)
     assert (self);
     assert (frame);
     self->content_size += zframe_size (frame);
-    return zlist_append (self->frames, frame);
+    return s_frames_append (self, frame);
 }
 
 
@@ -916,9 +1090,146 @@ zmsg_fprint (zmsg_t *self, FILE *file)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Double the frame array, moving from the inline array to the heap.
+//  Returns 0 if OK, -1 if there was not enough memory.
+
+static int
+s_frames_grow (zmsg_t *self)
+{
+    size_t limit = self->limit * 2;
+    zframe_t **frames;
+    if (self->frames == self->inline_frames) {
+        frames = (zframe_t **) malloc (limit * sizeof (zframe_t *));
+        if (frames)
+            memcpy (frames, self->frames, self->size * sizeof (zframe_t *));
+    }
+    else
+        frames = (zframe_t **) realloc (self->frames, limit * sizeof (zframe_t *));
+    if (!frames)
+        return -1;
+    self->frames = frames;
+    self->limit = limit;
+    return 0;
+}
+
+//  Make room for one more frame at the end of the frame array. We move the
+//  frames down if there is room at the start, else we grow the array.
+//  Returns 0 if OK, -1 if there was not enough memory.
+
+static int
+s_frames_reserve (zmsg_t *self)
+{
+    if (self->head + self->size < self->limit)
+        return 0;
+    if (self->head) {
+        memmove (self->frames, self->frames + self->head,
+                 self->size * sizeof (zframe_t *));
+        self->head = 0;
+        return 0;
+    }
+    return s_frames_grow (self);
+}
+
+//  Add frame to the front or back of the frame array, or take the first
+//  frame off the array. Like zlist, these reset the cursor. When there is
+//  no room at the front, we give it half the free slots, growing the array
+//  if it is more than half full, so pushing many frames onto the front does
+//  not move the whole array each time.
+
+static int
+s_frames_push (zmsg_t *self, zframe_t *frame)
+{
+    self->cursor = 0;
+    if (self->head == 0) {
+        if (self->size * 2 > self->limit && s_frames_grow (self))
+            return -1;
+        size_t head = (self->limit - self->size + 1) / 2;
+        memmove (self->frames + head, self->frames, self->size * sizeof (zframe_t *));
+        self->head = head;
+    }
+    self->frames [--self->head] = frame;
+    self->size++;
+    return 0;
+}
+
+static int
+s_frames_append (zmsg_t *self, zframe_t *frame)
+{
+    self->cursor = 0;
+    if (s_frames_reserve (self))
+        return -1;
+    self->frames [self->head + self->size++] = frame;
+    return 0;
+}
+
+static zframe_t *
+s_frames_pop (zmsg_t *self)
+{
+    self->cursor = 0;
+    if (self->size == 0)
+        return NULL;
+    zframe_t *frame = self->frames [self->head++];
+    if (--self->size == 0)
+        self->head = 0;
+    return frame;
+}
+
+//  Encode message into a buffer of buffer_size bytes, which the caller got
+//  from zmsg_encode_size
+
+static void
+s_encode (zmsg_t *self, byte *buffer, size_t buffer_size)
+{
+    byte *dest = buffer;
+    size_t index;
+    for (index = 0; index < self->size; index++) {
+        zframe_t *frame = self->frames [self->head + index];
+        size_t frame_size = zframe_size (frame);
+        if (frame_size < 255)
+            *dest++ = (byte) frame_size;
+        else {
+            *dest++ = 0xFF;
+            *dest++ = (frame_size >> 24) & 255;
+            *dest++ = (frame_size >> 16) & 255;
+            *dest++ = (frame_size >>  8) & 255;
+            *dest++ =  frame_size        & 255;
+        }
+        memcpy (dest, zframe_peek (frame), frame_size);
+        dest += frame_size;
+    }
+    assert ((size_t) (dest - buffer) == buffer_size);
+}
+
+//  Drop one reference to a buffer shared by zero-copy decoded frames, and
+//  release the buffer after the last one
+
+static void
+s_shared_buffer_release (void *data, void *hint)
+{
+    s_shared_buffer_t *shared = (s_shared_buffer_t *) hint;
+    if (s_shared_release (&shared->refs) == 0) {
+        if (shared->free_fn)
+            (shared->free_fn) (shared->buffer, shared->hint);
+        free (shared);
+    }
+}
+
+
 //  --------------------------------------------------------------------------
 //  Selftest
 
+//  Free a test buffer given to a message without copying; the hint is
+//  the number of buffers the test has seen released
+
+static void
+s_buffer_free (void *data, void *hint)
+{
+    (*((int *) hint))++;
+    free (data);
+}
+
+
 void
 zmsg_test (bool verbose)
 {
@@ -1078,10 +1389,55 @@ zmsg_test (bool verbose)
     assert (zmsg_size (msg) == 9);
     byte *buffer;
     size_t buffer_size = zmsg_encode (msg, &buffer);
-    zmsg_destroy (&msg);
-    msg = zmsg_decode (buffer, buffer_size);
-    assert (msg);
-    free (buffer);
+    assert (buffer_size == zmsg_encode_size (msg));
+
+    //  Encode into a caller buffer, which must be large enough
+    byte *buffer_into = (byte *) malloc (buffer_size);
+    assert (buffer_into);
+    assert (zmsg_encode_into (msg, buffer_into, buffer_size - 1) == buffer_size);
+    assert (zmsg_encode_into (msg, buffer_into, buffer_size) == buffer_size);
+    assert (memcmp (buffer, buffer_into, buffer_size) == 0);
+    free (buffer_into);
+
+    //  Walk the encoded frames without decoding them
+    size_t offset = 0;
+    size_t frame_size;
+    const byte *frame_data;
+    frame = zmsg_first (msg);
+    while ((frame_data = zmsg_decode_next (buffer, buffer_size, &offset, &frame_size))) {
+        assert (frame);
+        assert (frame_size == zframe_size (frame));
+        assert (memcmp (frame_data, zframe_data (frame), frame_size) == 0);
+        frame = zmsg_next (msg);
+    }
+    assert (frame == NULL);
+    assert (offset == buffer_size);
+    offset = 0;
+    while (zmsg_decode_next (buffer, buffer_size - 1, &offset, &frame_size));
+    assert (offset < buffer_size - 1);
+    assert (zmsg_decode (buffer, buffer_size - 1) == NULL);
+
+    zmsg_t *decoded = zmsg_decode (buffer, buffer_size);
+    assert (decoded);
+    assert (zmsg_eq (decoded, msg));
+    zmsg_destroy (&decoded);
+
+    //  Decode without copying; the buffer is released with the last frame
+    int buffer_released = 0;
+    decoded = zmsg_decode_zero_copy (buffer, buffer_size, s_buffer_free, &buffer_released);
+    assert (decoded);
+    assert (zmsg_eq (decoded, msg));
+    frame = zmsg_last (decoded);
+    assert (zframe_size (frame) == 65537);
+    zmsg_remove (decoded, frame);
+    zmsg_destroy (&decoded);
+    assert (buffer_released == 0);
+    zframe_destroy (&frame);
+    assert (buffer_released == 1);
+    buffer = (byte *) malloc (3);
+    memcpy (buffer, "\005abc", 3);
+    assert (zmsg_decode_zero_copy (buffer, 3, s_buffer_free, &buffer_released) == NULL);
+    assert (buffer_released == 2);
     zmsg_destroy (&msg);
 
     //  Test submessages
@@ -1129,6 +1485,114 @@ zmsg_test (bool verbose)
     zmsg_destroy (&empty_msg);
     zmsg_destroy (&empty_msg_2);
 
+    //  Test zero-copy frames; each buffer is released once, when the last
+    //  copy of its frame is gone
+    int released = 0;
+    msg = zmsg_new ();
+    assert (msg);
+    rc = zmsg_addmem_zero_copy (msg, strdup ("Hello"), 5, s_buffer_free, &released);
+    assert (rc == 0);
+    rc = zmsg_addmem_zero_copy (msg, strdup ("World"), 5, s_buffer_free, &released);
+    assert (rc == 0);
+    assert (zmsg_content_size (msg) == 10);
+    rc = zmsg_send (&msg, output);
+    assert (rc == 0);
+    msg = zmsg_recv (input);
+    assert (msg);
+    assert (zmsg_size (msg) == 2);
+    assert (zframe_streq (zmsg_first (msg), "Hello"));
+    assert (zframe_streq (zmsg_next (msg), "World"));
+    zmsg_destroy (&msg);
+    assert (released == 2);
+    msg = zmsg_new ();
+    assert (msg);
+    rc = zmsg_addmem_zero_copy (msg, strdup ("Unsent"), 6, s_buffer_free, &released);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    assert (released == 3);
+
+    //  Duplicates share frame data, so fan-out of a zero-copy message
+    //  releases each buffer once, after the last copy is sent
+    msg = zmsg_new ();
+    assert (msg);
+    rc = zmsg_addmem_zero_copy (msg, malloc (1000), 1000, s_buffer_free, &released);
+    assert (rc == 0);
+    rc = zmsg_addstr (msg, "Trailer");
+    assert (rc == 0);
+    for (frame_nbr = 0; frame_nbr < 5; frame_nbr++) {
+        copy = zmsg_dup (msg);
+        assert (copy);
+        assert (zmsg_size (copy) == 2);
+        assert (zmsg_content_size (copy) == 1007);
+        assert (zmsg_eq (copy, msg));
+        rc = zmsg_send (&copy, output);
+        assert (rc == 0);
+    }
+    zmsg_destroy (&msg);
+    for (frame_nbr = 0; frame_nbr < 5; frame_nbr++) {
+        copy = zmsg_recv (input);
+        assert (copy);
+        assert (zmsg_content_size (copy) == 1007);
+        zmsg_destroy (&copy);
+    }
+    assert (released == 4);
+
+    //  Test messages that outgrow the inline frame array, built from both
+    //  ends, and walking the frames while removing some
+    msg = zmsg_new ();
+    assert (msg);
+    for (frame_nbr = 0; frame_nbr < 10; frame_nbr++) {
+        rc = zmsg_addstrf (msg, "%d", 10 + frame_nbr);
+        assert (rc == 0);
+        rc = zmsg_pushstrf (msg, "%d", 9 - frame_nbr);
+        assert (rc == 0);
+    }
+    assert (zmsg_size (msg) == 20);
+    assert (zmsg_content_size (msg) == 30);
+    frame = zmsg_first (msg);
+    for (frame_nbr = 0; frame_nbr < 20; frame_nbr++) {
+        char expect [12];
+        snprintf (expect, sizeof (expect), "%d", frame_nbr);
+        assert (zframe_streq (frame, expect));
+        if (frame_nbr % 2) {
+            zmsg_remove (msg, frame);
+            zframe_destroy (&frame);
+        }
+        frame = zmsg_next (msg);
+    }
+    assert (frame == NULL);
+    assert (zmsg_size (msg) == 10);
+    //  After the last frame, the cursor starts again from the first
+    assert (zframe_streq (zmsg_next (msg), "0"));
+    assert (zframe_streq (zmsg_last (msg), "18"));
+    assert (zmsg_next (msg) == NULL);
+    char *string = zmsg_popstr (msg);
+    assert (streq (string, "0"));
+    zstr_free (&string);
+    rc = zmsg_pushstr (msg, "first");
+    assert (rc == 0);
+    assert (zframe_streq (zmsg_first (msg), "first"));
+    assert (zframe_streq (zmsg_next (msg), "2"));
+    zmsg_destroy (&msg);
+
+    //  Pushing many frames onto the front moves the array only now and then
+    msg = zmsg_new ();
+    assert (msg);
+    int moves = 0;
+    for (frame_nbr = 0; frame_nbr < 1000; frame_nbr++) {
+        if (msg->head == 0)
+            moves++;
+        rc = zmsg_pushmem (msg, &frame_nbr, sizeof (frame_nbr));
+        assert (rc == 0);
+    }
+    assert (moves < 20);
+    assert (zmsg_size (msg) == 1000);
+    frame = zmsg_first (msg);
+    assert (*((int *) zframe_data (frame)) == 999);
+    frame = zmsg_last (msg);
+    assert (*((int *) zframe_data (frame)) == 0);
+    zmsg_destroy (&msg);
+
     //  Test signal messages
     msg = zmsg_new_signal (0);
     assert (zmsg_signal (msg) == 0);
@@ -1150,6 +1614,24 @@ zmsg_test (bool verbose)
     assert (zmsg_send (&msg, output) == 0);
     assert (!msg);
 
+    //  With the object pool on, destroyed messages are reused, and start
+    //  out empty again
+    zsys_set_object_pool (100);
+    uint64_t hits = zsys_object_pool_hits ();
+    for (frame_nbr = 0; frame_nbr < 1000; frame_nbr++) {
+        msg = zmsg_new ();
+        assert (msg);
+        assert (zmsg_size (msg) == 0);
+        assert (zmsg_first (msg) == NULL);
+        for (int index = 0; index < 10; index++)
+            zmsg_addstr (msg, "Hello");
+        assert (zmsg_size (msg) == 10);
+        zmsg_destroy (&msg);
+    }
+    //  Each message reuses one message and ten frames
+    assert (zsys_object_pool_hits () >= hits + 5000);
+    zsys_set_object_pool (0);
+
     zsock_destroy (&input);
     zsock_destroy (&output);
 
@@ -0,0 +1,844 @@
+/*  =========================================================================
+    zpicture - compiled picture for binary encoded messages
+
+    Copyright (c) the Contributors as noted in the AUTHORS file.
+    This file is part of CZMQ, the high-level C binding for 0MQ:
+    http://czmq.zeromq.org.
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+    =========================================================================
+*/
+
+/*
+@header
+    The zpicture class holds a picture for zsock_bsend and zsock_brecv in
+    compiled form, checked and sized once, and sends and receives messages
+    with it. Use this when you send or receive the same picture many times.
+    The picture elements are the same as for zsock_bsend.
+@discuss
+    zsock_bsend and zsock_brecv compile each picture they see once, and
+    keep it on the socket, so they also benefit. Using a zpicture directly
+    saves looking the picture up on each call, and works with any socket.
+
+    A picture may have any number of 'f' (frame) elements, and may end in
+    an 'm' (message) element with any number of frames.
+
+    zpicture_recv_view returns strings, chunks, and frames as views into
+    the received message instead of copying them, and holds the message
+    until the next such call or zpicture_release. Use this for large
+    values that you only need to read.
+@end
+*/
+
+#include "../include/czmq.h"
+
+//  Structure of our class
+
+struct _zpicture_t {
+    char *picture;              //  Picture elements
+    size_t fixed_size;          //  Size of fixed-size elements in data
+    bool variable;              //  True if any elements vary in size
+    zframe_t **frames;          //  Frames to send after data frame
+    size_t nbr_frames;          //  Number of 'f' elements
+    char *cache;                //  Holds last received strings
+    zmq_msg_t *views;           //  Messages held for views, data first
+    size_t nbr_views;           //  Number of messages held
+};
+
+//  This is the largest size we allow for an incoming longstr or chunk (1M)
+#define MAX_ALLOC_SIZE      1024 * 1024
+
+
+//  --------------------------------------------------------------------------
+//  Network data encoding macros that we use in send/recv
+
+//  Put a 1-byte number to the frame
+#define PUT_NUMBER1(host) { \
+    *(byte *) needle = (host); \
+    needle++; \
+}
+
+//  Put a 2-byte number to the frame
+#define PUT_NUMBER2(host) { \
+    needle [0] = (byte) (((host) >> 8)  & 255); \
+    needle [1] = (byte) (((host))       & 255); \
+    needle += 2; \
+}
+
+//  Put a 4-byte number to the frame
+#define PUT_NUMBER4(host) { \
+    needle [0] = (byte) (((host) >> 24) & 255); \
+    needle [1] = (byte) (((host) >> 16) & 255); \
+    needle [2] = (byte) (((host) >> 8)  & 255); \
+    needle [3] = (byte) (((host))       & 255); \
+    needle += 4; \
+}
+
+//  Put a 8-byte number to the frame
+#define PUT_NUMBER8(host) { \
+    needle [0] = (byte) (((host) >> 56) & 255); \
+    needle [1] = (byte) (((host) >> 48) & 255); \
+    needle [2] = (byte) (((host) >> 40) & 255); \
+    needle [3] = (byte) (((host) >> 32) & 255); \
+    needle [4] = (byte) (((host) >> 24) & 255); \
+    needle [5] = (byte) (((host) >> 16) & 255); \
+    needle [6] = (byte) (((host) >> 8)  & 255); \
+    needle [7] = (byte) (((host))       & 255); \
+    needle += 8; \
+}
+
+//  Get a 1-byte number from the frame
+#define GET_NUMBER1(host) { \
+    if (needle + 1 > ceiling) \
+        goto malformed; \
+    (host) = *(byte *) needle; \
+    needle++; \
+}
+
+//  Get a 2-byte number from the frame
+#define GET_NUMBER2(host) { \
+    if (needle + 2 > ceiling) \
+        goto malformed; \
+    (host) = ((uint16_t) (needle [0]) << 8) \
+           +  (uint16_t) (needle [1]); \
+    needle += 2; \
+}
+
+//  Get a 4-byte number from the frame
+#define GET_NUMBER4(host) { \
+    if (needle + 4 > ceiling) \
+        goto malformed; \
+    (host) = ((uint32_t) (needle [0]) << 24) \
+           + ((uint32_t) (needle [1]) << 16) \
+           + ((uint32_t) (needle [2]) << 8) \
+           +  (uint32_t) (needle [3]); \
+    needle += 4; \
+}
+
+//  Get a 8-byte number from the frame
+#define GET_NUMBER8(host) { \
+    if (needle + 8 > ceiling) \
+        goto malformed; \
+    (host) = ((uint64_t) (needle [0]) << 56) \
+           + ((uint64_t) (needle [1]) << 48) \
+           + ((uint64_t) (needle [2]) << 40) \
+           + ((uint64_t) (needle [3]) << 32) \
+           + ((uint64_t) (needle [4]) << 24) \
+           + ((uint64_t) (needle [5]) << 16) \
+           + ((uint64_t) (needle [6]) << 8) \
+           +  (uint64_t) (needle [7]); \
+    needle += 8; \
+}
+
+
+//  --------------------------------------------------------------------------
+//  Create a new compiled picture. Returns NULL if the picture is not valid,
+//  after logging the reason.
+
+zpicture_t *
+zpicture_new (const char *picture)
+{
+    assert (picture);
+    zpicture_t *self = (zpicture_t *) zmalloc (sizeof (zpicture_t));
+    if (!self)
+        return NULL;
+
+    self->picture = strdup (picture);
+    if (!self->picture) {
+        zpicture_destroy (&self);
+        return NULL;
+    }
+    //  The cache holds each short string and its terminator, so it never
+    //  needs to grow, and strings we return never move
+    size_t cache_size = 0;
+    const char *picptr;
+    for (picptr = picture; *picptr; picptr++) {
+        if (*picptr == '1' || *picptr == '2' || *picptr == '4' || *picptr == '8')
+            self->fixed_size += *picptr - '0';
+        else
+        if (*picptr == 'p')
+            self->fixed_size += sizeof (void *);
+        else
+        if (*picptr == 'u')
+            self->fixed_size += ZUUID_LEN;
+        else
+        if (*picptr == 's') {
+            self->fixed_size += 1;
+            self->variable = true;
+            cache_size += 256;
+        }
+        else
+        if (*picptr == 'S' || *picptr == 'c') {
+            self->fixed_size += 4;
+            self->variable = true;
+        }
+        else
+        if (*picptr == 'f')
+            self->nbr_frames++;
+        else
+        if (*picptr == 'm') {
+            if (picptr [1]) {
+                zsys_error ("zpicture: 'm' (zmsg) only valid at end of picture");
+                zpicture_destroy (&self);
+                return NULL;
+            }
+        }
+        else {
+            zsys_error ("zpicture: invalid picture element '%c'", *picptr);
+            zpicture_destroy (&self);
+            return NULL;
+        }
+    }
+    if (self->nbr_frames) {
+        self->frames = (zframe_t **) malloc (self->nbr_frames * sizeof (zframe_t *));
+        if (!self->frames)
+            zpicture_destroy (&self);
+    }
+    if (self && cache_size) {
+        self->cache = (char *) malloc (cache_size);
+        if (!self->cache)
+            zpicture_destroy (&self);
+    }
+    if (self) {
+        self->views = (zmq_msg_t *) malloc ((self->nbr_frames + 1) * sizeof (zmq_msg_t));
+        if (!self->views)
+            zpicture_destroy (&self);
+    }
+    return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Destroy a compiled picture
+
+void
+zpicture_destroy (zpicture_t **self_p)
+{
+    assert (self_p);
+    if (*self_p) {
+        zpicture_t *self = *self_p;
+        if (self->views)
+            zpicture_release (self);
+        free (self->views);
+        free (self->picture);
+        free (self->frames);
+        free (self->cache);
+        free (self);
+        *self_p = NULL;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the picture as a string
+
+const char *
+zpicture_picture (zpicture_t *self)
+{
+    assert (self);
+    return self->picture;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send a binary encoded message to the socket (or actor), as zsock_bsend
+//  does, using the compiled picture. Does not change or take ownership of
+//  any arguments. Returns 0 if successful, -1 if sending failed for any
+//  reason.
+
+int
+zpicture_send (zpicture_t *self, void *dest, ...)
+{
+    va_list argptr;
+    va_start (argptr, dest);
+    int rc = zpicture_vsend (self, dest, argptr);
+    va_end (argptr);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send a binary encoded message to the socket (or actor), using the
+//  compiled picture, taking the arguments from a va_list.
+
+int
+zpicture_vsend (zpicture_t *self, void *dest, va_list argptr)
+{
+    assert (self);
+    assert (dest);
+
+    //  Only strings and chunks need a pass to size the data frame
+    size_t frame_size = self->fixed_size;
+    const char *picptr;
+    if (self->variable) {
+        va_list sizing;
+        va_copy (sizing, argptr);
+        for (picptr = self->picture; *picptr; picptr++) {
+            if (*picptr == '1' || *picptr == '2' || *picptr == '4')
+                va_arg (sizing, int);
+            else
+            if (*picptr == '8')
+                va_arg (sizing, uint64_t);
+            else
+            if (*picptr == 's' || *picptr == 'S') {
+                char *string = va_arg (sizing, char *);
+                frame_size += string? strlen (string): 0;
+            }
+            else
+            if (*picptr == 'c') {
+                zchunk_t *chunk = va_arg (sizing, zchunk_t *);
+                frame_size += chunk? zchunk_size (chunk): 0;
+            }
+            else
+                va_arg (sizing, void *);
+        }
+        va_end (sizing);
+    }
+    zmq_msg_t msg;
+    if (zmq_msg_init_size (&msg, frame_size))
+        return -1;
+    byte *needle = (byte *) zmq_msg_data (&msg);
+
+    size_t frame_nbr = 0;
+    bool has_msg = false;
+    zmsg_t *tail = NULL;
+    for (picptr = self->picture; *picptr; picptr++) {
+        if (*picptr == '1') {
+            int number1 = va_arg (argptr, int);
+            PUT_NUMBER1 (number1);
+        }
+        else
+        if (*picptr == '2') {
+            int number2 = va_arg (argptr, int);
+            PUT_NUMBER2 (number2);
+        }
+        else
+        if (*picptr == '4') {
+            uint32_t number4 = va_arg (argptr, uint32_t);
+            PUT_NUMBER4 (number4);
+        }
+        else
+        if (*picptr == '8') {
+            uint64_t number8 = va_arg (argptr, uint64_t);
+            PUT_NUMBER8 (number8);
+        }
+        else
+        if (*picptr == 'p') {
+            void *pointer = va_arg (argptr, void *);
+            memcpy (needle, &pointer, sizeof (void *));
+            needle += sizeof (void *);
+        }
+        else
+        if (*picptr == 's') {
+            char *string = va_arg (argptr, char *);
+            if (!string)
+                string = "";
+            size_t string_size = strlen (string);
+            PUT_NUMBER1 ((byte) string_size);
+            memcpy (needle, string, string_size);
+            needle += string_size;
+        }
+        else
+        if (*picptr == 'S') {
+            char *string = va_arg (argptr, char *);
+            if (!string)
+                string = "";
+            size_t string_size = strlen (string);
+            PUT_NUMBER4 (string_size);
+            memcpy (needle, string, string_size);
+            needle += string_size;
+        }
+        else
+        if (*picptr == 'c') {
+            zchunk_t *chunk = va_arg (argptr, zchunk_t *);
+            size_t chunk_size = chunk? zchunk_size (chunk): 0;
+            PUT_NUMBER4 (chunk_size);
+            if (chunk_size) {
+                memcpy (needle, zchunk_data (chunk), chunk_size);
+                needle += chunk_size;
+            }
+        }
+        else
+        if (*picptr == 'u') {
+            zuuid_t *uuid = va_arg (argptr, zuuid_t *);
+            if (uuid)
+                memcpy (needle, zuuid_data (uuid), ZUUID_LEN);
+            else
+                memset (needle, 0, ZUUID_LEN);
+            needle += ZUUID_LEN;
+        }
+        else
+        if (*picptr == 'f') {
+            zframe_t *frame = va_arg (argptr, zframe_t *);
+            assert (frame);
+            self->frames [frame_nbr++] = frame;
+        }
+        else
+        if (*picptr == 'm') {
+            tail = va_arg (argptr, zmsg_t *);
+            has_msg = true;
+        }
+    }
+    assert (needle == (byte *) zmq_msg_data (&msg) + frame_size);
+
+    //  Now send the data frame
+    void *handle = zsock_resolve (dest);
+    zsock_stats_t *stats = zsock_stats_of (dest);
+    int64_t started = stats? zclock_usecs (): 0;
+    bool more = self->nbr_frames || has_msg;
+    int rc = zmq_msg_send (&msg, handle, more? ZMQ_SNDMORE: 0) == -1? -1: 0;
+    if (stats)
+        zsock_stats_sent (stats, frame_size, more, rc, started);
+    if (rc == -1) {
+        zmq_msg_close (&msg);
+        return -1;
+    }
+    //  Now send any additional frames
+    for (frame_nbr = 0; frame_nbr < self->nbr_frames; frame_nbr++) {
+        more = frame_nbr < self->nbr_frames - 1 || has_msg;
+        if (zframe_send (&self->frames [frame_nbr], dest,
+                         ZFRAME_REUSE + (more? ZFRAME_MORE: 0)))
+            return -1;
+    }
+    //  And finally the frames of the message, or one empty frame if the
+    //  message is null or empty
+    if (has_msg) {
+        zframe_t *frame = tail? zmsg_first (tail): NULL;
+        if (!frame) {
+            zmq_msg_init (&msg);
+            started = stats? zclock_usecs (): 0;
+            rc = zmq_msg_send (&msg, handle, 0) == -1? -1: 0;
+            if (stats)
+                zsock_stats_sent (stats, 0, false, rc, started);
+            if (rc == -1) {
+                zmq_msg_close (&msg);
+                return -1;
+            }
+        }
+        while (frame) {
+            zframe_t *next = zmsg_next (tail);
+            if (zframe_send (&frame, dest, ZFRAME_REUSE + (next? ZFRAME_MORE: 0)))
+                return -1;
+            frame = next;
+        }
+    }
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive and decode a message; if view is true, hold the message data
+//  on the picture and return views into it.
+
+static int
+s_recv (zpicture_t *self, void *source, va_list argptr, bool view)
+{
+    assert (self);
+    assert (source);
+
+    zmq_msg_t local;
+    zmq_msg_t *msg = &local;
+    if (view) {
+        zpicture_release (self);
+        msg = &self->views [0];
+    }
+    zmq_msg_init (msg);
+    if (zmq_msg_recv (msg, zsock_resolve (source), 0) == -1) {
+        zmq_msg_close (msg);
+        return -1;              //  Interrupted
+    }
+    if (view)
+        self->nbr_views = 1;
+    zsock_stats_t *stats = zsock_stats_of (source);
+    if (stats)
+        zsock_stats_received (stats, zmq_msg_size (msg), zmq_msg_more (msg));
+
+    //  Last received strings are cached in the picture
+    size_t cache_used = 0;
+    byte *needle = (byte *) zmq_msg_data (msg);
+    byte *ceiling = needle + zmq_msg_size (msg);
+
+    const char *picptr;
+    for (picptr = self->picture; *picptr; picptr++) {
+        if (*picptr == '1') {
+            uint8_t *number1_p = va_arg (argptr, uint8_t *);
+            GET_NUMBER1 (*number1_p);
+        }
+        else
+        if (*picptr == '2') {
+            uint16_t *number2_p = va_arg (argptr, uint16_t *);
+            GET_NUMBER2 (*number2_p);
+        }
+        else
+        if (*picptr == '4') {
+            uint32_t *number4_p = va_arg (argptr, uint32_t *);
+            GET_NUMBER4 (*number4_p);
+        }
+        else
+        if (*picptr == '8') {
+            uint64_t *number8_p = va_arg (argptr, uint64_t *);
+            GET_NUMBER8 (*number8_p);
+        }
+        else
+        if (*picptr == 'p') {
+            void **pointer_p = va_arg (argptr, void **);
+            if (needle + sizeof (void *) > ceiling)
+                goto malformed;
+            memcpy (pointer_p, needle, sizeof (void *));
+            needle += sizeof (void *);
+        }
+        else
+        if (*picptr == 's' && view) {
+            const byte **data_p = va_arg (argptr, const byte **);
+            size_t *size_p = va_arg (argptr, size_t *);
+            GET_NUMBER1 (*size_p);
+            if (needle + *size_p > ceiling)
+                goto malformed;
+            *data_p = needle;
+            needle += *size_p;
+        }
+        else
+        if (*picptr == 's') {
+            char **string_p = va_arg (argptr, char **);
+            size_t string_size;
+            GET_NUMBER1 (string_size);
+            if (needle + string_size > ceiling)
+                goto malformed;
+            *string_p = self->cache + cache_used;
+            memcpy (*string_p, needle, string_size);
+            cache_used += string_size;
+            self->cache [cache_used++] = 0;
+            needle += string_size;
+        }
+        else
+        if ((*picptr == 'S' || *picptr == 'c') && view) {
+            const byte **data_p = va_arg (argptr, const byte **);
+            size_t *size_p = va_arg (argptr, size_t *);
+            GET_NUMBER4 (*size_p);
+            if (needle + *size_p > ceiling)
+                goto malformed;
+            *data_p = needle;
+            needle += *size_p;
+        }
+        else
+        if (*picptr == 'S') {
+            char **string_p = va_arg (argptr, char **);
+            size_t string_size;
+            GET_NUMBER4 (string_size);
+            if (string_size > MAX_ALLOC_SIZE
+            ||  needle + string_size > ceiling)
+                goto malformed;
+            *string_p = (char *) malloc (string_size + 1);
+            assert (*string_p);
+            memcpy (*string_p, needle, string_size);
+            (*string_p) [string_size] = 0;
+            needle += string_size;
+        }
+        else
+        if (*picptr == 'c') {
+            zchunk_t **chunk_p = va_arg (argptr, zchunk_t **);
+            size_t chunk_size;
+            GET_NUMBER4 (chunk_size);
+            if (chunk_size > MAX_ALLOC_SIZE
+            ||  needle + chunk_size > ceiling)
+                goto malformed;
+            *chunk_p = zchunk_new (needle, chunk_size);
+            needle += chunk_size;
+        }
+        else
+        if (*picptr == 'u' && view) {
+            const byte **data_p = va_arg (argptr, const byte **);
+            if (needle + ZUUID_LEN > ceiling)
+                goto malformed;
+            *data_p = needle;
+            needle += ZUUID_LEN;
+        }
+        else
+        if (*picptr == 'u') {
+            zuuid_t **uuid_p = va_arg (argptr, zuuid_t **);
+            if (needle + ZUUID_LEN > ceiling)
+                goto malformed;
+            *uuid_p = zuuid_new ();
+            zuuid_set (*uuid_p, needle);
+            needle += ZUUID_LEN;
+        }
+        else
+        if (*picptr == 'f' && view) {
+            const byte **data_p = va_arg (argptr, const byte **);
+            size_t *size_p = va_arg (argptr, size_t *);
+            if (!zsock_rcvmore (source))
+                goto malformed;
+            zmq_msg_t *frame = &self->views [self->nbr_views];
+            zmq_msg_init (frame);
+            if (zmq_msg_recv (frame, zsock_resolve (source), 0) == -1) {
+                zmq_msg_close (frame);
+                goto malformed;
+            }
+            self->nbr_views++;
+            if (stats)
+                zsock_stats_received (stats, zmq_msg_size (frame), zmq_msg_more (frame));
+            *data_p = (const byte *) zmq_msg_data (frame);
+            *size_p = zmq_msg_size (frame);
+        }
+        else
+        if (*picptr == 'f') {
+            zframe_t **frame_p = va_arg (argptr, zframe_t **);
+            //  Get next frame off socket
+            if (!zsock_rcvmore (source))
+                goto malformed;
+            *frame_p = zframe_recv (source);
+        }
+        else
+        if (*picptr == 'm') {
+            zmsg_t **msg_p = va_arg (argptr, zmsg_t **);
+            //  Get zero or more remaining frames
+            if (!zsock_rcvmore (source))
+                goto malformed;
+            *msg_p = zmsg_recv (source);
+        }
+    }
+    if (!view)
+        zmq_msg_close (msg);
+    return 0;
+
+    //  Error return
+    malformed:
+        if (view)
+            zpicture_release (self);
+        else
+            zmq_msg_close (msg);
+        return -1;              //  Invalid message
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive a binary encoded message from the socket (or actor), as
+//  zsock_brecv does, using the compiled picture. All arguments must be
+//  pointers; strings ('s') point to values held by the picture, which are
+//  valid until the next receive with it. Returns 0 if successful, or -1 if
+//  it failed to read a message.
+
+int
+zpicture_recv (zpicture_t *self, void *source, ...)
+{
+    va_list argptr;
+    va_start (argptr, source);
+    int rc = zpicture_vrecv (self, source, argptr);
+    va_end (argptr);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive a binary encoded message from the socket (or actor), using the
+//  compiled picture, storing into the pointers in a va_list.
+
+int
+zpicture_vrecv (zpicture_t *self, void *source, va_list argptr)
+{
+    return s_recv (self, source, argptr, false);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive a binary encoded message from the socket (or actor), returning
+//  views into the received data rather than copies. Numbers and pointers
+//  are returned as by zpicture_recv. Strings ('s' and 'S') and chunks ('c')
+//  take two arguments, a const byte ** and a size_t *, which are set to
+//  the value's data and size; strings are not null-terminated. Frames
+//  ('f') also take a const byte ** and a size_t *. UUIDs ('u') take a
+//  const byte ** to ZUUID_LEN bytes. A message ('m') is created as for
+//  zpicture_recv and the caller must destroy it. The views are valid until
+//  the next call to this method with the picture, zpicture_release, or
+//  destroying the picture. Returns 0 if successful, or -1 if it failed to
+//  read a message.
+
+int
+zpicture_recv_view (zpicture_t *self, void *source, ...)
+{
+    va_list argptr;
+    va_start (argptr, source);
+    int rc = zpicture_vrecv_view (self, source, argptr);
+    va_end (argptr);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive a binary encoded message from the socket (or actor), returning
+//  views as zpicture_recv_view does, storing into the pointers in a va_list.
+
+int
+zpicture_vrecv_view (zpicture_t *self, void *source, va_list argptr)
+{
+    return s_recv (self, source, argptr, true);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Release the message data held for views by zpicture_recv_view. Does
+//  nothing if no views are held.
+
+void
+zpicture_release (zpicture_t *self)
+{
+    assert (self);
+    size_t index;
+    for (index = 0; index < self->nbr_views; index++)
+        zmq_msg_close (&self->views [index]);
+    self->nbr_views = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Selftest
+
+void
+zpicture_test (bool verbose)
+{
+    printf (" * zpicture: ");
+
+    //  @selftest
+    zsock_t *writer = zsock_new_push ("@inproc://zpicture.test");
+    assert (writer);
+    zsock_t *reader = zsock_new_pull (">inproc://zpicture.test");
+    assert (reader);
+
+    //  Invalid pictures are refused
+    assert (zpicture_new ("1x") == NULL);
+    assert (zpicture_new ("ms") == NULL);
+
+    zpicture_t *picture = zpicture_new ("1248sSpcum");
+    assert (picture);
+    assert (streq (zpicture_picture (picture), "1248sSpcum"));
+    zuuid_t *uuid = zuuid_new ();
+    zchunk_t *chunk = zchunk_new ("World", 5);
+    int iteration;
+    for (iteration = 0; iteration < 10; iteration++) {
+        zmsg_t *msg = zmsg_new ();
+        zmsg_addstrf (msg, "%d", iteration);
+        int rc = zpicture_send (picture, writer, 1, 2, 4, (uint64_t) 8,
+                                "Hello", "Goodbye", picture, chunk, uuid, msg);
+        assert (rc == 0);
+        zmsg_destroy (&msg);
+    }
+    for (iteration = 0; iteration < 10; iteration++) {
+        uint8_t number1;
+        uint16_t number2;
+        uint32_t number4;
+        uint64_t number8;
+        char *string, *longstr;
+        void *pointer;
+        zchunk_t *chunk_in;
+        zuuid_t *uuid_in;
+        zmsg_t *msg;
+        int rc = zpicture_recv (picture, reader, &number1, &number2, &number4,
+                                &number8, &string, &longstr, &pointer,
+                                &chunk_in, &uuid_in, &msg);
+        assert (rc == 0);
+        assert (number1 == 1 && number2 == 2 && number4 == 4 && number8 == 8);
+        assert (streq (string, "Hello"));
+        assert (streq (longstr, "Goodbye"));
+        assert (pointer == picture);
+        assert (zchunk_size (chunk_in) == 5);
+        assert (zuuid_eq (uuid_in, zuuid_data (uuid)));
+        char *number = zmsg_popstr (msg);
+        assert (atoi (number) == iteration);
+        zstr_free (&number);
+        zstr_free (&longstr);
+        zchunk_destroy (&chunk_in);
+        zuuid_destroy (&uuid_in);
+        zmsg_destroy (&msg);
+    }
+    zchunk_destroy (&chunk);
+    zpicture_destroy (&picture);
+
+    //  Receive views into the message, without copying
+    picture = zpicture_new ("4sScuf");
+    assert (picture);
+    chunk = zchunk_new (NULL, 65536);
+    zchunk_fill (chunk, 'c', 65536);
+    zframe_t *frame = zframe_new ("Frame", 5);
+    for (iteration = 0; iteration < 2; iteration++) {
+        int rc = zpicture_send (picture, writer, iteration, "Hello", "Goodbye",
+                                chunk, uuid, frame);
+        assert (rc == 0);
+    }
+    for (iteration = 0; iteration < 2; iteration++) {
+        uint32_t number4;
+        const byte *string, *longstr, *chunk_data, *uuid_data, *frame_data;
+        size_t string_size, longstr_size, chunk_size, frame_size;
+        int rc = zpicture_recv_view (picture, reader, &number4,
+                                     &string, &string_size,
+                                     &longstr, &longstr_size,
+                                     &chunk_data, &chunk_size, &uuid_data,
+                                     &frame_data, &frame_size);
+        assert (rc == 0);
+        assert (number4 == (uint32_t) iteration);
+        assert (string_size == 5 && memcmp (string, "Hello", 5) == 0);
+        assert (longstr_size == 7 && memcmp (longstr, "Goodbye", 7) == 0);
+        assert (chunk_size == 65536);
+        assert (memcmp (chunk_data, zchunk_data (chunk), 65536) == 0);
+        assert (zuuid_eq (uuid, uuid_data));
+        assert (frame_size == 5 && memcmp (frame_data, "Frame", 5) == 0);
+    }
+    zpicture_release (picture);
+    zpicture_release (picture);
+    zframe_destroy (&frame);
+    zchunk_destroy (&chunk);
+    zuuid_destroy (&uuid);
+    zpicture_destroy (&picture);
+
+    //  Many frames, and many strings to cache
+    picture = zpicture_new ("ssssffffffffffffffffffffffffffffffffffffffffm");
+    assert (picture);
+    frame = zframe_new ("Frame", 5);
+    zmsg_t *msg = zmsg_new ();
+    for (iteration = 0; iteration < 100; iteration++)
+        zmsg_addstrf (msg, "%d", iteration);
+    char long_string [256];
+    memset (long_string, 'x', 255);
+    long_string [255] = 0;
+    int rc = zpicture_send (picture, writer,
+        long_string, long_string, long_string, long_string,
+        frame, frame, frame, frame, frame, frame, frame, frame, frame, frame,
+        frame, frame, frame, frame, frame, frame, frame, frame, frame, frame,
+        frame, frame, frame, frame, frame, frame, frame, frame, frame, frame,
+        frame, frame, frame, frame, frame, frame, frame, frame, frame, frame,
+        msg);
+    assert (rc == 0);
+    zframe_destroy (&frame);
+    zmsg_destroy (&msg);
+
+    char *strings [4];
+    zframe_t *frames [40];
+    rc = zpicture_recv (picture, reader,
+        &strings [0], &strings [1], &strings [2], &strings [3],
+        &frames [0], &frames [1], &frames [2], &frames [3], &frames [4],
+        &frames [5], &frames [6], &frames [7], &frames [8], &frames [9],
+        &frames [10], &frames [11], &frames [12], &frames [13], &frames [14],
+        &frames [15], &frames [16], &frames [17], &frames [18], &frames [19],
+        &frames [20], &frames [21], &frames [22], &frames [23], &frames [24],
+        &frames [25], &frames [26], &frames [27], &frames [28], &frames [29],
+        &frames [30], &frames [31], &frames [32], &frames [33], &frames [34],
+        &frames [35], &frames [36], &frames [37], &frames [38], &frames [39],
+        &msg);
+    assert (rc == 0);
+    for (iteration = 0; iteration < 4; iteration++)
+        assert (streq (strings [iteration], long_string));
+    for (iteration = 0; iteration < 40; iteration++) {
+        assert (zframe_streq (frames [iteration], "Frame"));
+        zframe_destroy (&frames [iteration]);
+    }
+    assert (zmsg_size (msg) == 100);
+    zmsg_destroy (&msg);
+    zpicture_destroy (&picture);
+
+    zsock_destroy (&reader);
+    zsock_destroy (&writer);
+    //  @end
+
+    printf ("OK\n");
+}
@@ -14,9 +14,13 @@
 @header
     The zpoller class provides a minimalist interface to ZeroMQ's zmq_poll
     API, for the very common case of reading from a number of sockets.
-    It does not provide polling for output, nor polling on file handles.
-    If you need either of these, use the zmq_poll API directly.
+    Readers are polled for input by default; use zpoller_set_events to
+    poll a reader for output as well, or instead, so a producer can wait
+    until a socket that hit its high-water mark can accept messages again.
 @discuss
+    When several readers are busy, zpoller_wait_all collects every reader
+    that has input from a single poll call, and zpoller_ready_first and
+    zpoller_ready_next walk that set.
 @end
 */
 
@@ -26,9 +30,15 @@
 
 struct _zpoller_t {
     zlist_t *reader_list;       //  List of sockets to read from
+    zhashx_t *reader_events;    //  Events to poll for, if not ZMQ_POLLIN
     zmq_pollitem_t *poll_set;   //  Current zmq_poll set
     void **poll_readers;        //  Matching table of socket readers
     size_t poll_size;           //  Size of poll set
+    size_t *ready;              //  Indexes of readers ready after last poll
+    size_t ready_size;          //  Number of readers in ready set
+    size_t ready_cursor;        //  Iterator into ready set
+    size_t next_reader;         //  Index where next scan of poll set starts
+    int revents;                //  Events on last reader we returned
     bool need_rebuild;          //  Does pollset needs rebuilding?
     bool expired;               //  Did poll timer expire?
     bool terminated;            //  Did poll call end with EINTR?
@@ -36,6 +46,21 @@ struct _zpoller_t {
 };
 
 static int s_rebuild_poll_set (zpoller_t *self);
+static int s_poll (zpoller_t *self, int timeout);
+
+//  We look up reader events by the reader's address
+
+static size_t
+s_reader_hash (const void *key)
+{
+    return (size_t) ((byte *) key - (byte *) NULL);
+}
+
+static int
+s_reader_compare (const void *key1, const void *key2)
+{
+    return key1 == key2? 0: 1;
+}
 
 
 //  --------------------------------------------------------------------------
@@ -80,8 +105,10 @@ zpoller_destroy (zpoller_t **self_p)
     if (*self_p) {
         zpoller_t *self = *self_p;
         zlist_destroy (&self->reader_list);
+        zhashx_destroy (&self->reader_events);
         free (self->poll_readers);
         free (self->poll_set);
+        free (self->ready);
         free (self);
         *self_p = NULL;
     }
@@ -114,29 +141,172 @@ zpoller_remove (zpoller_t *self, void *reader)
     assert (self);
     assert (reader);
     zlist_remove (self->reader_list, reader);
+    if (self->reader_events)
+        zhashx_delete (self->reader_events, reader);
+    self->need_rebuild = true;
+    return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the events to poll a reader for: ZMQ_POLLIN, ZMQ_POLLOUT, or both.
+//  Readers are polled for ZMQ_POLLIN by default. Poll for ZMQ_POLLOUT to
+//  wait until a socket can accept a message without blocking, e.g. after
+//  it reached its high-water mark. Use zpoller_revents to tell which events
+//  a reader returned by the poller is ready for. Returns 0 if OK, -1 if the
+//  reader is not registered with the poller.
+
+int
+zpoller_set_events (zpoller_t *self, void *reader, int events)
+{
+    assert (self);
+    assert (reader);
+    assert (events && !(events & ~(ZMQ_POLLIN | ZMQ_POLLOUT)));
+
+    void *cursor = zlist_first (self->reader_list);
+    while (cursor && cursor != reader)
+        cursor = zlist_next (self->reader_list);
+    if (!cursor)
+        return -1;
+
+    if (!self->reader_events) {
+        self->reader_events = zhashx_new ();
+        if (!self->reader_events)
+            return -1;
+        zhashx_set_key_hasher (self->reader_events, s_reader_hash);
+        zhashx_set_key_comparator (self->reader_events, s_reader_compare);
+        zhashx_set_key_duplicator (self->reader_events, NULL);
+        zhashx_set_key_destructor (self->reader_events, NULL);
+    }
+    zhashx_update (self->reader_events, reader, (byte *) NULL + events);
     self->need_rebuild = true;
     return 0;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Poll the registered readers for I/O, return first reader that has input.
-//  The reader will be a libzmq void * socket, or a zsock_t or zactor_t
+//  Poll the registered readers for I/O, return first reader that is ready,
+//  i.e. that has input, or the events set with zpoller_set_events. The
+//  reader will be a libzmq void * socket, or a zsock_t or zactor_t
 //  instance as specified in zpoller_new/zpoller_add. The timeout should be
-//  zero or greater, or -1 to wait indefinitely. Socket priority is defined
-//  by their order in the poll list. If you need a balanced poll, use the low
-//  level zmq_poll method directly. If the poll call was interrupted (SIGINT),
-//  or the ZMQ context was destroyed, or the timeout expired, returns NULL.
-//  You can test the actual exit condition by calling zpoller_expired () and
-//  zpoller_terminated (). The timeout is in msec.
+//  zero or greater, or -1 to wait indefinitely. Each call starts looking for
+//  input just after the reader it returned last time, so a busy reader does
+//  not starve the readers after it in the poll list. If you need all ready
+//  readers, use zpoller_wait_all. If the poll call was interrupted
+//  (SIGINT), or the ZMQ context was destroyed, or the timeout expired,
+//  returns NULL. You can test the actual exit condition by calling
+//  zpoller_expired () and zpoller_terminated (). The timeout is in msec.
 
 void *
 zpoller_wait (zpoller_t *self, int timeout)
+{
+    assert (self);
+    if (s_poll (self, timeout) > 0) {
+        uint count;
+        for (count = 0; count < self->poll_size; count++) {
+            size_t reader = (self->next_reader + count) % self->poll_size;
+            if (self->poll_set [reader].revents) {
+                self->next_reader = reader + 1;
+                self->revents = self->poll_set [reader].revents;
+                return self->poll_readers [reader];
+            }
+        }
+    }
+    return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Poll the registered readers for I/O, and collect every reader that is
+//  ready, so one poll call can service all busy readers. Returns the number
+//  of ready readers, zero if the timeout expired, or -1 if the
+//  poll call was interrupted or the ZMQ context was destroyed. Walk the
+//  readers with zpoller_ready_first and zpoller_ready_next; these are valid
+//  until the next call to zpoller_wait or zpoller_wait_all. The order of the
+//  ready set rotates on each call, to keep polling fair. The timeout is in
+//  msec.
+
+int
+zpoller_wait_all (zpoller_t *self, int timeout)
+{
+    assert (self);
+    int rc = s_poll (self, timeout);
+    if (rc > 0) {
+        uint count;
+        for (count = 0; count < self->poll_size; count++) {
+            size_t reader = (self->next_reader + count) % self->poll_size;
+            if (self->poll_set [reader].revents)
+                self->ready [self->ready_size++] = reader;
+        }
+        self->next_reader = (self->next_reader + 1) % self->poll_size;
+        rc = (int) self->ready_size;
+    }
+    else
+    if (self->terminated)
+        rc = -1;
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return first reader in the ready set collected by zpoller_wait_all, or
+//  NULL if no readers were ready. Sets the cursor for zpoller_ready_next.
+
+void *
+zpoller_ready_first (zpoller_t *self)
+{
+    assert (self);
+    self->ready_cursor = 0;
+    return zpoller_ready_next (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return next reader in the ready set collected by zpoller_wait_all, or
+//  NULL if there are no more readers.
+
+void *
+zpoller_ready_next (zpoller_t *self)
+{
+    assert (self);
+    if (self->ready_cursor < self->ready_size) {
+        size_t reader = self->ready [self->ready_cursor++];
+        self->revents = self->poll_set [reader].revents;
+        return self->poll_readers [reader];
+    }
+    else
+        return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the events that the reader last returned by zpoller_wait,
+//  zpoller_ready_first, or zpoller_ready_next is ready for: ZMQ_POLLIN,
+//  ZMQ_POLLOUT, and for file handles, ZMQ_POLLERR. Returns 0 if no reader
+//  was returned.
+
+int
+zpoller_revents (zpoller_t *self)
+{
+    assert (self);
+    return self->revents;
+}
+
+
+//  Poll the readers once, updating the expired and terminated flags. Returns
+//  the zmq_poll return code, or -1 if we did not poll because the process
+//  was interrupted.
+
+static int
+s_poll (zpoller_t *self, int timeout)
 {
     self->expired = false;
+    self->revents = 0;
+    self->ready_size = 0;
+    self->ready_cursor = 0;
     if (!self->ignore_interrupts && zsys_interrupted) {
         self->terminated = true;
-        return NULL;
+        return -1;
     }
     else
         self->terminated = false;
@@ -145,20 +315,13 @@ zpoller_wait (zpoller_t *self, int timeout)
         s_rebuild_poll_set (self);
     int rc = zmq_poll (self->poll_set, (int) self->poll_size,
                        timeout * ZMQ_POLL_MSEC);
-    if (rc > 0) {
-        uint reader = 0;
-        for (reader = 0; reader < self->poll_size; reader++)
-            if (self->poll_set [reader].revents & ZMQ_POLLIN)
-                return self->poll_readers [reader];
-    }
-    else
-    if (rc == -1 || (!self->ignore_interrupts && zsys_interrupted))
+    if (rc == -1 || (rc == 0 && !self->ignore_interrupts && zsys_interrupted))
         self->terminated = true;
     else
     if (rc == 0)
         self->expired = true;
 
-    return NULL;
+    return rc;
 }
 
 
@@ -169,12 +332,15 @@ s_rebuild_poll_set (zpoller_t *self)
     self->poll_set = NULL;
     free (self->poll_readers);
     self->poll_readers = NULL;
+    free (self->ready);
+    self->ready = NULL;
 
     self->poll_size = zlist_size (self->reader_list);
     self->poll_set = (zmq_pollitem_t *)
                      zmalloc (self->poll_size * sizeof (zmq_pollitem_t));
     self->poll_readers = (void **) zmalloc (self->poll_size * sizeof (void *));
-    if (!self->poll_set || !self->poll_readers)
+    self->ready = (size_t *) zmalloc (self->poll_size * sizeof (size_t));
+    if (!self->poll_set || !self->poll_readers || !self->ready)
         return -1;
 
     uint reader_nbr = 0;
@@ -192,7 +358,10 @@ s_rebuild_poll_set (zpoller_t *self)
         }
         else
             self->poll_set [reader_nbr].socket = socket;
-        self->poll_set [reader_nbr].events = ZMQ_POLLIN;
+        void *events = self->reader_events?
+            zhashx_lookup (self->reader_events, reader): NULL;
+        self->poll_set [reader_nbr].events = events?
+            (short) ((byte *) events - (byte *) NULL): ZMQ_POLLIN;
 
         reader_nbr++;
         reader = zlist_next (self->reader_list);
@@ -292,6 +461,113 @@ zpoller_test (bool verbose)
     zstr_send (vent, "Hello again, world");
     assert (zpoller_wait (poller, 500) == &fd);
 
+    //  Check we get every ready reader from one poll, and that
+    //  zpoller_wait takes turns between busy readers
+    zsock_t *writer1 = zsock_new_pair ("@inproc://zpoller.test1");
+    assert (writer1);
+    zsock_t *reader1 = zsock_new_pair (">inproc://zpoller.test1");
+    assert (reader1);
+    zsock_t *writer2 = zsock_new_pair ("@inproc://zpoller.test2");
+    assert (writer2);
+    zsock_t *reader2 = zsock_new_pair (">inproc://zpoller.test2");
+    assert (reader2);
+    zsock_t *writer3 = zsock_new_pair ("@inproc://zpoller.test3");
+    assert (writer3);
+    zsock_t *reader3 = zsock_new_pair (">inproc://zpoller.test3");
+    assert (reader3);
+    zpoller_t *busy = zpoller_new (reader1, reader2, reader3, NULL);
+    assert (busy);
+    assert (zpoller_wait_all (busy, 0) == 0);
+    assert (zpoller_expired (busy));
+    assert (zpoller_ready_first (busy) == NULL);
+
+    zstr_send (writer1, "one");
+    zstr_send (writer3, "three");
+    zstr_send (writer2, "two");
+    rc = zpoller_wait_all (busy, 500);
+    assert (rc == 3);
+    int seen = 0;
+    which = (zsock_t *) zpoller_ready_first (busy);
+    while (which) {
+        seen |= which == reader1? 1: which == reader2? 2: 4;
+        which = (zsock_t *) zpoller_ready_next (busy);
+    }
+    assert (seen == 7);
+
+    //  Nobody reads the messages, so all three readers stay busy, and
+    //  zpoller_wait returns each in turn
+    zsock_t *first = (zsock_t *) zpoller_wait (busy, 0);
+    zsock_t *second = (zsock_t *) zpoller_wait (busy, 0);
+    zsock_t *third = (zsock_t *) zpoller_wait (busy, 0);
+    assert (first && second && third);
+    assert (first != second && second != third && third != first);
+    assert (zpoller_wait (busy, 0) == first);
+    message = zstr_recv (second);
+    assert (message);
+    zstr_free (&message);
+    assert (zpoller_wait (busy, 0) == third);
+
+    //  The ready set starts one reader later on each call, so each busy
+    //  reader comes first in turn
+    seen = 0;
+    int call;
+    for (call = 0; call < 3; call++) {
+        assert (zpoller_wait_all (busy, 0) == 2);
+        which = (zsock_t *) zpoller_ready_first (busy);
+        seen |= which == reader1? 1: which == reader2? 2: 4;
+    }
+    assert (seen == 7 - (second == reader1? 1: second == reader2? 2: 4));
+    zpoller_destroy (&busy);
+    zsock_destroy (&writer1);
+    zsock_destroy (&reader1);
+    zsock_destroy (&writer2);
+    zsock_destroy (&reader2);
+    zsock_destroy (&writer3);
+    zsock_destroy (&reader3);
+
+    //  Check we can wait for a blocked writer to drain
+    zsock_t *producer = zsock_new (ZMQ_PUSH);
+    assert (producer);
+    zsock_set_sndhwm (producer, 1);
+    zsock_set_sndtimeo (producer, 0);
+    rc = zsock_bind (producer, "inproc://zpoller.hwm");
+    assert (rc == 0);
+    zsock_t *consumer = zsock_new (ZMQ_PULL);
+    assert (consumer);
+    zsock_set_rcvhwm (consumer, 1);
+    rc = zsock_connect (consumer, "inproc://zpoller.hwm");
+    assert (rc == 0);
+    zpoller_t *writer = zpoller_new (consumer, NULL);
+    assert (writer);
+    assert (zpoller_set_events (writer, producer, ZMQ_POLLOUT) == -1);
+    rc = zpoller_add (writer, producer);
+    assert (rc == 0);
+    rc = zpoller_set_events (writer, producer, ZMQ_POLLOUT);
+    assert (rc == 0);
+    assert (zpoller_wait (writer, 0) == producer);
+    assert (zpoller_revents (writer) == ZMQ_POLLOUT);
+
+    //  Fill the pipe until the producer would block
+    int sent = 0;
+    while (zstr_send (producer, "backlog") == 0)
+        assert (++sent < 100);
+    assert (sent > 0);
+    assert (zpoller_wait (writer, 0) == consumer);
+    assert (zpoller_revents (writer) == ZMQ_POLLIN);
+    zpoller_remove (writer, consumer);
+    assert (zpoller_wait (writer, 0) == NULL);
+    assert (zpoller_expired (writer));
+
+    //  Once the consumer takes a message, the producer can send again
+    message = zstr_recv (consumer);
+    assert (streq (message, "backlog"));
+    zstr_free (&message);
+    assert (zpoller_wait (writer, 100) == producer);
+    assert (zpoller_revents (writer) == ZMQ_POLLOUT);
+    zpoller_destroy (&writer);
+    zsock_destroy (&producer);
+    zsock_destroy (&consumer);
+
     // Check whether poller properly ignores zsys_interrupted flag
     // when asked to
     zsys_interrupted = 1;
@@ -301,6 +577,13 @@ zpoller_test (bool verbose)
     zpoller_wait (poller, 0);
     assert (!zpoller_terminated (poller));
     zsys_interrupted = 0;
+    zpoller_t *interrupted = zpoller_new (sink, NULL);
+    assert (interrupted);
+    zsys_interrupted = 1;
+    assert (zpoller_wait_all (interrupted, 0) == -1);
+    assert (zpoller_terminated (interrupted));
+    zsys_interrupted = 0;
+    zpoller_destroy (&interrupted);
 
     //  Destroy poller and sockets
     zpoller_destroy (&poller);
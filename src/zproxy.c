@@ -225,18 +225,24 @@ zproxy (zsock_t *pipe, void *unused)
     zsock_signal (pipe, 0);
 
     while (!self->terminated) {
-        zsock_t *which = (zsock_t *) zpoller_wait (self->poller, -1);
-        if (zpoller_terminated (self->poller))
+        if (zpoller_wait_all (self->poller, -1) == -1)
             break;          //  Interrupted
-        else
-        if (which == self->pipe)
-            s_self_handle_pipe (self);
-        else
-        if (which == self->frontend)
-            s_self_switch (self, self->frontend, self->backend);
-        else
-        if (which == self->backend)
-            s_self_switch (self, self->backend, self->frontend);
+        //  Service every ready socket from the one poll call
+        zsock_t *which = (zsock_t *) zpoller_ready_first (self->poller);
+        while (which) {
+            if (which == self->pipe) {
+                //  Commands may replace the poller, so stop here
+                s_self_handle_pipe (self);
+                break;
+            }
+            else
+            if (which == self->frontend)
+                s_self_switch (self, self->frontend, self->backend);
+            else
+            if (which == self->backend)
+                s_self_switch (self, self->backend, self->frontend);
+            which = (zsock_t *) zpoller_ready_next (self->poller);
+        }
     }
     s_self_destroy (&self);
 }
@@ -34,19 +34,20 @@
 #define DYNAMIC_FIRST       0xc000    // 49152
 #define DYNAMIC_LAST        0xffff    // 65535
 
-#define ZSOCK_BSEND_MAX_FRAMES 32  // Arbitrary limit, for now
-
 //  Structure of our class
 
 struct _zsock_t {
     uint32_t tag;               //  Object tag for runtime detection
     void *handle;               //  The libzmq socket handle
     char *endpoint;             //  Last bound endpoint, if any
-    char *cache;                //  Holds last zsock_brecv strings
     int type;                   //  Socket type
-    size_t cache_size;          //  Current size of cache
+    zhashx_t *pictures;         //  Compiled bsend/brecv pictures
+    zsock_stats_t stats;        //  Traffic counters
+    bool counting;              //  True if we count traffic
 };
 
+static zpicture_t *s_compiled_picture (void *self, const char *picture);
+
 
 //  --------------------------------------------------------------------------
 //  Create a new socket. This macro passes the caller source and line
@@ -65,6 +66,8 @@ zsock_new_checked (int type, const char *filename, size_t line_nbr)
         self->type = type;
         if (!self->handle)
             zsock_destroy (&self);
+        else
+            self->counting = zsys_stats_register (&self->stats, type, filename, line_nbr) == 0;
     }
     return self;
 }
@@ -90,7 +93,9 @@ zsock_destroy_checked (zsock_t **self_p, const char *filename, size_t line_nbr)
         int rc = zsys_close (self->handle, filename, line_nbr);
         assert (rc == 0);
         free (self->endpoint);
-        free (self->cache);
+        zhashx_destroy (&self->pictures);
+        if (self->counting)
+            zsys_stats_deregister (&self->stats);
         free (self);
         *self_p = NULL;
     }
@@ -613,7 +618,7 @@ zsock_type_str (zsock_t *self)
 //  Send a 'picture' message to the socket (or actor). The picture is a
 //  string that defines the type of each frame. This makes it easy to send
 //  a complex multiframe message in one call. The picture can contain any
-//  of these characters, each corresponding to one or two arguments:
+//  of these characters, each corresponding to one or more arguments:
 //
 //      i = int (signed)
 //      1 = uint8_t
@@ -628,14 +633,28 @@ zsock_type_str (zsock_t *self)
 //      U = zuuid_t *
 //      p = void * (sends the pointer value, only meaningful over inproc)
 //      m = zmsg_t * (sends all frames in the zmsg)
+//      x = void *, size_t, zframe_free_fn *, void * (4 arguments)
+//          (sends data without copying, see zframe_new_zero_copy)
 //      z = sends zero-sized frame (0 arguments)
 //      u = uint (deprecated)
 //
 //  Note that s, b, c, and f are encoded the same way and the choice is
 //  offered as a convenience to the sender, which may or may not already
 //  have data in a zchunk or zframe. Does not change or take ownership of
-//  any arguments. Returns 0 if successful, -1 if sending failed for any
-//  reason.
+//  any arguments, except the x data, which is freed by its free function
+//  even if sending fails. Returns 0 if successful, -1 if sending failed
+//  for any reason.
+//
+//  Integers are sent as decimal text by default. If the picture starts
+//  with '#', they are sent in binary instead, in network byte order, as
+//  4 bytes for i and u, and 1, 2, 4, or 8 bytes for 1, 2, 4, and 8. This
+//  is cheaper to encode and decode; the receiver must use '#' as well.
+//  As decimal text, u is now sent as just the digits, for example "42".
+//  Older versions sent it with a trailing 'd', as "42d". zsock_recv reads
+//  both forms, but a peer that reads the frame as a string sees the new
+//  form, so this is a wire format change for such peers.
+//  Frames are sent straight from the arguments without building a zmsg;
+//  f and m frames are sent by reference, without copying their data.
 
 int
 zsock_send (void *self, const char *picture, ...)
@@ -648,6 +667,112 @@ zsock_send (void *self, const char *picture, ...)
 }
 
 
+//  --------------------------------------------------------------------------
+//  zsock_vsend builds each frame directly as a zmq_msg_t, or sends the
+//  caller's zframe by reference, and never assembles a zmsg. It holds back
+//  one frame at a time, since it only knows whether to send that frame with
+//  MORE once it has the next one ('m' may contribute no frames at all).
+
+typedef struct {
+    void *dest;                 //  Socket (or actor) we're sending to
+    void *handle;               //  Its libzmq socket
+    zsock_stats_t *stats;       //  Its traffic counters, if any
+    zmq_msg_t msg;              //  Held frame, if not a zframe
+    zframe_t *frame;            //  Held frame, if a zframe
+    bool owned;                 //  Destroy held zframe after sending?
+    bool active;                //  Are we holding a frame?
+    int rc;                     //  -1 once any send has failed
+} s_sender_t;
+
+//  Send the held frame, if any. After a failed send we only drop frames,
+//  so that zero-copy data still gets released.
+
+static void
+s_sender_flush (s_sender_t *self, bool more)
+{
+    if (!self->active)
+        return;
+    if (self->frame) {
+        if (self->rc == 0) {
+            int flags = more? ZFRAME_MORE: 0;
+            if (!self->owned)
+                flags |= ZFRAME_REUSE;
+            self->rc = zframe_send (&self->frame, self->dest, flags);
+        }
+        if (self->owned)
+            zframe_destroy (&self->frame);
+        self->frame = NULL;
+    }
+    else {
+        if (self->rc == 0) {
+            size_t size = zmq_msg_size (&self->msg);
+            int64_t started = self->stats? zclock_usecs (): 0;
+            if (zmq_sendmsg (self->handle, &self->msg, more? ZMQ_SNDMORE: 0) == -1)
+                self->rc = -1;
+            if (self->stats)
+                zsock_stats_sent (self->stats, size, more, self->rc, started);
+        }
+        zmq_msg_close (&self->msg);
+        zmq_msg_init (&self->msg);
+    }
+    self->active = false;
+}
+
+//  Hold a frame that we built, taking ownership of its contents
+
+static void
+s_sender_msg (s_sender_t *self, zmq_msg_t *msg)
+{
+    s_sender_flush (self, true);
+    zmq_msg_move (&self->msg, msg);
+    zmq_msg_close (msg);
+    self->active = true;
+}
+
+//  Hold a copy of the supplied data
+
+static void
+s_sender_data (s_sender_t *self, const void *data, size_t size)
+{
+    zmq_msg_t msg;
+    int rc = zmq_msg_init_size (&msg, size);
+    assert (rc == 0);
+    if (size)
+        memcpy (zmq_msg_data (&msg), data, size);
+    s_sender_msg (self, &msg);
+}
+
+//  Hold a zframe; if not owned, we send it by reference and leave it as is
+
+static void
+s_sender_frame (s_sender_t *self, zframe_t *frame, bool owned)
+{
+    s_sender_flush (self, true);
+    self->frame = frame;
+    self->owned = owned;
+    self->active = true;
+}
+
+//  Hold an integer, as decimal text or in network byte order
+
+static void
+s_sender_number (s_sender_t *self, uint64_t number, size_t size, bool is_signed, bool binary)
+{
+    byte buffer [24];
+    size_t length = 0;
+    if (binary) {
+        for (length = 0; length < size; length++)
+            buffer [length] = (byte) (number >> (8 * (size - length - 1)));
+    }
+    else
+    if (is_signed)
+        length = snprintf ((char *) buffer, sizeof (buffer), "%" PRId64, (int64_t) number);
+    else
+        length = snprintf ((char *) buffer, sizeof (buffer), "%" PRIu64, number);
+    s_sender_data (self, buffer, length);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Send a 'picture' message to the socket (or actor). This is a va_list
 //  version of zsock_send (), so please consult its documentation for the
@@ -659,83 +784,133 @@ zsock_vsend (void *self, const char *picture, va_list argptr)
     assert (self);
     assert (picture);
 
-    zmsg_t *msg = zmsg_new ();
+    s_sender_t sender;
+    memset (&sender, 0, sizeof (sender));
+    sender.dest = self;
+    sender.handle = zsock_resolve (self);
+    sender.stats = zsock_stats_of (self);
+    zmq_msg_init (&sender.msg);
+    bool binary = false;
+    if (*picture == '#') {
+        binary = true;
+        picture++;
+    }
     while (*picture) {
         if (*picture == 'i')
-            zmsg_addstrf (msg, "%d", va_arg (argptr, int));
+            s_sender_number (&sender, (int64_t) va_arg (argptr, int), 4, true, binary);
         else
         if (*picture == '1')
-            zmsg_addstrf (msg, "%" PRIu8, (uint8_t) va_arg (argptr, int));
+            s_sender_number (&sender, (uint8_t) va_arg (argptr, int), 1, false, binary);
         else
         if (*picture == '2')
-            zmsg_addstrf (msg, "%" PRIu16, (uint16_t) va_arg (argptr, int));
+            s_sender_number (&sender, (uint16_t) va_arg (argptr, int), 2, false, binary);
         else
         if (*picture == '4')
-            zmsg_addstrf (msg, "%" PRIu32, va_arg (argptr, uint32_t));
+            s_sender_number (&sender, va_arg (argptr, uint32_t), 4, false, binary);
         else
         if (*picture == '8')
-            zmsg_addstrf (msg, "%" PRIu64, va_arg (argptr, uint64_t));
+            s_sender_number (&sender, va_arg (argptr, uint64_t), 8, false, binary);
         else
         if (*picture == 'u')    //  Deprecated, use 4 or 8 instead
-            zmsg_addstrf (msg, "%ud", va_arg (argptr, uint));
+            s_sender_number (&sender, va_arg (argptr, uint), 4, false, binary);
         else
-        if (*picture == 's')
-            zmsg_addstr (msg, va_arg (argptr, char *));
+        if (*picture == 's') {
+            char *string = va_arg (argptr, char *);
+            assert (string);
+            s_sender_data (&sender, string, strlen (string));
+        }
         else
         if (*picture == 'b') {
             //  Note function arguments may be expanded in reverse order,
             //  so we cannot use va_arg macro twice in a single call
             byte *data = va_arg (argptr, byte *);
-            zmsg_addmem (msg, data, va_arg (argptr, int));
+            s_sender_data (&sender, data, va_arg (argptr, int));
         }
         else
         if (*picture == 'c') {
             zchunk_t *chunk = va_arg (argptr, zchunk_t *);
             assert (zchunk_is (chunk));
-            zmsg_addmem (msg, zchunk_data (chunk), zchunk_size (chunk));
+            s_sender_data (&sender, zchunk_data (chunk), zchunk_size (chunk));
         }
         else
         if (*picture == 'f') {
             zframe_t *frame = va_arg (argptr, zframe_t *);
             assert (zframe_is (frame));
-            zmsg_addmem (msg, zframe_data (frame), zframe_size (frame));
+            s_sender_frame (&sender, frame, false);
         }
         else
         if (*picture == 'U') {
             zuuid_t *uuid = va_arg (argptr, zuuid_t *);
-            zmsg_addmem (msg, zuuid_data (uuid), zuuid_size (uuid));
+            s_sender_data (&sender, zuuid_data (uuid), zuuid_size (uuid));
         }
         else
         if (*picture == 'p') {
             void *pointer = va_arg (argptr, void *);
-            zmsg_addmem (msg, &pointer, sizeof (void *));
+            s_sender_data (&sender, &pointer, sizeof (void *));
         }
         else
         if (*picture == 'h') {
             zhashx_t *hash = va_arg (argptr, zhashx_t *);
-            zframe_t *frame = zhashx_pack (hash);
-            zmsg_append (msg, &frame);
+            s_sender_frame (&sender, zhashx_pack (hash), true);
         }
         else
         if (*picture == 'm') {
             zframe_t *frame;
             zmsg_t *zmsg = va_arg (argptr, zmsg_t *);
             for (frame = zmsg_first (zmsg); frame;
-                 frame = zmsg_next (zmsg) ) {
-                zframe_t *frame_dup = zframe_dup (frame);
-                zmsg_append (msg, &frame_dup);
+                 frame = zmsg_next (zmsg) )
+                s_sender_frame (&sender, frame, false);
+        }
+        else
+        if (*picture == 'x') {
+            void *data = va_arg (argptr, void *);
+            size_t size = va_arg (argptr, size_t);
+            zframe_free_fn *free_fn = va_arg (argptr, zframe_free_fn *);
+            void *hint = va_arg (argptr, void *);
+            zmq_msg_t msg;
+            if (zmq_msg_init_data (&msg, data, size, free_fn, hint) == 0)
+                s_sender_msg (&sender, &msg);
+            else {
+                if (free_fn)
+                    free_fn (data, hint);
+                sender.rc = -1;
             }
         }
         else
         if (*picture == 'z')
-            zmsg_addmem (msg, NULL, 0);
+            s_sender_data (&sender, NULL, 0);
         else {
             zsys_error ("zsock: invalid picture element '%c'", *picture);
             assert (false);
         }
         picture++;
     }
-    return zmsg_send (&msg, self);
+    s_sender_flush (&sender, false);
+    zmq_msg_close (&sender.msg);
+    return sender.rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Pop a binary integer of the given size from the message into number.
+//  Returns 0 if OK, or -1 if the frame is missing or is not exactly that
+//  size, in which case number is zero.
+
+static int
+s_pop_number (zmsg_t *msg, size_t size, uint64_t *number)
+{
+    *number = 0;
+    zframe_t *frame = zmsg_pop (msg);
+    if (!frame || zframe_size (frame) != size) {
+        zframe_destroy (&frame);
+        return -1;
+    }
+    const byte *data = zframe_peek (frame);
+    size_t index;
+    for (index = 0; index < size; index++)
+        *number = (*number << 8) + data [index];
+    zframe_destroy (&frame);
+    return 0;
 }
 
 
@@ -768,6 +943,9 @@ zsock_vsend (void *self, const char *picture, va_list argptr)
 //  If an argument pointer is NULL, does not store any value (skips it).
 //  An 'n' picture matches an empty frame; if the message does not match,
 //  the method will return -1.
+//  A picture that starts with '#' expects binary integers, as sent by a
+//  '#' picture. If a binary integer frame is missing or has the wrong
+//  size, the integer reads as zero and the method returns -1.
 
 int
 zsock_recv (void *self, const char *picture, ...)
@@ -800,7 +978,54 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
     }
     //  Now parse message according to picture argument
     int rc = 0;
+    bool binary = false;
+    if (*picture == '#') {
+        binary = true;
+        picture++;
+    }
     while (*picture) {
+        if (binary && strchr ("i1248u", *picture)) {
+            //  Binary integers are the exact size, in network byte order
+            size_t size = *picture == '1'? 1: *picture == '2'? 2: *picture == '8'? 8: 4;
+            uint64_t number;
+            if (s_pop_number (msg, size, &number))
+                rc = -1;
+            if (*picture == 'i') {
+                int *int_p = va_arg (argptr, int *);
+                if (int_p)
+                    *int_p = (int32_t) number;
+            }
+            else
+            if (*picture == '1') {
+                uint8_t *uint8_p = va_arg (argptr, uint8_t *);
+                if (uint8_p)
+                    *uint8_p = (uint8_t) number;
+            }
+            else
+            if (*picture == '2') {
+                uint16_t *uint16_p = va_arg (argptr, uint16_t *);
+                if (uint16_p)
+                    *uint16_p = (uint16_t) number;
+            }
+            else
+            if (*picture == '4') {
+                uint32_t *uint32_p = va_arg (argptr, uint32_t *);
+                if (uint32_p)
+                    *uint32_p = (uint32_t) number;
+            }
+            else
+            if (*picture == '8') {
+                uint64_t *uint64_p = va_arg (argptr, uint64_t *);
+                if (uint64_p)
+                    *uint64_p = number;
+            }
+            else {
+                uint *uint_p = va_arg (argptr, uint *);
+                if (uint_p)
+                    *uint_p = (uint) number;
+            }
+        }
+        else
         if (*picture == 'i') {
             char *string = zmsg_popstr (msg);
             int *int_p = va_arg (argptr, int *);
@@ -866,7 +1091,7 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
                 if (frame) {
                     *size = zframe_size (frame);
                     *data_p = (byte *) malloc (*size);
-                    memcpy (*data_p, zframe_data (frame), *size);
+                    memcpy (*data_p, zframe_peek (frame), *size);
                 }
                 else {
                     *data_p = NULL;
@@ -881,7 +1106,7 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
             zchunk_t **chunk_p = va_arg (argptr, zchunk_t **);
             if (chunk_p) {
                 if (frame)
-                    *chunk_p = zchunk_new (zframe_data (frame), zframe_size (frame));
+                    *chunk_p = zchunk_new (zframe_peek (frame), zframe_size (frame));
                 else
                     *chunk_p = NULL;
             }
@@ -903,7 +1128,7 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
             if (uuid_p) {
                 if (frame) {
                     *uuid_p = zuuid_new ();
-                    zuuid_set (*uuid_p, zframe_data (frame));
+                    zuuid_set (*uuid_p, zframe_peek (frame));
                 }
                 else
                     *uuid_p = NULL;
@@ -917,7 +1142,7 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
             if (pointer_p) {
                 if (frame) {
                     if (zframe_size (frame) == sizeof (void *))
-                        *pointer_p = *((void **) zframe_data (frame));
+                        *pointer_p = *((void * const *) zframe_peek (frame));
                     else
                         rc = -1;
                 }
@@ -966,88 +1191,6 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
 }
 
 
-//  --------------------------------------------------------------------------
-//  Network data encoding macros that we use in bsend/brecv
-
-//  Put a 1-byte number to the frame
-#define PUT_NUMBER1(host) { \
-    *(byte *) needle = (host); \
-    needle++; \
-}
-
-//  Put a 2-byte number to the frame
-#define PUT_NUMBER2(host) { \
-    needle [0] = (byte) (((host) >> 8)  & 255); \
-    needle [1] = (byte) (((host))       & 255); \
-    needle += 2; \
-}
-
-//  Put a 4-byte number to the frame
-#define PUT_NUMBER4(host) { \
-    needle [0] = (byte) (((host) >> 24) & 255); \
-    needle [1] = (byte) (((host) >> 16) & 255); \
-    needle [2] = (byte) (((host) >> 8)  & 255); \
-    needle [3] = (byte) (((host))       & 255); \
-    needle += 4; \
-}
-
-//  Put a 8-byte number to the frame
-#define PUT_NUMBER8(host) { \
-    needle [0] = (byte) (((host) >> 56) & 255); \
-    needle [1] = (byte) (((host) >> 48) & 255); \
-    needle [2] = (byte) (((host) >> 40) & 255); \
-    needle [3] = (byte) (((host) >> 32) & 255); \
-    needle [4] = (byte) (((host) >> 24) & 255); \
-    needle [5] = (byte) (((host) >> 16) & 255); \
-    needle [6] = (byte) (((host) >> 8)  & 255); \
-    needle [7] = (byte) (((host))       & 255); \
-    needle += 8; \
-}
-
-//  Get a 1-byte number from the frame
-#define GET_NUMBER1(host) { \
-    if (needle + 1 > ceiling) \
-        goto malformed; \
-    (host) = *(byte *) needle; \
-    needle++; \
-}
-
-//  Get a 2-byte number from the frame
-#define GET_NUMBER2(host) { \
-    if (needle + 2 > ceiling) \
-        goto malformed; \
-    (host) = ((uint16_t) (needle [0]) << 8) \
-           +  (uint16_t) (needle [1]); \
-    needle += 2; \
-}
-
-//  Get a 4-byte number from the frame
-#define GET_NUMBER4(host) { \
-    if (needle + 4 > ceiling) \
-        goto malformed; \
-    (host) = ((uint32_t) (needle [0]) << 24) \
-           + ((uint32_t) (needle [1]) << 16) \
-           + ((uint32_t) (needle [2]) << 8) \
-           +  (uint32_t) (needle [3]); \
-    needle += 4; \
-}
-
-//  Get a 8-byte number from the frame
-#define GET_NUMBER8(host) { \
-    if (needle + 8 > ceiling) \
-        goto malformed; \
-    (host) = ((uint64_t) (needle [0]) << 56) \
-           + ((uint64_t) (needle [1]) << 48) \
-           + ((uint64_t) (needle [2]) << 40) \
-           + ((uint64_t) (needle [3]) << 32) \
-           + ((uint64_t) (needle [4]) << 24) \
-           + ((uint64_t) (needle [5]) << 16) \
-           + ((uint64_t) (needle [6]) << 8) \
-           +  (uint64_t) (needle [7]); \
-    needle += 8; \
-}
-
-
 //  --------------------------------------------------------------------------
 //  Send a binary encoded 'picture' message to the socket (or actor). This
 //  method is similar to zsock_send, except the arguments are encoded in a
@@ -1070,6 +1213,9 @@ zsock_vrecv (void *self, const char *picture, va_list argptr)
 //
 //  Does not change or take ownership of any arguments. Returns 0 if
 //  successful, -1 if sending failed for any reason.
+//  The socket keeps each picture it sees in compiled form, so it checks
+//  and sizes each picture once; see zpicture. A picture may have any
+//  number of 'f' elements.
 
 int
 zsock_bsend (void *self, const char *picture, ...)
@@ -1077,176 +1223,17 @@ zsock_bsend (void *self, const char *picture, ...)
     assert (self);
     assert (picture);
 
-    //  Pass 1: calculate total size of data frame
-    size_t frame_size = 0;
-    zframe_t *frames [ZSOCK_BSEND_MAX_FRAMES]; //  Non-data frames to send
-    size_t nbr_frames = 0;                     //  Size of this table
-    va_list argptr;
-    va_start (argptr, picture);
-    const char *picptr = picture;
-    while (*picptr) {
-        if (*picptr == '1') {
-            va_arg (argptr, int);
-            frame_size += 1;
-        }
-        else
-        if (*picptr == '2') {
-            va_arg (argptr, int);
-            frame_size += 2;
-        }
-        else
-        if (*picptr == '4') {
-            va_arg (argptr, uint32_t);
-            frame_size += 4;
-        }
-        else
-        if (*picptr == '8') {
-            va_arg (argptr, uint64_t);
-            frame_size += 8;
-        }
-        else
-        if (*picptr == 's') {
-            char *string = va_arg (argptr, char *);
-            frame_size += 1 + (string? strlen (string): 0);
-        }
-        else
-        if (*picptr == 'S') {
-            char *string = va_arg (argptr, char *);
-            frame_size += 4 + (string? strlen (string): 0);
-        }
-        else
-        if (*picptr == 'c') {
-            zchunk_t *chunk = va_arg (argptr, zchunk_t *);
-            frame_size += 4 + (chunk? zchunk_size (chunk): 0);
-        }
-        else
-        if (*picptr == 'p') {
-            va_arg (argptr, void *);
-            frame_size += sizeof (void *);
-        }
-        else
-        if (*picptr == 'f') {
-            zframe_t *frame = va_arg (argptr, zframe_t *);
-            assert (nbr_frames < ZSOCK_BSEND_MAX_FRAMES - 1);
-            frames [nbr_frames++] = frame;
-        }
-        else
-        if (*picptr == 'u') {
-            zuuid_t *uuid = va_arg (argptr, zuuid_t *);
-            frame_size += zuuid_size (uuid);
-        }
-        else
-        if (*picptr == 'm') {
-            if (picptr [1]) {
-                zsys_error ("zsock_bsend: 'm' (zmsg) only valid at end of picptr");
-                assert (false);
-            }
-            zmsg_t *msg = va_arg (argptr, zmsg_t *);
-            if (msg) {
-                zframe_t *frame = zmsg_first (msg);
-                while (frame) {
-                    assert (nbr_frames < ZSOCK_BSEND_MAX_FRAMES - 1);
-                    frames [nbr_frames++] = frame;
-                    frame = zmsg_next (msg);
-                }
-            }
-            else
-                frames [nbr_frames++] = zframe_new_empty ();
-        }
-        else {
-            zsys_error ("zsock_bsend: invalid picptr element '%c'", *picptr);
-            assert (false);
-        }
-        picptr++;
-    }
-    va_end (argptr);
-
-    //  Pass 2: encode data into data frame
-    zmq_msg_t msg;
-    zmq_msg_init_size (&msg, frame_size);
-    byte *needle = (byte *) zmq_msg_data (&msg);
+    //  A bare libzmq socket has nowhere to keep the compiled picture
+    zpicture_t *compiled = s_compiled_picture (self, picture);
+    zpicture_t *transient = compiled? NULL: zpicture_new (picture);
+    assert (compiled || transient);
 
+    va_list argptr;
     va_start (argptr, picture);
-    picptr = picture;
-    while (*picptr) {
-        if (*picptr == '1') {
-            int number1 = va_arg (argptr, int);
-            PUT_NUMBER1 (number1);
-        }
-        else
-        if (*picptr == '2') {
-            int number2 = va_arg (argptr, int);
-            PUT_NUMBER2 (number2);
-        }
-        else
-        if (*picptr == '4') {
-            uint32_t number4 = va_arg (argptr, uint32_t);
-            PUT_NUMBER4 (number4);
-        }
-        else
-        if (*picptr == '8') {
-            uint64_t number8 = va_arg (argptr, uint64_t);
-            PUT_NUMBER8 (number8);
-        }
-        else
-        if (*picptr == 'p') {
-            void *pointer = va_arg (argptr, void *);
-            memcpy (needle, &pointer, sizeof (void *));
-            needle += sizeof (void *);
-        }
-        else
-        if (*picptr == 's') {
-            char *string = va_arg (argptr, char *);
-            if (!string)
-                string = "";
-            size_t string_size = strlen (string);
-            PUT_NUMBER1 ((byte) string_size);
-            memcpy (needle, string, string_size);
-            needle += string_size;
-        }
-        else
-        if (*picptr == 'S') {
-            char *string = va_arg (argptr, char *);
-            if (!string)
-                string = "";
-            size_t string_size = strlen (string);
-            PUT_NUMBER4 (string_size);
-            memcpy (needle, string, string_size);
-            needle += string_size;
-        }
-        else
-        if (*picptr == 'c') {
-            zchunk_t *chunk = va_arg (argptr, zchunk_t *);
-            if (chunk) {
-                PUT_NUMBER4 (zchunk_size (chunk));
-                memcpy (needle, zchunk_data (chunk), zchunk_size (chunk));
-                needle += zchunk_size (chunk);
-            }
-        }
-        else
-        if (*picptr == 'u') {
-            zuuid_t *uuid = va_arg (argptr, zuuid_t *);
-            if (uuid) {
-                memcpy (needle, zuuid_data (uuid), zuuid_size (uuid));
-                needle += zuuid_size (uuid);
-            }
-        }
-        picptr++;
-    }
+    int rc = zpicture_vsend (compiled? compiled: transient, self, argptr);
     va_end (argptr);
-
-    //  Now send the data frame
-    void *handle = zsock_resolve (self);
-    zmq_msg_send (&msg, handle, nbr_frames? ZMQ_SNDMORE: 0);
-
-    //  Now send any additional frames
-    unsigned int frame_nbr;
-    for (frame_nbr = 0; frame_nbr < nbr_frames; frame_nbr++) {
-        bool more = frame_nbr < nbr_frames - 1;
-        zframe_send (&frames [frame_nbr], handle,
-                     ZFRAME_REUSE + (more? ZFRAME_MORE: 0));
-    }
-    return 0;
+    zpicture_destroy (&transient);
+    return rc;
 }
 
 
@@ -1260,155 +1247,315 @@ zsock_bsend (void *self, const char *picture, ...)
 //  values held on a per-socket basis. Do not modify or destroy the returned
 //  values. Returns 0 if successful, or -1 if it failed to read a message.
 
-//  This is the largest size we allow for an incoming longstr or chunk (1M)
-#define MAX_ALLOC_SIZE      1024 * 1024
-
 int
-zsock_brecv (void *selfish, const char *picture, ...)
+zsock_brecv (void *self, const char *picture, ...)
 {
-    assert (selfish);           //  Kind of self
+    assert (self);
     assert (picture);
 
-    zmq_msg_t msg;
-    zmq_msg_init (&msg);
-    if (zmq_msg_recv (&msg, zsock_resolve (selfish), 0) == -1)
-        return -1;              //  Interrupted
+    zpicture_t *compiled = s_compiled_picture (self, picture);
+    assert (compiled);
+
+    va_list argptr;
+    va_start (argptr, picture);
+    int rc = zpicture_vrecv (compiled, self, argptr);
+    va_end (argptr);
+    return rc;
+}
 
-    //  If we don't have a string cache, create one now with arbitrary
-    //  value; this will grow if needed. Do not use an initial size less
-    //  than 256, or cache expansion will not work properly.
-    zsock_t *self = (zsock_t *) selfish;
-    if (zactor_is (selfish))
-        self = zactor_sock ((zactor_t *) selfish);
 
-    if (!self->cache) {
-        self->cache = (char *) malloc (512);
-        self->cache_size = 512;
-    }
-    //  Last received strings are cached per socket
-    uint cache_used = 0;
-    byte *needle = (byte *) zmq_msg_data (&msg);
-    byte *ceiling = needle + zmq_msg_size (&msg);
+//  --------------------------------------------------------------------------
+//  Receive a binary encoded 'picture' message from the socket (or actor),
+//  returning views into the received data instead of copies, as for
+//  zpicture_recv_view. Strings, chunks, and frames each take a const
+//  byte ** and a size_t *; strings are not null-terminated. The views are
+//  valid until the next zsock_brecv_view with the same picture on this
+//  socket, or until the socket is destroyed. Returns 0 if successful, or
+//  -1 if it failed to read a message.
+
+int
+zsock_brecv_view (void *self, const char *picture, ...)
+{
+    assert (self);
+    assert (picture);
+
+    zpicture_t *compiled = s_compiled_picture (self, picture);
+    assert (compiled);
 
     va_list argptr;
     va_start (argptr, picture);
-    const char *picptr = picture;
-    while (*picptr) {
-        if (*picptr == '1') {
-            uint8_t *number1_p = va_arg (argptr, uint8_t *);
-            GET_NUMBER1 (*number1_p);
-        }
-        else
-        if (*picptr == '2') {
-            uint16_t *number2_p = va_arg (argptr, uint16_t *);
-            GET_NUMBER2 (*number2_p);
-        }
-        else
-        if (*picptr == '4') {
-            uint32_t *number4_p = va_arg (argptr, uint32_t *);
-            GET_NUMBER4 (*number4_p);
-        }
-        else
-        if (*picptr == '8') {
-            uint64_t *number8_p = va_arg (argptr, uint64_t *);
-            GET_NUMBER8 (*number8_p);
+    int rc = zpicture_vrecv_view (compiled, self, argptr);
+    va_end (argptr);
+    return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive up to limit messages from the socket (or actor) without blocking,
+//  storing them in the msgs array in order. Entries that already hold a
+//  message are reused: the message is emptied and refilled, reusing its
+//  frames, so a caller that keeps the array between calls does not need to
+//  allocate new objects. Entries that are NULL get a new message. Stops at
+//  the first message that is not waiting, and leaves that entry and all
+//  entries after it unchanged. Returns the number of messages received, 0
+//  if none were waiting, or -1 if the receive was interrupted before any
+//  message was received. If interrupted part way through a message, that
+//  entry is destroyed and set to NULL.
+
+int
+zsock_recv_batch (void *self, zmsg_t **msgs, size_t limit)
+{
+    assert (self);
+    assert (msgs);
+
+    void *handle = zsock_resolve (self);
+    size_t count = 0;
+    while (count < limit) {
+        zmsg_t *msg = msgs [count];
+        //  The message's old frames are at its head, and we append the new
+        //  frames at its tail, so we can recycle the old frames as we go
+        size_t old_frames = msg? zmsg_size (msg): 0;
+        zframe_t *frame = old_frames? zmsg_pop (msg): zframe_new_empty ();
+        assert (frame);
+        if (zframe_recv_resolved (frame, self, handle, ZFRAME_DONTWAIT)) {
+            bool again = zmq_errno () == EAGAIN;
+            if (old_frames)
+                zmsg_prepend (msg, &frame);
+            else
+                zframe_destroy (&frame);
+            if (again)
+                break;
+            return count? (int) count: -1;
         }
-        else
-        if (*picptr == 'p') {
-            void **pointer_p = va_arg (argptr, void **);
-            memcpy (pointer_p, needle, sizeof (void *));
-            needle += sizeof (void *);
+        if (!msg) {
+            msg = msgs [count] = zmsg_new ();
+            assert (msg);
         }
         else
-        if (*picptr == 's') {
-            char **string_p = va_arg (argptr, char **);
-            uint string_size;
-            GET_NUMBER1 (string_size);
-            if (needle + string_size > ceiling)
-                goto malformed;
-            //  Expand cache if we need to; string is guaranteed to fit into
-            //  expansion space
-            if (cache_used + string_size > self->cache_size) {
-                puts ("REALLOC");
-                self->cache_size *= 2;
-                self->cache = (char *) realloc (self->cache, self->cache_size);
-                assert (self->cache);
+            old_frames--;
+        //  libzmq delivers multipart messages atomically, so once the first
+        //  frame has arrived, the others are waiting too
+        bool more = zframe_more (frame) == 1;
+        zmsg_append (msg, &frame);
+        while (more) {
+            frame = old_frames? zmsg_pop (msg): zframe_new_empty ();
+            if (old_frames)
+                old_frames--;
+            if (zframe_recv_resolved (frame, self, handle, ZFRAME_DONTWAIT)) {
+                zframe_destroy (&frame);
+                zmsg_destroy (&msgs [count]);
+                return count? (int) count: -1;
             }
-            *string_p = self->cache + cache_used;
-            memcpy (*string_p, needle, string_size);
-            cache_used += string_size;
-            self->cache [cache_used++] = 0;
-            needle += string_size;
-        }
-        else
-        if (*picptr == 'S') {
-            char **string_p = va_arg (argptr, char **);
-            size_t string_size;
-            GET_NUMBER4 (string_size);
-            if (string_size > MAX_ALLOC_SIZE
-            ||  needle + string_size > (ceiling))
-                goto malformed;
-            *string_p = (char *) malloc (string_size + 1);
-            assert (string_p);
-            memcpy (*string_p, needle, string_size);
-            (*string_p) [string_size] = 0;
-            needle += string_size;
-        }
-        else
-        if (*picptr == 'c') {
-            zchunk_t **chunk_p = va_arg (argptr, zchunk_t **);
-            size_t chunk_size;
-            GET_NUMBER4 (chunk_size);
-            if (chunk_size > MAX_ALLOC_SIZE
-            ||  needle + chunk_size > (ceiling))
-                goto malformed;
-            *chunk_p = zchunk_new (needle, chunk_size);
-            needle += chunk_size;
+            more = zframe_more (frame) == 1;
+            zmsg_append (msg, &frame);
         }
-        else
-        if (*picptr == 'u') {
-            zuuid_t **uuid_p = va_arg (argptr, zuuid_t **);
-            *uuid_p = zuuid_new ();
-            if (zuuid_size (*uuid_p) > MAX_ALLOC_SIZE
-            ||  needle + zuuid_size (*uuid_p) > (ceiling))
-                goto malformed;
-            zuuid_set (*uuid_p, needle);
-            needle += zuuid_size (*uuid_p);
+        while (old_frames--) {
+            frame = zmsg_pop (msg);
+            zframe_destroy (&frame);
         }
-        else
-        if (*picptr == 'f') {
-            zframe_t **frame_p = va_arg (argptr, zframe_t **);
-            //  Get next frame off socket
-            if (!zsock_rcvmore (self))
-                goto malformed;
-            *frame_p = zframe_recv (self);
+        count++;
+    }
+    return (int) count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Receive up to limit frames from the socket (or actor) without blocking,
+//  storing them in the frames array in order. This is the frame level
+//  version of zsock_recv_batch, for callers that handle each frame as it
+//  comes and check zframe_more for message boundaries. Entries that already
+//  hold a frame are reused, and entries that are NULL get a new frame.
+//  Stops at the first frame that is not waiting, and leaves that entry and
+//  all entries after it unchanged. Returns the number of frames received,
+//  0 if none were waiting, or -1 if the receive was interrupted before any
+//  frame was received.
+
+int
+zsock_recv_frames (void *self, zframe_t **frames, size_t limit)
+{
+    assert (self);
+    assert (frames);
+
+    void *handle = zsock_resolve (self);
+    size_t count = 0;
+    while (count < limit) {
+        zframe_t *frame = frames [count]? frames [count]: zframe_new_empty ();
+        assert (frame);
+        if (zframe_recv_resolved (frame, self, handle, ZFRAME_DONTWAIT)) {
+            bool again = zmq_errno () == EAGAIN;
+            if (!frames [count])
+                zframe_destroy (&frame);
+            if (again)
+                break;
+            return count? (int) count: -1;
         }
-        else
-        if (*picptr == 'm') {
-            if (picptr [1]) {
-                zsys_error ("zsock_brecv: 'm' (zmsg) only valid at end of picptr");
-                assert (false);
+        frames [count++] = frame;
+    }
+    return (int) count;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Send count messages from the msgs array to the socket (or actor), in
+//  order. Each message that is sent is destroyed and its entry set to NULL,
+//  as for zmsg_send. Stops at the first message that fails to send, which
+//  stays with the caller along with all the messages after it. Returns the
+//  number of messages sent.
+
+int
+zsock_send_batch (void *self, zmsg_t **msgs, size_t count)
+{
+    assert (self);
+    assert (msgs);
+
+    void *handle = zsock_resolve (self);
+    size_t index;
+    for (index = 0; index < count; index++) {
+        zmsg_t *msg = msgs [index];
+        if (!msg)
+            continue;
+        assert (zmsg_is (msg));
+        zframe_t *frame = zmsg_pop (msg);
+        while (frame) {
+            int flags = zmsg_size (msg)? ZFRAME_MORE: 0;
+            if (zframe_send_resolved (&frame, self, handle, flags)) {
+                zmsg_prepend (msg, &frame);
+                return (int) index;
             }
-            zmsg_t **msg_p = va_arg (argptr, zmsg_t **);
-            //  Get zero or more remaining frames
-            if (!zsock_rcvmore (self))
-                goto malformed;
-            *msg_p = zmsg_recv (self);
+            frame = zmsg_pop (msg);
         }
-        else {
-            zsys_error ("zsock_brecv: invalid picptr element '%c'", *picptr);
-            assert (false);
-        }
-        picptr++;
+        zmsg_destroy (&msgs [index]);
     }
-    va_end (argptr);
-    zmq_msg_close (&msg);
-    return 0;
+    return (int) index;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return a snapshot of the traffic counters of the socket (or actor). If
+//  the socket does not count its traffic (see zsys_set_socket_stats), sets
+//  all the counters to zero.
+
+void
+zsock_stats (void *self, zsock_stats_t *stats)
+{
+    assert (self);
+    assert (stats);
+    zsock_stats_t *counters = zsock_stats_of (self);
+    if (counters)
+        *stats = *counters;
+    else
+        memset (stats, 0, sizeof (zsock_stats_t));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Apply a socket tuning profile to the socket (or actor), setting a group
+//  of options in one call. The built-in profiles are "low-latency" (short
+//  queues, immediate, no linger, fast reconnect, TCP keepalives),
+//  "bulk-throughput" (deep queues, 4MB kernel buffers, a larger backlog,
+//  and 5 seconds linger), and "lossy-telemetry" (short queues, sends that
+//  fail instead of blocking, and conflate). The lossy-telemetry profile
+//  only fits PUB, SUB, PUSH, and PULL sockets sending single-frame
+//  messages, as conflate does not support multipart messages.
+//  Applications can add their own profiles with zsys_load_socket_profiles,
+//  and set a profile for all new sockets with zsys_set_socket_profile.
+//  Options set later override the profile. Returns 0 if OK, or -1 if the
+//  profile is unknown, or does not fit the socket type.
+
+int
+zsock_set_profile (void *self, const char *profile)
+{
+    assert (self);
+    assert (profile);
+    return zsys_socket_profile_apply (self, profile);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the traffic counters of the socket (or actor), or NULL if it does
+//  not count its traffic, or is a bare libzmq socket. Not a part of the
+//  official interface.
+
+zsock_stats_t *
+zsock_stats_of (void *self)
+{
+    if (zsock_is (self)) {
+        zsock_t *sock = (zsock_t *) self;
+        return sock->counting? &sock->stats: NULL;
+    }
+    else
+    if (zactor_is (self))
+        return zsock_stats_of (zactor_sock ((zactor_t *) self));
+    else
+        return NULL;
+}
 
-    //  Error return
-    malformed:
-        zmq_msg_close (&msg);
-        return -1;              //  Invalid message
+
+//  --------------------------------------------------------------------------
+//  Count a frame sent, or a failed send if rc is -1. If started is not zero,
+//  it is the time the send started, and we count the time it took. Not a
+//  part of the official interface.
+
+void
+zsock_stats_sent (zsock_stats_t *stats, size_t bytes, bool more, int rc, int64_t started)
+{
+    if (rc == -1) {
+        if (errno == EAGAIN)
+            stats->send_again++;
+    }
+    else {
+        stats->bytes_sent += bytes;
+        if (!more)
+            stats->msgs_sent++;
+    }
+    if (started) {
+        uint64_t waited = (uint64_t) (zclock_usecs () - started);
+        stats->send_wait_usecs += waited;
+        if (stats->send_wait_max_usecs < waited)
+            stats->send_wait_max_usecs = waited;
+    }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Count a frame received. Not a part of the official interface.
+
+void
+zsock_stats_received (zsock_stats_t *stats, size_t bytes, bool more)
+{
+    stats->bytes_received += bytes;
+    if (!more)
+        stats->msgs_received++;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the compiled form of a picture, which we keep on the socket (or
+//  actor), so that we check and size each picture once. Returns NULL if
+//  self is a bare libzmq socket, and asserts if the picture is not valid.
+
+static zpicture_t *
+s_compiled_picture (void *self, const char *picture)
+{
+    zsock_t *sock = (zsock_t *) self;
+    if (zactor_is (self))
+        sock = zactor_sock ((zactor_t *) self);
+    else
+    if (!zsock_is (self))
+        return NULL;
+
+    if (!sock->pictures) {
+        sock->pictures = zhashx_new ();
+        assert (sock->pictures);
+        zhashx_set_destructor (sock->pictures, (zhashx_destructor_fn *) zpicture_destroy);
+    }
+    zpicture_t *compiled = (zpicture_t *) zhashx_lookup (sock->pictures, picture);
+    if (!compiled) {
+        compiled = zpicture_new (picture);
+        assert (compiled);
+        zhashx_insert (sock->pictures, picture, compiled);
+    }
+    return compiled;
 }
 
 
@@ -1533,6 +1680,16 @@ zsock_resolve (void *self)
 //  We use the gossip messages for some test cases
 #include "zgossip_msg.h"
 
+//  Free the buffer sent by the zero-copy test, and flag that we did
+
+static void
+s_buffer_free (void *data, void *hint)
+{
+    assert (*((bool *) hint) == false);
+    *((bool *) hint) = true;
+    free (data);
+}
+
 //  --------------------------------------------------------------------------
 //  Selftest
 
@@ -1725,6 +1882,20 @@ zsock_test (bool verbose)
     zstr_free (&string);
     zmsg_destroy (&msg);
 
+    //  Test zero-copy frames; the buffer is released once, after the
+    //  reader is done with it
+    bool released = false;
+    char *buffer = strdup ("zero-copy");
+    rc = zsock_send (writer, "sx", "header", buffer, strlen (buffer), s_buffer_free, &released);
+    assert (rc == 0);
+    rc = zsock_recv (reader, "sf", &string, &frame);
+    assert (rc == 0);
+    assert (streq (string, "header"));
+    assert (zframe_streq (frame, "zero-copy"));
+    zstr_free (&string);
+    zframe_destroy (&frame);
+    assert (released);
+
     //  Test zsock_recv with null arguments
     chunk = zchunk_new ("HELLO", 5);
     assert (chunk);
@@ -1740,6 +1911,252 @@ zsock_test (bool verbose)
     assert (zchunk_size (chunk) == 5);
     zchunk_destroy (&chunk);
 
+    //  Test binary integers; each is sent as a frame of its exact size
+    rc = zsock_send (writer, "#i1248u", -12345, 123, 12345, 123456789,
+                     (uint64_t) 1234567890123456789ULL, 42);
+    assert (rc == 0);
+    msg = zmsg_recv (reader);
+    assert (zmsg_size (msg) == 6);
+    assert (zframe_size (zmsg_first (msg)) == 4);
+    assert (zframe_size (zmsg_next (msg)) == 1);
+    assert (zframe_size (zmsg_next (msg)) == 2);
+    assert (zframe_size (zmsg_next (msg)) == 4);
+    assert (zframe_size (zmsg_next (msg)) == 8);
+    assert (zframe_size (zmsg_next (msg)) == 4);
+    zmsg_destroy (&msg);
+
+    rc = zsock_send (writer, "#i1248u", -12345, 123, 12345, 123456789,
+                     (uint64_t) 1234567890123456789ULL, 42);
+    assert (rc == 0);
+    uint8_t binary1;
+    uint16_t binary2;
+    uint32_t binary4;
+    uint64_t binary8;
+    uint unsigned_int;
+    rc = zsock_recv (reader, "#i1248u", &integer, &binary1, &binary2,
+                     &binary4, &binary8, &unsigned_int);
+    assert (rc == 0);
+    assert (integer == -12345);
+    assert (binary1 == 123);
+    assert (binary2 == 12345);
+    assert (binary4 == 123456789);
+    assert (binary8 == 1234567890123456789ULL);
+    assert (unsigned_int == 42);
+
+    //  A binary integer frame of the wrong size, or a missing one, fails
+    rc = zsock_send (writer, "#2", 12345);
+    assert (rc == 0);
+    rc = zsock_recv (reader, "#48", &binary4, &binary8);
+    assert (rc == -1);
+    assert (binary4 == 0);
+    assert (binary8 == 0);
+
+    //  Deprecated u is sent as plain decimal text
+    rc = zsock_send (writer, "u", 42);
+    assert (rc == 0);
+    char *u_string = zstr_recv (reader);
+    assert (streq (u_string, "42"));
+    zstr_free (&u_string);
+
+    //  Test that frames and messages are sent without being changed, and
+    //  that an empty message at the end still terminates the message
+    frame = zframe_new ("frame", 5);
+    msg = zmsg_new ();
+    zmsg_addstr (msg, "body");
+    zmsg_t *empty = zmsg_new ();
+    rc = zsock_send (writer, "fmm", frame, msg, empty);
+    assert (rc == 0);
+    assert (zframe_streq (frame, "frame"));
+    assert (zmsg_size (msg) == 1);
+    zframe_destroy (&frame);
+    zmsg_destroy (&msg);
+    zmsg_destroy (&empty);
+    rc = zsock_recv (reader, "fm", &frame, &msg);
+    assert (rc == 0);
+    assert (zframe_streq (frame, "frame"));
+    assert (zmsg_size (msg) == 1);
+    assert (zframe_streq (zmsg_first (msg), "body"));
+    zframe_destroy (&frame);
+    zmsg_destroy (&msg);
+    rc = zsock_send (writer, "s", "next");
+    assert (rc == 0);
+    string = zstr_recv (reader);
+    assert (streq (string, "next"));
+    zstr_free (&string);
+
+    //  Test traffic counters; only sockets created while they are switched
+    //  on count their traffic
+    zsys_set_socket_stats (1);
+    zsock_t *counted_writer = zsock_new_push ("@inproc://zsock.stats");
+    assert (counted_writer);
+    zsock_t *counted_reader = zsock_new_pull (">inproc://zsock.stats");
+    assert (counted_reader);
+    zsock_t *lonely = zsock_new (ZMQ_DEALER);
+    assert (lonely);
+    zsys_set_socket_stats (0);
+    zsock_stats_t stats;
+    zsock_stats (writer, &stats);
+    assert (stats.msgs_sent == 0 && stats.bytes_sent == 0);
+
+    zsock_stats_t totals_before;
+    zsys_socket_stats (&totals_before);
+    zstr_send (counted_writer, "Hello");
+    zsock_send (counted_writer, "ss", "Hello", "World");
+    zsock_bsend (counted_writer, "4", 1234);
+    char *hello = zstr_recv (counted_reader);
+    zstr_free (&hello);
+    msg = zmsg_recv (counted_reader);
+    zmsg_destroy (&msg);
+    uint32_t bnumber;
+    zsock_brecv (counted_reader, "4", &bnumber);
+    assert (bnumber == 1234);
+
+    zsock_stats (counted_writer, &stats);
+    assert (stats.msgs_sent == 3);
+    assert (stats.bytes_sent == 19);
+    assert (stats.msgs_received == 0);
+    assert (stats.send_again == 0);
+    assert (stats.send_wait_max_usecs <= stats.send_wait_usecs);
+    zsock_stats (counted_reader, &stats);
+    assert (stats.msgs_received == 3);
+    assert (stats.bytes_received == 19);
+    assert (stats.msgs_sent == 0);
+
+    //  Non-blocking receives are counted too
+    zsock_send (counted_writer, "ss", "Hello", "World");
+    zclock_sleep (10);
+    msg = zmsg_recv_nowait (counted_reader);
+    assert (msg);
+    zmsg_destroy (&msg);
+    zsock_stats (counted_reader, &stats);
+    assert (stats.msgs_received == 4);
+    assert (stats.bytes_received == 29);
+
+    //  A non-blocking send with no peer to go to is refused
+    frame = zframe_new ("Hello", 5);
+    rc = zframe_send (&frame, lonely, ZFRAME_DONTWAIT);
+    assert (rc == -1);
+    zframe_destroy (&frame);
+    zsock_stats (lonely, &stats);
+    assert (stats.send_again == 1);
+    assert (stats.msgs_sent == 0);
+    zsock_destroy (&lonely);
+
+    //  Counters of closed sockets stay in the process totals
+    zsock_destroy (&counted_reader);
+    zsock_destroy (&counted_writer);
+    zsock_stats_t totals;
+    zsys_socket_stats (&totals);
+    assert (totals.msgs_sent == totals_before.msgs_sent + 4);
+    assert (totals.msgs_received == totals_before.msgs_received + 4);
+
+    //  Test socket tuning profiles
+    zsock_t *tuned = zsock_new (ZMQ_PUSH);
+    assert (tuned);
+    rc = zsock_set_profile (tuned, "bulk-throughput");
+    assert (rc == 0);
+#if (ZMQ_VERSION_MAJOR >= 3)
+    assert (zsock_sndhwm (tuned) == 100000);
+#endif
+    assert (zsock_sndbuf (tuned) == 4 * 1024 * 1024);
+    assert (zsock_linger (tuned) == 5000);
+    rc = zsock_set_profile (tuned, "low-latency");
+    assert (rc == 0);
+    assert (zsock_linger (tuned) == 0);
+    rc = zsock_set_profile (tuned, "lossy-telemetry");
+    assert (rc == 0);
+    assert (zsock_sndtimeo (tuned) == 0);
+    rc = zsock_set_profile (tuned, "no-such-profile");
+    assert (rc == -1);
+    zsock_destroy (&tuned);
+
+    //  The lossy profile does not fit other socket types
+    tuned = zsock_new (ZMQ_REQ);
+    assert (tuned);
+    rc = zsock_set_profile (tuned, "lossy-telemetry");
+    assert (rc == -1);
+    zsock_destroy (&tuned);
+    tuned = zsock_new (ZMQ_DEALER);
+    assert (tuned);
+    rc = zsock_set_profile (tuned, "lossy-telemetry");
+    assert (rc == -1);
+    assert (zsock_sndtimeo (tuned) == -1);
+    zsock_destroy (&tuned);
+
+    //  Test batched send and receive; messages in the array are reused
+    zmsg_t *batch [4] = { NULL, NULL, NULL, NULL };
+    int index;
+    for (index = 0; index < 4; index++) {
+        batch [index] = zmsg_new ();
+        zmsg_addstrf (batch [index], "%d", index);
+        if (index % 2)
+            zmsg_addstr (batch [index], "second frame");
+    }
+    rc = zsock_send_batch (writer, batch, 4);
+    assert (rc == 4);
+    for (index = 0; index < 4; index++)
+        assert (batch [index] == NULL);
+    rc = zsock_recv_batch (reader, batch, 3);
+    assert (rc == 3);
+    assert (zmsg_size (batch [0]) == 1);
+    assert (zmsg_size (batch [1]) == 2);
+    assert (zframe_streq (zmsg_first (batch [1]), "1"));
+    assert (zframe_streq (zmsg_next (batch [1]), "second frame"));
+    assert (zmsg_content_size (batch [1]) == 13);
+    rc = zsock_recv_batch (reader, &batch [1], 3);
+    assert (rc == 1);
+    assert (zmsg_size (batch [1]) == 2);
+    assert (zframe_streq (zmsg_first (batch [1]), "3"));
+    assert (batch [3] == NULL);
+    rc = zsock_recv_batch (reader, batch, 4);
+    assert (rc == 0);
+    //  A message with fewer frames than before reuses and trims it
+    zsock_send (writer, "s", "short");
+    rc = zsock_recv_batch (reader, &batch [1], 1);
+    assert (rc == 1);
+    assert (zmsg_size (batch [1]) == 1);
+    assert (zmsg_content_size (batch [1]) == 5);
+    assert (zframe_streq (zmsg_first (batch [1]), "short"));
+    //  An entry that gets no message is left as it was
+    rc = zsock_recv_batch (reader, &batch [1], 1);
+    assert (rc == 0);
+    assert (zframe_streq (zmsg_first (batch [1]), "short"));
+    for (index = 0; index < 4; index++)
+        zmsg_destroy (&batch [index]);
+
+    //  Test batched receive of frames, which reuses frames in the array
+    zframe_t *frames [4] = { NULL, NULL, NULL, NULL };
+    zsock_send (writer, "ss", "one", "two");
+    zsock_send (writer, "s", "three");
+    rc = zsock_recv_frames (reader, frames, 2);
+    assert (rc == 2);
+    assert (zframe_streq (frames [0], "one"));
+    assert (zframe_more (frames [0]));
+    assert (zframe_streq (frames [1], "two"));
+    assert (!zframe_more (frames [1]));
+    zframe_t *reused = frames [0];
+    rc = zsock_recv_frames (reader, frames, 4);
+    assert (rc == 1);
+    assert (frames [0] == reused);
+    assert (zframe_streq (frames [0], "three"));
+    assert (zframe_streq (frames [1], "two"));
+    assert (frames [2] == NULL);
+    for (index = 0; index < 4; index++)
+        zframe_destroy (&frames [index]);
+
+    //  Test zsock_brecv_view, which returns views into the message
+    chunk = zchunk_new ("Chunk", 5);
+    rc = zsock_bsend (writer, "sc", "String", chunk);
+    assert (rc == 0);
+    zchunk_destroy (&chunk);
+    const byte *view_string, *view_chunk;
+    size_t view_string_size, view_chunk_size;
+    rc = zsock_brecv_view (reader, "sc", &view_string, &view_string_size,
+                           &view_chunk, &view_chunk_size);
+    assert (rc == 0);
+    assert (view_string_size == 6 && memcmp (view_string, "String", 6) == 0);
+    assert (view_chunk_size == 5 && memcmp (view_chunk, "Chunk", 5) == 0);
+
     //  Test zsock_bsend/brecv pictures with binary encoding
     frame = zframe_new ("Hello", 5);
     chunk = zchunk_new ("World", 5);
@@ -1784,6 +2201,20 @@ zsock_test (bool verbose)
     assert (zgossip_msg_id (gossip) == ZGOSSIP_MSG_PUBLISH);
     zgossip_msg_destroy (&gossip);
 
+    //  Pictures may carry more frames than they used to allow
+    msg = zmsg_new ();
+    int frame_nbr;
+    for (frame_nbr = 0; frame_nbr < 100; frame_nbr++)
+        zmsg_addstrf (msg, "%d", frame_nbr);
+    rc = zsock_bsend (writer, "1m", 7, msg);
+    assert (rc == 0);
+    zmsg_destroy (&msg);
+    rc = zsock_brecv (reader, "1m", &number1, &msg);
+    assert (rc == 0);
+    assert (number1 == 7);
+    assert (zmsg_size (msg) == 100);
+    zmsg_destroy (&msg);
+
     zsock_destroy (&reader);
     zsock_destroy (&writer);
 
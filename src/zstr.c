@@ -42,12 +42,14 @@ s_send_string (void *dest, bool more, char *string)
     zmq_msg_t message;
     zmq_msg_init_size (&message, len);
     memcpy (zmq_msg_data (&message), string, len);
-    if (zmq_sendmsg (handle, &message, more ? ZMQ_SNDMORE : 0) == -1) {
+    zsock_stats_t *stats = zsock_stats_of (dest);
+    int64_t started = stats? zclock_usecs (): 0;
+    int rc = zmq_sendmsg (handle, &message, more ? ZMQ_SNDMORE : 0) == -1? -1: 0;
+    if (stats)
+        zsock_stats_sent (stats, len, more, rc, started);
+    if (rc == -1)
         zmq_msg_close (&message);
-        return -1;
-    }
-    else
-        return 0;
+    return rc;
 }
 
 
@@ -68,6 +70,9 @@ zstr_recv (void *source)
         return NULL;
 
     size_t size = zmq_msg_size (&message);
+    zsock_stats_t *stats = zsock_stats_of (source);
+    if (stats)
+        zsock_stats_received (stats, size, zmq_msg_more (&message));
     char *string = (char *) malloc (size + 1);
     if (string) {
         memcpy (string, zmq_msg_data (&message), size);
@@ -247,6 +252,9 @@ zstr_recv_nowait (void *dest)
         return NULL;
 
     size_t size = zmq_msg_size (&message);
+    zsock_stats_t *stats = zsock_stats_of (dest);
+    if (stats)
+        zsock_stats_received (stats, size, zmq_msg_more (&message));
     char *string = (char *) malloc (size + 1);
     if (string) {
         memcpy (string, zmq_msg_data (&message), size);
@@ -69,8 +69,11 @@ static size_t s_linger = 0;         //  ZSYS_LINGER=0
 static size_t s_sndhwm = 1000;      //  ZSYS_SNDHWM=1000
 static size_t s_rcvhwm = 1000;      //  ZSYS_RCVHWM=1000
 static size_t s_pipehwm = 1000;     //  ZSYS_PIPEHWM=1000
+static size_t s_object_pool = 0;    //  ZSYS_OBJECT_POOL=0
+static int s_socket_stats = 0;      //  ZSYS_SOCKET_STATS=0
 static int s_ipv6 = 0;              //  ZSYS_IPV6=0
 static char *s_interface = NULL;    //  ZSYS_INTERFACE=
+static char *s_socket_profile = NULL;   //  ZSYS_SOCKET_PROFILE=
 static char *s_logident = NULL;     //  ZSYS_LOGIDENT=
 static FILE *s_logstream = NULL;    //  ZSYS_LOGSTREAM=stdout/stderr
 static bool s_logsystem = false;    //  ZSYS_LOGSYSTEM=true/false
@@ -90,6 +93,36 @@ typedef struct {
     size_t line_nbr;
 } s_sockref_t;
 
+//  We keep a list of the traffic counters of open sockets, and the totals
+//  of closed sockets, so we can report process-wide traffic
+static zlist_t *s_statsref_list = NULL;
+static zsock_stats_t s_stats_closed;
+
+//  This defines the counters of a single zsock instance
+typedef struct {
+    zsock_stats_t *stats;
+    int type;
+    const char *filename;
+    size_t line_nbr;
+} s_statsref_t;
+
+//  Socket tuning profiles loaded by the application, each a child of this
+//  root, holding option = value items
+static zconfig_t *s_socket_profiles = NULL;
+
+//  This defines a socket option that profiles can set
+typedef struct {
+    const char *name;
+    void (*setter) (void *self, int value);
+} s_profile_option_t;
+
+//  This defines one option setting in a built-in profile
+typedef struct {
+    const char *profile;
+    const char *option;
+    int value;
+} s_profile_setting_t;
+
 //  Mutex macros
 #if defined (__UNIX__)
 typedef pthread_mutex_t zsys_mutex_t;
@@ -108,6 +141,106 @@ typedef CRITICAL_SECTION zsys_mutex_t;
 //  Mutex to guard socket counter
 static zsys_mutex_t s_mutex;
 
+//  When zsys_set_object_pool is set, each thread keeps the zframe_t and
+//  zmsg_t objects it destroys on a free list per type, up to the configured
+//  limit, and reuses them for new objects. A free object holds the link to
+//  the next one in its first bytes. We count pool hits and misses per
+//  thread, and add them to the process totals in batches. When the thread
+//  exits, we free its pool and add its last counts.
+
+static volatile uint64_t s_pool_hits = 0;
+static volatile uint64_t s_pool_misses = 0;
+
+#if defined (__UNIX__)
+#define POOL_TYPES 2
+#define POOL_BATCH 256
+
+typedef struct {
+    void *objects [POOL_TYPES]; //  Free objects of each type
+    size_t size [POOL_TYPES];   //  Number of free objects of each type
+    uint64_t hits;              //  Hits not yet added to totals
+    uint64_t misses;            //  Misses not yet added to totals
+} s_pool_t;
+
+static CZMQ_THREADLS s_pool_t *s_pool = NULL;
+static pthread_key_t s_pool_key;
+static pthread_once_t s_pool_once = PTHREAD_ONCE_INIT;
+
+static void
+s_pool_flush (s_pool_t *pool)
+{
+    __sync_add_and_fetch (&s_pool_hits, pool->hits);
+    __sync_add_and_fetch (&s_pool_misses, pool->misses);
+    pool->hits = pool->misses = 0;
+}
+
+//  Free objects of each type beyond the limit
+
+static void
+s_pool_trim (s_pool_t *pool, size_t limit)
+{
+    int type;
+    for (type = 0; type < POOL_TYPES; type++)
+        while (pool->size [type] > limit) {
+            void *object = pool->objects [type];
+            pool->objects [type] = *(void **) object;
+            pool->size [type]--;
+            free (object);
+        }
+}
+
+static void
+s_pool_destroy (void *arg)
+{
+    s_pool_t *pool = (s_pool_t *) arg;
+    s_pool_trim (pool, 0);
+    s_pool_flush (pool);
+    free (pool);
+    s_pool = NULL;
+}
+
+static void
+s_pool_init (void)
+{
+    pthread_key_create (&s_pool_key, s_pool_destroy);
+}
+
+//  Free this thread's pool now, rather than when the thread exits. The
+//  key destructor does not run for the main thread, so zsys_shutdown uses
+//  this.
+
+static void
+s_pool_release (void)
+{
+    if (s_pool) {
+        pthread_setspecific (s_pool_key, NULL);
+        s_pool_destroy (s_pool);
+    }
+}
+
+//  Return this thread's pool, creating it if needed, or NULL if pooling
+//  is off or the pool could not be created. If pooling was switched off,
+//  frees the pool.
+
+static s_pool_t *
+s_pool_get (void)
+{
+    size_t limit = s_object_pool;
+    if (!s_pool && limit) {
+        pthread_once (&s_pool_once, s_pool_init);
+        s_pool = (s_pool_t *) zmalloc (sizeof (s_pool_t));
+        if (s_pool && pthread_setspecific (s_pool_key, s_pool)) {
+            free (s_pool);
+            s_pool = NULL;
+        }
+    }
+    else
+    if (s_pool && !limit)
+        s_pool_release ();
+    return s_pool;
+}
+#endif
+
 
 //  --------------------------------------------------------------------------
 //  Initialize CZMQ zsys layer; this happens automatically when you create
@@ -142,6 +275,12 @@ zsys_init (void)
     if (getenv ("ZSYS_PIPEHWM"))
         s_pipehwm = atoi (getenv ("ZSYS_PIPEHWM"));
 
+    if (getenv ("ZSYS_OBJECT_POOL"))
+        s_object_pool = atoi (getenv ("ZSYS_OBJECT_POOL"));
+
+    if (getenv ("ZSYS_SOCKET_STATS"))
+        s_socket_stats = atoi (getenv ("ZSYS_SOCKET_STATS"));
+
     if (getenv ("ZSYS_IPV6"))
         s_ipv6 = atoi (getenv ("ZSYS_IPV6"));
 
@@ -169,7 +308,8 @@ zsys_init (void)
 
     ZMUTEX_INIT (s_mutex);
     s_sockref_list = zlist_new ();
-    if (!s_sockref_list) {
+    s_statsref_list = zlist_new ();
+    if (!s_sockref_list || !s_statsref_list) {
         zsys_shutdown ();
         return NULL;
     }
@@ -191,6 +331,9 @@ zsys_init (void)
     if (getenv ("ZSYS_INTERFACE"))
         zsys_set_interface (getenv ("ZSYS_INTERFACE"));
 
+    if (getenv ("ZSYS_SOCKET_PROFILE"))
+        zsys_set_socket_profile (getenv ("ZSYS_SOCKET_PROFILE"));
+
     if (getenv ("ZSYS_LOGIDENT"))
         zsys_set_logident (getenv ("ZSYS_LOGIDENT"));
 
@@ -236,6 +379,12 @@ zsys_shutdown (void)
         sockref = (s_sockref_t *) zlist_pop (s_sockref_list);
     }
     zlist_destroy (&s_sockref_list);
+    s_statsref_t *statsref = (s_statsref_t *) zlist_pop (s_statsref_list);
+    while (statsref) {
+        free (statsref);
+        statsref = (s_statsref_t *) zlist_pop (s_statsref_list);
+    }
+    zlist_destroy (&s_statsref_list);
     ZMUTEX_UNLOCK (s_mutex);
 
     //  Close logsender socket if opened (don't do this in critical section)
@@ -250,9 +399,15 @@ zsys_shutdown (void)
 
     ZMUTEX_DESTROY (s_mutex);
 
+#if defined (__UNIX__)
+    s_pool_release ();
+#endif
     //  Free dynamically allocated properties
     free (s_interface);
     free (s_logident);
+    free (s_socket_profile);
+    s_socket_profile = NULL;
+    zconfig_destroy (&s_socket_profiles);
 
 #if defined (__UNIX__)
     closelog ();                //  Just to be pedantic
@@ -260,6 +415,144 @@ zsys_shutdown (void)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Socket tuning profiles
+
+//  Returns true if the socket is a PUB, SUB, PUSH, or PULL socket, which
+//  are the types that lossy profiles fit
+
+static bool
+s_profile_lossy_type (void *self)
+{
+    int type = zsock_type (self);
+    return type == ZMQ_PUB  || type == ZMQ_SUB
+        || type == ZMQ_PUSH || type == ZMQ_PULL;
+}
+
+//  ZMQ_CONFLATE asserts on some socket types, and drops frames of multipart
+//  messages on DEALER, so profiles only set it on lossy socket types
+
+static void
+s_set_conflate (void *self, int conflate)
+{
+#if (ZMQ_VERSION_MAJOR == 4)
+    if (s_profile_lossy_type (self))
+        zsock_set_conflate (self, conflate);
+#endif
+}
+
+//  These are the options that profiles may set, for this libzmq version
+
+static s_profile_option_t s_profile_options [] = {
+#if (ZMQ_VERSION_MAJOR == 4)
+    { "conflate",               s_set_conflate },
+    { "immediate",              zsock_set_immediate },
+    { "tos",                    zsock_set_tos },
+#endif
+#if (ZMQ_VERSION_MAJOR >= 3)
+    { "sndhwm",                 zsock_set_sndhwm },
+    { "rcvhwm",                 zsock_set_rcvhwm },
+    { "tcp_keepalive",          zsock_set_tcp_keepalive },
+    { "tcp_keepalive_idle",     zsock_set_tcp_keepalive_idle },
+    { "tcp_keepalive_cnt",      zsock_set_tcp_keepalive_cnt },
+    { "tcp_keepalive_intvl",    zsock_set_tcp_keepalive_intvl },
+#endif
+    { "affinity",               zsock_set_affinity },
+    { "rate",                   zsock_set_rate },
+    { "sndbuf",                 zsock_set_sndbuf },
+    { "rcvbuf",                 zsock_set_rcvbuf },
+    { "linger",                 zsock_set_linger },
+    { "reconnect_ivl",          zsock_set_reconnect_ivl },
+    { "backlog",                zsock_set_backlog },
+    { "sndtimeo",               zsock_set_sndtimeo },
+    { "rcvtimeo",               zsock_set_rcvtimeo },
+    { NULL, NULL }
+};
+
+//  These are the built-in profiles. Options this libzmq version does not
+//  support are skipped.
+
+static s_profile_setting_t s_builtin_profiles [] = {
+    //  Short queues so messages don't wait behind others, no queueing for
+    //  peers that are not connected yet, and fast detection of dead peers
+    { "low-latency",        "sndhwm",               1000 },
+    { "low-latency",        "rcvhwm",               1000 },
+    { "low-latency",        "immediate",            1 },
+    { "low-latency",        "linger",               0 },
+    { "low-latency",        "reconnect_ivl",        100 },
+    { "low-latency",        "tcp_keepalive",        1 },
+    { "low-latency",        "tcp_keepalive_idle",   10 },
+    { "low-latency",        "tcp_keepalive_intvl",  5 },
+    { "low-latency",        "tcp_keepalive_cnt",    3 },
+    //  Deep queues and large kernel buffers to keep the network busy, and
+    //  time to deliver queued messages when the socket closes
+    { "bulk-throughput",    "sndhwm",               100000 },
+    { "bulk-throughput",    "rcvhwm",               100000 },
+    { "bulk-throughput",    "sndbuf",               4 * 1024 * 1024 },
+    { "bulk-throughput",    "rcvbuf",               4 * 1024 * 1024 },
+    { "bulk-throughput",    "backlog",              1024 },
+    { "bulk-throughput",    "linger",               5000 },
+    //  Short queues, sends that fail rather than block, and only the latest
+    //  message kept; losing samples is fine. For PUB, SUB, PUSH, and PULL
+    //  sockets only, see s_profile_apply
+    { "lossy-telemetry",    "sndhwm",               100 },
+    { "lossy-telemetry",    "rcvhwm",               100 },
+    { "lossy-telemetry",    "sndtimeo",             0 },
+    { "lossy-telemetry",    "immediate",            1 },
+    { "lossy-telemetry",    "conflate",             1 },
+    { "lossy-telemetry",    "linger",               0 },
+    { NULL, NULL, 0 }
+};
+
+//  Look up a profile option by name, returns NULL if unknown
+
+static s_profile_option_t *
+s_profile_option (const char *name)
+{
+    s_profile_option_t *option;
+    for (option = s_profile_options; option->name; option++)
+        if (streq (option->name, name))
+            return option;
+    return NULL;
+}
+
+//  Apply a loaded or built-in profile to a socket; a loaded profile hides
+//  a built-in one of the same name. Returns 0 if OK, -1 if the profile is
+//  unknown, or is the built-in lossy-telemetry profile and the socket is
+//  not a PUB, SUB, PUSH, or PULL socket. Caller must hold s_mutex.
+
+static int
+s_profile_apply (void *self, const char *profile)
+{
+    zconfig_t *loaded = s_socket_profiles?
+        zconfig_locate (s_socket_profiles, profile): NULL;
+    if (loaded) {
+        zconfig_t *item = zconfig_child (loaded);
+        while (item) {
+            s_profile_option_t *option = s_profile_option (zconfig_name (item));
+            assert (option);    //  Checked when loaded
+            option->setter (self, atoi (zconfig_value (item)));
+            item = zconfig_next (item);
+        }
+        return 0;
+    }
+    if (streq (profile, "lossy-telemetry") && !s_profile_lossy_type (self))
+        return -1;
+
+    bool found = false;
+    s_profile_setting_t *setting;
+    for (setting = s_builtin_profiles; setting->profile; setting++) {
+        if (streq (setting->profile, profile)) {
+            s_profile_option_t *option = s_profile_option (setting->option);
+            if (option)
+                option->setter (self, setting->value);
+            found = true;
+        }
+    }
+    return found? 0: -1;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Get a new ZMQ socket, automagically creating a ZMQ context if this is
 //  the first time. Caller is responsible for destroying the ZMQ socket
@@ -295,6 +588,9 @@ zsys_socket (int type, const char *filename, size_t line_nbr)
         zsock_set_ipv4only (handle, s_ipv6? 0: 1);
 #   endif
 #endif
+        if (s_socket_profile && s_profile_apply (handle, s_socket_profile))
+            zsys_error ("cannot apply socket profile '%s' to %s socket",
+                        s_socket_profile, zsys_sockname (type));
         //  Add socket to reference tracker so we can report leaks; this is
         //  done only when the caller passes a filename/line_nbr
         if (filename) {
@@ -346,6 +642,82 @@ zsys_close (void *handle, const char *filename, size_t line_nbr)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Add one set of traffic counters into another
+
+static void
+s_stats_add (zsock_stats_t *totals, zsock_stats_t *stats)
+{
+    totals->msgs_sent += stats->msgs_sent;
+    totals->bytes_sent += stats->bytes_sent;
+    totals->msgs_received += stats->msgs_received;
+    totals->bytes_received += stats->bytes_received;
+    totals->send_again += stats->send_again;
+    totals->send_wait_usecs += stats->send_wait_usecs;
+    if (totals->send_wait_max_usecs < stats->send_wait_max_usecs)
+        totals->send_wait_max_usecs = stats->send_wait_max_usecs;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Register a zsock instance's traffic counters, so zsys_socket_stats can
+//  report them. Returns 0 if registered, or -1 if socket statistics are
+//  switched off, in which case the socket should not count its traffic.
+//  Not a part of the official interface; zsock calls this.
+
+int
+zsys_stats_register (zsock_stats_t *stats, int type, const char *filename, size_t line_nbr)
+{
+    assert (stats);
+    zsys_init ();
+    if (!s_socket_stats)
+        return -1;
+
+    s_statsref_t *statsref = (s_statsref_t *) zmalloc (sizeof (s_statsref_t));
+    if (!statsref)
+        return -1;
+    statsref->stats = stats;
+    statsref->type = type;
+    statsref->filename = filename;
+    statsref->line_nbr = line_nbr;
+    ZMUTEX_LOCK (s_mutex);
+    if (s_statsref_list)
+        zlist_append (s_statsref_list, statsref);
+    else {
+        free (statsref);
+        statsref = NULL;
+    }
+    ZMUTEX_UNLOCK (s_mutex);
+    return statsref? 0: -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Deregister a zsock instance's traffic counters, adding them to the totals
+//  for closed sockets. Not a part of the official interface; zsock calls
+//  this when it destroys a socket that counts its traffic.
+
+void
+zsys_stats_deregister (zsock_stats_t *stats)
+{
+    assert (stats);
+    ZMUTEX_LOCK (s_mutex);
+    if (s_statsref_list) {
+        s_statsref_t *statsref = (s_statsref_t *) zlist_first (s_statsref_list);
+        while (statsref) {
+            if (statsref->stats == stats) {
+                zlist_remove (s_statsref_list, statsref);
+                free (statsref);
+                break;
+            }
+            statsref = (s_statsref_t *) zlist_next (s_statsref_list);
+        }
+    }
+    s_stats_add (&s_stats_closed, stats);
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Return ZMQ socket name for socket type
 
@@ -1296,6 +1668,299 @@ zsys_pipehwm (void)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Configure how many destroyed zframe_t and zmsg_t objects each thread
+//  keeps for reuse, of each type, so that creating frames and messages on
+//  a busy thread does not go to the heap. The default is zero, which means
+//  no pooling. If the environment variable ZSYS_OBJECT_POOL is defined,
+//  that provides the default. Pooling only works on POSIX systems, where we
+//  can release a thread's pool when the thread exits.
+
+void
+zsys_set_object_pool (size_t object_pool)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    s_object_pool = object_pool;
+    ZMUTEX_UNLOCK (s_mutex);
+#if defined (__UNIX__)
+    //  Other threads free their pools when they next allocate, or exit
+    if (s_pool && object_pool == 0)
+        s_pool_release ();
+    else
+    if (s_pool)
+        s_pool_trim (s_pool, object_pool);
+#endif
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the number of objects each thread keeps for reuse, of each type.
+
+size_t
+zsys_object_pool (void)
+{
+    return s_object_pool;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return how many zframe_t and zmsg_t objects were taken from a thread
+//  pool (hits), and how many were allocated because the pool was empty
+//  (misses), since the process started. Each thread adds its counts to
+//  the totals in batches, and when it exits, so the totals may trail the
+//  latest activity.
+
+uint64_t
+zsys_object_pool_hits (void)
+{
+    return s_pool_hits;
+}
+
+uint64_t
+zsys_object_pool_misses (void)
+{
+    return s_pool_misses;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Allocate a zeroed object of the specified pool type and size, from this
+//  thread's pool if possible. Asserts if there is not enough memory, as
+//  zmalloc does. Not a part of the official interface; zframe and zmsg
+//  call this.
+
+void *
+zsys_pool_alloc (int type, size_t size)
+{
+#if defined (__UNIX__)
+    assert (type >= 0 && type < POOL_TYPES);
+    assert (size >= sizeof (void *));
+    s_pool_t *pool = s_pool_get ();
+    if (pool) {
+        void *object = pool->objects [type];
+        if (object) {
+            pool->objects [type] = *(void **) object;
+            pool->size [type]--;
+            memset (object, 0, size);
+            pool->hits++;
+        }
+        else {
+            object = zmalloc (size);
+            pool->misses++;
+        }
+        if (pool->hits + pool->misses == POOL_BATCH)
+            s_pool_flush (pool);
+        return object;
+    }
+#endif
+    return zmalloc (size);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Free an object from zsys_pool_alloc, keeping it in this thread's pool
+//  if possible. Not a part of the official interface; zframe and zmsg call
+//  this.
+
+void
+zsys_pool_free (int type, void *object)
+{
+#if defined (__UNIX__)
+    s_pool_t *pool = s_pool;
+    if (pool && pool->size [type] < s_object_pool) {
+        *(void **) object = pool->objects [type];
+        pool->objects [type] = object;
+        pool->size [type]++;
+        return;
+    }
+#endif
+    free (object);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Configure whether new zsock instances count their traffic, for zsock_stats
+//  and zsys_socket_stats. Counting costs a clock read on each blocking send,
+//  so it is off by default (socket_stats set to 0). If the environment
+//  variable ZSYS_SOCKET_STATS is defined (as 1 or 0), this provides the
+//  default. Sockets that already exist are not affected.
+
+void
+zsys_set_socket_stats (int socket_stats)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    s_socket_stats = socket_stats;
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the traffic counters of all zsock instances in the process that
+//  count their traffic, open or closed, added together. The wait maximum is
+//  the largest for any one socket. Each socket updates its counters without
+//  locking, so the values for open sockets may trail their latest activity.
+
+void
+zsys_socket_stats (zsock_stats_t *totals)
+{
+    assert (totals);
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    *totals = s_stats_closed;
+    if (s_statsref_list) {
+        s_statsref_t *statsref = (s_statsref_t *) zlist_first (s_statsref_list);
+        while (statsref) {
+            s_stats_add (totals, statsref->stats);
+            statsref = (s_statsref_t *) zlist_next (s_statsref_list);
+        }
+    }
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Log the traffic counters of each open zsock instance that counts its
+//  traffic, with the place it was created, to find hot or backed-up sockets.
+
+void
+zsys_socket_stats_print (void)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    if (s_statsref_list) {
+        s_statsref_t *statsref = (s_statsref_t *) zlist_first (s_statsref_list);
+        while (statsref) {
+            zsock_stats_t *stats = statsref->stats;
+            zsys_info ("%s socket created at %s:%d: sent %" PRIu64 "/%" PRIu64
+                       " msgs/bytes, received %" PRIu64 "/%" PRIu64 " msgs/bytes,"
+                       " %" PRIu64 " sends refused, blocked %" PRIu64
+                       " usecs (max %" PRIu64 ")",
+                       zsys_sockname (statsref->type),
+                       statsref->filename? statsref->filename: "(unknown)",
+                       (int) statsref->line_nbr,
+                       stats->msgs_sent, stats->bytes_sent,
+                       stats->msgs_received, stats->bytes_received,
+                       stats->send_again, stats->send_wait_usecs,
+                       stats->send_wait_max_usecs);
+            statsref = (s_statsref_t *) zlist_next (s_statsref_list);
+        }
+    }
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Set the socket tuning profile that new zsock instances get, after the
+//  other process defaults. This may be one of the built-in profiles,
+//  "low-latency", "bulk-throughput", or "lossy-telemetry", or a profile
+//  loaded with zsys_load_socket_profiles. The profile applies to every new
+//  socket, including actor pipes, so lossy profiles are rarely a good
+//  default. A socket whose type the profile does not fit gets no profile,
+//  and an error is logged. Set to NULL for no profile, which is the
+//  default. If the environment variable ZSYS_SOCKET_PROFILE is defined,
+//  that provides the default.
+
+void
+zsys_set_socket_profile (const char *profile)
+{
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    free (s_socket_profile);
+    s_socket_profile = profile? strdup (profile): NULL;
+    ZMUTEX_UNLOCK (s_mutex);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Return the socket tuning profile that new zsock instances get, or "" if
+//  none was set.
+
+const char *
+zsys_socket_profile (void)
+{
+    return s_socket_profile? s_socket_profile: "";
+}
+
+
+//  --------------------------------------------------------------------------
+//  Load socket tuning profiles from a configuration section. Each child of
+//  the section is a profile, named by the child, holding option = value
+//  items that name socket options without the ZMQ_ prefix, in lower case,
+//  for example:
+//
+//      socket_profiles
+//          market-data
+//              sndhwm = 50000
+//              conflate = 1
+//
+//  The options are sndhwm, rcvhwm, sndbuf, rcvbuf, linger, immediate,
+//  conflate, affinity, rate, reconnect_ivl, backlog, sndtimeo, rcvtimeo,
+//  tos, and the tcp_keepalive options, as far as the libzmq version
+//  supports them. A loaded profile replaces a built-in profile with the
+//  same name, and its options are added to any profile already loaded with
+//  that name. Returns the number of profiles loaded, or -1 if any option is
+//  unknown or has no value, in which case logs the error and loads nothing.
+
+int
+zsys_load_socket_profiles (zconfig_t *config)
+{
+    assert (config);
+    zconfig_t *profile = zconfig_child (config);
+    while (profile) {
+        zconfig_t *item = zconfig_child (profile);
+        while (item) {
+            if (!s_profile_option (zconfig_name (item))
+            ||  !zconfig_value (item)) {
+                zsys_error ("socket profile '%s': invalid option '%s'",
+                            zconfig_name (profile), zconfig_name (item));
+                return -1;
+            }
+            item = zconfig_next (item);
+        }
+        profile = zconfig_next (profile);
+    }
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    if (!s_socket_profiles)
+        s_socket_profiles = zconfig_new ("root", NULL);
+    int loaded = 0;
+    profile = zconfig_child (config);
+    while (profile) {
+        zconfig_t *item = zconfig_child (profile);
+        while (item) {
+            char *path = zsys_sprintf ("%s/%s", zconfig_name (profile), zconfig_name (item));
+            assert (path);
+            zconfig_put (s_socket_profiles, path, zconfig_value (item));
+            zstr_free (&path);
+            item = zconfig_next (item);
+        }
+        loaded++;
+        profile = zconfig_next (profile);
+    }
+    ZMUTEX_UNLOCK (s_mutex);
+    return loaded;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Apply a socket tuning profile to a socket. Not a part of the official
+//  interface; zsock_set_profile calls this.
+
+int
+zsys_socket_profile_apply (void *self, const char *profile)
+{
+    assert (self);
+    assert (profile);
+    zsys_init ();
+    ZMUTEX_LOCK (s_mutex);
+    int rc = s_profile_apply (self, profile);
+    ZMUTEX_UNLOCK (s_mutex);
+    return rc;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Configure use of IPv6 for new zsock instances. By default sockets accept
 //  and make only IPv4 connections. When you enable IPv6, sockets will accept
@@ -1599,6 +2264,61 @@ zsys_test (bool verbose)
     zsys_set_rcvhwm (1000);
     zsys_set_pipehwm (2500);
     assert (zsys_pipehwm () == 2500);
+    zsys_set_object_pool (64);
+    assert (zsys_object_pool () == 64);
+    zframe_t *pooled = zframe_new ("pool", 4);
+    zframe_destroy (&pooled);
+#if defined (__UNIX__)
+    assert (s_pool && s_pool->size [ZSYS_POOL_FRAME] == 1);
+#endif
+    //  Dropping the limit frees this thread's pool at once
+    zsys_set_object_pool (0);
+#if defined (__UNIX__)
+    assert (s_pool == NULL);
+#endif
+    zsys_set_socket_stats (1);
+    zsock_t *counted = zsock_new (ZMQ_PUB);
+    assert (counted);
+    zsys_set_socket_stats (0);
+    zsock_stats_t totals;
+    zsys_socket_stats (&totals);
+    zstr_send (counted, "Hello");
+    zsock_stats_t totals_after;
+    zsys_socket_stats (&totals_after);
+    assert (totals_after.msgs_sent == totals.msgs_sent + 1);
+    assert (totals_after.bytes_sent == totals.bytes_sent + 5);
+    if (verbose)
+        zsys_socket_stats_print ();
+    zsock_destroy (&counted);
+
+    //  Test socket tuning profiles from configuration, and as a default
+    zconfig_t *config = zconfig_str_load (
+        "socket_profiles\n"
+        "    deep-queues\n"
+        "        sndhwm = 5000\n"
+        "        rcvhwm = 6000\n");
+    assert (config);
+    assert (zsys_load_socket_profiles (zconfig_locate (config, "socket_profiles")) == 1);
+    zconfig_destroy (&config);
+    config = zconfig_str_load (
+        "socket_profiles\n"
+        "    broken\n"
+        "        no_such_option = 1\n");
+    assert (zsys_load_socket_profiles (zconfig_locate (config, "socket_profiles")) == -1);
+    zconfig_destroy (&config);
+
+    zsys_set_socket_profile ("deep-queues");
+    assert (streq (zsys_socket_profile (), "deep-queues"));
+    zsock_t *profiled = zsock_new (ZMQ_PUSH);
+    assert (profiled);
+    zsys_set_socket_profile (NULL);
+    assert (streq (zsys_socket_profile (), ""));
+#if (ZMQ_VERSION_MAJOR >= 3)
+    assert (zsock_sndhwm (profiled) == 5000);
+    assert (zsock_rcvhwm (profiled) == 6000);
+#endif
+    assert (zsock_set_profile (profiled, "broken") == -1);
+    zsock_destroy (&profiled);
     zsys_set_ipv6 (0);
 
     //  Test pipe creation